@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 Veeam Software Group GmbH <https://www.veeam.com/contacts.html>
+ *
+ * This file is part of libblksnap
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Lesser Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+/*
+ * The hi-level abstraction for the blksnap kernel module.
+ * Allows to export the snapshot image incrementally.
+ *
+ * The change tracker allows reading only the blocks that have been changed
+ * since the previous backup. The generation id and the change number of the
+ * current snapshot should be saved after the export and passed as the base
+ * for the next one. If the change tracker was reset since then, the whole
+ * image is exported.
+ */
+#include <memory>
+#include <string>
+#include <uuid/uuid.h>
+#include "Cbt.h"
+#include "SnapshotReader.h"
+
+namespace blksnap
+{
+    struct IIncrementalExport
+    {
+        virtual ~IIncrementalExport() = default;
+
+        /*
+         * Set the generation id and the change number of the snapshot from
+         * the previous export. Returns false if they do not match the
+         * current state of the change tracker. In this case, the whole image
+         * is exported.
+         */
+        virtual bool SetBase(const uuid_t& generationId, const uint8_t snapNumber) = 0;
+        /*
+         * Read the changed blocks of the snapshot image and call the callback
+         * for each portion of data.
+         */
+        virtual void Export(const ReaderCallback& callback) = 0;
+
+        virtual bool IsIncremental() = 0;
+        /*
+         * Provides the generation id and the change number that should be
+         * used as the base for the next export.
+         */
+        virtual std::shared_ptr<SCbtInfo> GetCbtInfo() = 0;
+        virtual unsigned long long GetCapacity() = 0;
+
+        static std::shared_ptr<IIncrementalExport> Create(const std::string& original,
+                                                          const SReaderConfig& config = SReaderConfig());
+    };
+}
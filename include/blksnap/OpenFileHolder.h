@@ -17,8 +17,16 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
-
+/*
+ * The hi-level abstraction for the blksnap kernel module.
+ * Allows to keep the file open and to share the open files.
+ */
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <sys/types.h>
 
 namespace blksnap
 {
@@ -32,4 +40,102 @@ namespace blksnap
     private:
         int m_fd;
     };
+
+    struct SHandleCacheStats
+    {
+        SHandleCacheStats()
+            : opens(0)
+            , hits(0)
+            , evictions(0)
+            , stale(0)
+            , cached(0)
+        {};
+
+        /*
+         * The number of files that were opened, and the number of requests
+         * that were satisfied by the files already open.
+         */
+        unsigned long long opens;
+        unsigned long long hits;
+        unsigned long long evictions;
+        /*
+         * The number of cached files that were reopened because the path
+         * began to point to another file. For example, the device was
+         * recreated.
+         */
+        unsigned long long stale;
+        size_t cached;
+    };
+
+    /*
+     * The process-wide cache of open files.
+     * The control file of the blksnap module is opened once and is shared
+     * by all objects. The block devices are kept open after use, and the
+     * least recently used of them are closed when the capacity of the cache
+     * is exceeded. The file remains open while at least one object uses it.
+     *
+     * While the control file is open, the module cannot be unloaded, so the
+     * Clear method should be called before that. The session manager
+     * releases the control file and the block devices of its sessions when
+     * it is destroyed. The files of a block device are released from the
+     * cache when the filter is detached from it.
+     */
+    class CHandleCache
+    {
+    public:
+        static CHandleCache& Instance();
+
+        std::shared_ptr<COpenFileHolder> Control();
+        std::shared_ptr<COpenFileHolder> Open(const std::string& filename, int flags);
+
+        /*
+         * Zero capacity disables caching of the block devices.
+         */
+        void SetCapacity(size_t capacity);
+        /*
+         * The flags for opening the block devices, O_DIRECT by default.
+         * They allow to open a device that does not support direct I/O.
+         */
+        void SetDeviceFlags(int flags);
+        int DeviceFlags();
+        void Clear();
+        /*
+         * Removes the control file from the cache. It is closed when the
+         * objects that use it are released.
+         */
+        void ReleaseControl();
+        /*
+         * Removes the files opened by the path from the cache. The file is
+         * closed when the objects that use it are released.
+         */
+        void Release(const std::string& filename);
+        SHandleCacheStats GetStats();
+
+    private:
+        CHandleCache();
+
+        struct SEntry
+        {
+            std::string key;
+            std::string filename;
+            std::shared_ptr<COpenFileHolder> file;
+            /*
+             * The identity of the open file. It is compared with the file
+             * that the path points to when the entry is found.
+             */
+            dev_t dev;
+            ino_t ino;
+            dev_t rdev;
+        };
+
+        void Evict();
+
+        std::mutex m_lock;
+        size_t m_capacity;
+        int m_deviceFlags;
+        std::shared_ptr<COpenFileHolder> m_control;
+        std::list<SEntry> m_lru;
+        std::unordered_map<std::string, std::list<SEntry>::iterator> m_index;
+        SHandleCacheStats m_stats;
+    };
 }
@@ -21,7 +21,9 @@
  * The hi-level abstraction for the blksnap kernel module.
  * Allows to show module kernel version.
  */
+#include <memory>
 #include <string>
+#include <system_error>
 #include <vector>
 #include "SnapshotId.h"
 #include "OpenFileHolder.h"
@@ -37,7 +39,15 @@ namespace blksnap
         void Collect(std::vector<CSnapshotId>& ids);
         void Version(unsigned short& major, unsigned short& minor, unsigned short& revision, unsigned short& build);
 
+        /*
+         * The variants that do not throw exceptions. The error is returned
+         * in ec, which is cleared on success.
+         */
+        void Collect(std::vector<CSnapshotId>& ids, std::error_code& ec) noexcept;
+        void Version(unsigned short& major, unsigned short& minor, unsigned short& revision, unsigned short& build,
+                     std::error_code& ec) noexcept;
+
     private:
-        COpenFileHolder m_ctl;
+        std::shared_ptr<COpenFileHolder> m_ctl;
     };
 }
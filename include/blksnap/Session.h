@@ -21,23 +21,170 @@
  * The hi-level abstraction for the blksnap kernel module.
  * Allows to create snapshot session.
  */
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 #include "Sector.h"
+#include "Snapshot.h"
 
 namespace blksnap
 {
+    /*
+     * The time in microseconds spent on each phase of the session creation.
+     */
+    struct SSessionStats
+    {
+        SSessionStats()
+            : attachUs(0)
+            , createUs(0)
+            , addUs(0)
+            , takeUs(0)
+            , frozenUs(0)
+            , devices(0)
+            , threads(0)
+        {};
+
+        unsigned long long attachUs;
+        unsigned long long createUs;
+        unsigned long long addUs;
+        unsigned long long takeUs;
+        /*
+         * The time while the file systems were frozen according to the
+         * kernel module.
+         */
+        unsigned long long frozenUs;
+        unsigned int devices;
+        unsigned int threads;
+    };
+
+    /*
+     * The policy of extending the difference storage on a block device.
+     * When the free space in the difference storage is running out, the spare
+     * devices are appended to it one by one. When they run out, the callback
+     * is called with the recommended size in sectors. It can, for example,
+     * extend the logical volume that is already used as the difference
+     * storage, and return the path to the device that should be appended or
+     * whose new size should be taken into account. An empty string means that
+     * the difference storage cannot be extended.
+     */
+    struct SDiffStorageExtension
+    {
+        std::vector<std::string> spareDevices;
+        std::function<std::string(unsigned long long requestedSectors)> extend;
+    };
+
+    /*
+     * The number of events with the same code received from the snapshot
+     * and the time label of the last one. The time label is the monotonic
+     * time of the kernel in nanoseconds.
+     */
+    struct SSessionEventCounter
+    {
+        SSessionEventCounter()
+            : count(0)
+            , lastTime(0)
+        {};
+
+        unsigned long long count;
+        long long lastTime;
+    };
+
+    /*
+     * The callback is called from the thread that receives the events, so it
+     * should not block for a long time.
+     */
+    using SessionEventCallback = std::function<void(const SBlksnapEvent& ev)>;
+
     struct ISession
     {
         virtual ~ISession() = default;
 
         virtual bool GetError(std::string& errorMessage) = 0;
+        virtual SSessionStats GetStats() = 0;
+        /*
+         * Set the callback that is called for each event received from the
+         * snapshot before the session handles it.
+         */
+        virtual void OnEvent(const SessionEventCallback& callback) = 0;
+        virtual SSessionEventCounter GetEventCounter(const unsigned int code) = 0;
 
+        /*
+         * The devices are attached and added to the snapshot in parallel
+         * by no more than maxThreads threads. If maxThreads is zero, the
+         * number of threads is selected automatically.
+         */
         static std::shared_ptr<ISession> Create(
             const std::vector<std::string>& devices,
             const std::string& diffStorageFilePath,
-            const unsigned long long limit);
+            const unsigned long long limit,
+            const unsigned int maxThreads = 0);
+        static std::shared_ptr<ISession> Create(
+            const std::vector<std::string>& devices,
+            const std::string& diffStorageFilePath,
+            const unsigned long long limit,
+            const SDiffStorageExtension& extension,
+            const unsigned int maxThreads = 0);
+    };
+
+    /*
+     * The aggregate statistics of all sessions of the session manager.
+     * The time is the sum for all sessions created by the manager.
+     */
+    struct SSessionManagerStats
+    {
+        SSessionManagerStats()
+            : sessions(0)
+            , sessionsCreated(0)
+            , devices(0)
+            , events(0)
+            , threads(0)
+            , attachUs(0)
+            , createUs(0)
+            , addUs(0)
+            , takeUs(0)
+            , frozenUs(0)
+        {};
+
+        /*
+         * The number of sessions that exist now and the devices in them.
+         */
+        unsigned int sessions;
+        unsigned long long sessionsCreated;
+        unsigned int devices;
+        /*
+         * The number of events received from all snapshots.
+         */
+        unsigned long long events;
+        unsigned int threads;
+        unsigned long long attachUs;
+        unsigned long long createUs;
+        unsigned long long addUs;
+        unsigned long long takeUs;
+        unsigned long long frozenUs;
     };
 
+    /*
+     * Allows to hold several snapshot sessions at once.
+     * The events of all snapshots are received by one thread, and the devices
+     * of all sessions are attached and added by one shared pool of threads.
+     * The sessions should be released before the manager.
+     */
+    struct ISessionManager
+    {
+        virtual ~ISessionManager() = default;
+
+        virtual std::shared_ptr<ISession> CreateSession(
+            const std::vector<std::string>& devices,
+            const std::string& diffStorageFilePath,
+            const unsigned long long limit,
+            const SDiffStorageExtension& extension = SDiffStorageExtension()) = 0;
+        virtual SSessionManagerStats GetStats() = 0;
+
+        /*
+         * The pool contains no more than maxThreads threads. If maxThreads
+         * is zero, the number of threads is selected automatically.
+         */
+        static std::shared_ptr<ISessionManager> Create(const unsigned int maxThreads = 0);
+    };
 }
@@ -25,6 +25,8 @@
 
 #include <memory>
 #include <string>
+#include <system_error>
+#include <vector>
 #include "Sector.h"
 #include "SnapshotId.h"
 #include "OpenFileHolder.h"
@@ -44,6 +46,12 @@ namespace blksnap
         unsigned long long requestedSectors;
     };
 
+    struct SBlksnapEventLowSpace
+    {
+        unsigned long long freeSectors;
+        unsigned long long requestedSectors;
+    };
+
     struct SBlksnapEvent
     {
         unsigned int code;
@@ -52,9 +60,77 @@ namespace blksnap
         {
             struct SBlksnapEventCorrupted corrupted;
             struct SBlksnapEventNoSpace noSpace;
+            struct SBlksnapEventLowSpace lowSpace;
         };
     };
 
+    struct SDeviceTakeTiming
+    {
+        unsigned int origDevIdMj;
+        unsigned int origDevIdMn;
+        unsigned long long freezeNs;
+        unsigned long long switchNs;
+        unsigned long long thawNs;
+    };
+
+    /*
+     * The time spent by the kernel module on taking the snapshot.
+     * If the module does not provide it or it cannot be received after the
+     * snapshot is taken, the time is zero and the list of devices is empty.
+     */
+    struct STakeTiming
+    {
+        STakeTiming()
+            : takeNs(0)
+            , frozenNs(0)
+        {};
+
+        unsigned long long takeNs;
+        unsigned long long frozenNs;
+        std::vector<SDeviceTakeTiming> devices;
+    };
+
+    struct SDeviceStats
+    {
+        unsigned int origDevIdMj;
+        unsigned int origDevIdMn;
+        unsigned long long chunkSize;
+        unsigned long long chunkCount;
+        unsigned long long chunkNew;
+        unsigned long long chunkInMemory;
+        unsigned long long chunkStored;
+        unsigned long long chunkFailed;
+        unsigned long long copiedSectors;
+        unsigned long long imageRedirectedSectors;
+        unsigned long long imageMemorySectors;
+        unsigned long long imageStoredSectors;
+    };
+
+    /*
+     * The statistics of the snapshot collected by the kernel module: the
+     * size of the difference storage and the work of the copy-on-write
+     * algorithm and the snapshot images for each device.
+     */
+    struct SSnapshotStats
+    {
+        SSnapshotStats()
+            : capacitySectors(0)
+            , limitSectors(0)
+            , filledSectors(0)
+            , requestedSectors(0)
+            , reallocateCount(0)
+            , reallocateNs(0)
+        {};
+
+        unsigned long long capacitySectors;
+        unsigned long long limitSectors;
+        unsigned long long filledSectors;
+        unsigned long long requestedSectors;
+        unsigned long long reallocateCount;
+        unsigned long long reallocateNs;
+        std::vector<SDeviceStats> devices;
+    };
+
     class CSnapshot
     {
     public:
@@ -64,9 +140,32 @@ namespace blksnap
     public:
         virtual ~CSnapshot() {};
 
-        void Take();
+        STakeTiming Take();
+        STakeTiming Timing();
         void Destroy();
         bool WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev);
+        /*
+         * Append the block device to the difference storage on a block
+         * device. Returns false if the block device is already used by the
+         * difference storage and its size has not been increased.
+         */
+        bool AppendStorage(const std::string& devicePath);
+        SSnapshotStats Stats();
+
+        /*
+         * The variants that do not throw exceptions. The error is returned
+         * in ec, which is cleared on success. The Take variant does not
+         * request the timing. WaitEvent returns EBADMSG if the code of the
+         * received event is unknown, and ev.code contains it.
+         */
+        static std::shared_ptr<CSnapshot> Create(const std::string& filePath, const unsigned long long limit,
+                                                 std::error_code& ec) noexcept;
+        void Take(std::error_code& ec) noexcept;
+        STakeTiming Timing(std::error_code& ec) noexcept;
+        void Destroy(std::error_code& ec) noexcept;
+        bool WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev, std::error_code& ec) noexcept;
+        bool AppendStorage(const std::string& devicePath, std::error_code& ec) noexcept;
+        SSnapshotStats Stats(std::error_code& ec) noexcept;
 
         const CSnapshotId& Id() const
         {
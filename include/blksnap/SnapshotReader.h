@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2022 Veeam Software Group GmbH <https://www.veeam.com/contacts.html>
+ *
+ * This file is part of libblksnap
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Lesser Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+/*
+ * The hi-level abstraction for the blksnap kernel module.
+ * Allows to read the snapshot image.
+ *
+ * The image is opened with O_DIRECT and is read by several workers. Each
+ * worker has its own asynchronous I/O queue and its own pool of aligned
+ * buffers. The io_uring interface is used if the kernel supports it,
+ * otherwise the Linux native AIO is used, and the synchronous reading is the
+ * last fallback.
+ */
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Cbt.h"
+#include "Sector.h"
+
+namespace blksnap
+{
+    enum EIoEngine
+    {
+        eIoEngineAuto,
+        eIoEngineUring,
+        eIoEngineAio,
+        eIoEngineSync,
+    };
+
+    struct SReaderConfig
+    {
+        SReaderConfig()
+            : blockSize(1024 * 1024)
+            , queueDepth(16)
+            , workers(2)
+            , ordered(true)
+            , engine(eIoEngineAuto)
+        {};
+
+        /*
+         * Size of a single read request in bytes.
+         * It is rounded up to the logical block size of the image.
+         */
+        size_t blockSize;
+        /*
+         * Number of read requests that each worker keeps in flight.
+         */
+        unsigned int queueDepth;
+        /*
+         * Number of worker threads.
+         */
+        unsigned int workers;
+        /*
+         * If set, the callback is called in the order of the offset, one
+         * call at a time. Otherwise, the callback is called from workers as
+         * soon as the data is read, and it must be thread-safe.
+         */
+        bool ordered;
+        EIoEngine engine;
+    };
+
+    /*
+     * The callback receives the range of the image in sectors and the buffer
+     * with its data. The buffer is valid only during the call.
+     */
+    using ReaderCallback = std::function<void(const SRange& range, const void* buffer)>;
+
+    struct ISnapshotReader
+    {
+        virtual ~ISnapshotReader() = default;
+
+        /*
+         * Limit reading to the ranges of the image. By default, the whole
+         * image is read.
+         */
+        virtual void SetRanges(const std::vector<SRange>& ranges) = 0;
+        /*
+         * Limit reading to the blocks that have been changed since the
+         * snapshot with the snapNumber change number, according to the CBT
+         * map.
+         */
+        virtual void SetCbtFilter(const SCbtInfo& cbtInfo, const SCbtData& cbtData, const uint8_t snapNumber) = 0;
+        /*
+         * Read the ranges and call the callback for each portion of data.
+         * Returns when all the data has been read. If an error occurs,
+         * reading is stopped and the exception is rethrown.
+         */
+        virtual void Read(const ReaderCallback& callback) = 0;
+
+        virtual EIoEngine GetEngine() = 0;
+        virtual unsigned long long GetCapacity() = 0;
+
+        static std::shared_ptr<ISnapshotReader> Create(const std::string& imagePath,
+                                                       const SReaderConfig& config = SReaderConfig());
+    };
+}
@@ -23,12 +23,15 @@
  * flexibility. Uses structures that are directly passed to the kernel module.
  */
 
+#include <memory>
 #include <stdint.h>
 #include <string>
+#include <system_error>
 #include <uuid/uuid.h>
 #include <vector>
 
 #include "Sector.h"
+#include "OpenFileHolder.h"
 #include <linux/fs.h>
 #include <linux/blksnap.h>
 
@@ -49,7 +52,22 @@ namespace blksnap
         void SnapshotAdd(const uuid_t& id);
         void SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo);
 
+        /*
+         * The variants that do not throw exceptions. The error is returned
+         * in ec, which is cleared on success. They allow to poll the state
+         * of many devices, when an error is an expected result.
+         */
+        bool Attach(std::error_code& ec) noexcept;
+        void Detach(std::error_code& ec) noexcept;
+        void CbtInfo(struct blksnap_cbtinfo& cbtInfo, std::error_code& ec) noexcept;
+        void ReadCbtMap(unsigned int offset, unsigned int length, uint8_t* buff, std::error_code& ec) noexcept;
+        void MarkDirtyBlock(std::vector<struct blksnap_sectors>& ranges, std::error_code& ec) noexcept;
+        void SnapshotAdd(const uuid_t& id, std::error_code& ec) noexcept;
+        void SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo, std::error_code& ec) noexcept;
+
     private:
+        std::string m_devicePath;
+        std::shared_ptr<COpenFileHolder> m_device;
         int m_fd;
     };
 
@@ -193,6 +193,9 @@ enum blksnap_ioctl {
 	BLKSNAP_IOCTL_SNAPSHOT_TAKE = 3,
 	BLKSNAP_IOCTL_SNAPSHOT_COLLECT = 4,
 	BLKSNAP_IOCTL_SNAPSHOT_WAIT_EVENT = 5,
+	BLKSNAP_IOCTL_SNAPSHOT_TIMING = 6,
+	BLKSNAP_IOCTL_SNAPSHOT_APPEND_STORAGE = 7,
+	BLKSNAP_IOCTL_SNAPSHOT_STATS = 8,
 };
 
 /**
@@ -344,10 +347,15 @@ struct blksnap_snapshot_collect {
  *	No more space left in the difference storage.
  *	This event is generated at the moment when the difference storage resize
  *	request cannot be satisfied.
+ * @blksnap_event_code_low_space:
+ *	The free space in the difference storage on a block device is running
+ *	out. The difference storage on a block device does not grow by itself,
+ *	but it can be extended by &IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE.
  */
 enum blksnap_event_codes {
 	blksnap_event_code_corrupted,
 	blksnap_event_code_no_space,
+	blksnap_event_code_low_space,
 };
 
 /**
@@ -415,4 +423,228 @@ struct blksnap_event_no_space {
 	__u64 requested_nr_sect;
 };
 
+/**
+ * struct blksnap_event_low_space - Data for the
+ *	&blksnap_event_code_low_space event.
+ * @free_nr_sect:
+ *	The number of free sectors left in the difference storage.
+ * @requested_nr_sect:
+ *	The recommended number of sectors to extend the difference storage.
+ */
+struct blksnap_event_low_space {
+	__u64 free_nr_sect;
+	__u64 requested_nr_sect;
+};
+
+/**
+ * struct blksnap_device_timing - The time spent on taking the snapshot of
+ *	the block device.
+ *
+ * @dev_id_mj:
+ *	Major part of original device ID.
+ * @dev_id_mn:
+ *	Minor part of original device ID.
+ * @freeze_ns:
+ *	The time of freezing the file system in nanoseconds.
+ * @switch_ns:
+ *	The time of switching the change tracker tables and enabling COW in
+ *	nanoseconds.
+ * @thaw_ns:
+ *	The time of thawing the file system in nanoseconds.
+ */
+struct blksnap_device_timing {
+	__u32 dev_id_mj;
+	__u32 dev_id_mn;
+	__u64 freeze_ns;
+	__u64 switch_ns;
+	__u64 thaw_ns;
+};
+
+/**
+ * struct blksnap_snapshot_timing - Argument for the
+ *	&IOCTL_BLKSNAP_SNAPSHOT_TIMING control.
+ *
+ * @id:
+ *	Snapshot ID.
+ * @take_ns:
+ *	The time of taking the snapshot in nanoseconds.
+ * @frozen_ns:
+ *	The time from the beginning of freezing the first block device to the
+ *	end of thawing the last one in nanoseconds.
+ * @count:
+ *	Size of &blksnap_snapshot_timing.devices in the number of
+ *	struct blksnap_device_timing.
+ * @devices:
+ *	Pointer to the array of struct blksnap_device_timing for output.
+ */
+struct blksnap_snapshot_timing {
+	struct blksnap_uuid id;
+	__u64 take_ns;
+	__u64 frozen_ns;
+	__u32 count;
+	__u64 devices;
+};
+
+/**
+ * define IOCTL_BLKSNAP_SNAPSHOT_TIMING - Get the time spent on taking the
+ *	snapshot.
+ *
+ * While the file systems are frozen, the applications cannot write to the
+ * block devices. The control allows to find out how long it took for each
+ * block device.
+ *
+ * The array &blksnap_snapshot_timing.devices is filled in the same way as
+ * for &IOCTL_BLKSNAP_SNAPSHOT_COLLECT. If the pointer is null, the required
+ * array size is set in &blksnap_snapshot_timing.count.
+ *
+ * Return: 0 if succeeded, -ENODATA if there is not enough space in the array,
+ * or negative errno otherwise.
+ */
+#define IOCTL_BLKSNAP_SNAPSHOT_TIMING						\
+	_IOWR(BLKSNAP, BLKSNAP_IOCTL_SNAPSHOT_TIMING,				\
+	     struct blksnap_snapshot_timing)
+
+/**
+ * struct blksnap_snapshot_append_storage - Argument for the
+ *	&IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE control.
+ *
+ * @id:
+ *	Snapshot ID.
+ * @devpath:
+ *	Pointer to the null-terminated string with the path to the block
+ *	device.
+ */
+struct blksnap_snapshot_append_storage {
+	struct blksnap_uuid id;
+	__u64 devpath;
+};
+
+/**
+ * define IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE - Append a block device to the
+ *	difference storage.
+ *
+ * Only the difference storage on a block device can be appended. The block
+ * device is used when the free space on the current one runs out. If the
+ * block device is already used by the difference storage, for example, it is
+ * a logical volume that has been extended, its new size is taken into
+ * account.
+ *
+ * Return: 0 if succeeded, -EALREADY if the block device is already used and
+ * its size has not been increased, or negative errno otherwise.
+ */
+#define IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE					\
+	_IOW(BLKSNAP, BLKSNAP_IOCTL_SNAPSHOT_APPEND_STORAGE,			\
+	     struct blksnap_snapshot_append_storage)
+
+/**
+ * struct blksnap_device_stats - The statistics of the difference area of the
+ *	block device.
+ *
+ * @dev_id_mj:
+ *	Major part of original device ID.
+ * @dev_id_mn:
+ *	Minor part of original device ID.
+ * @chunk_size:
+ *	The size of the chunk in bytes.
+ * @chunk_count:
+ *	The number of chunks into which the block device is divided.
+ * @chunk_new:
+ *	The number of chunks whose data has not been read yet.
+ * @chunk_in_memory:
+ *	The number of chunks whose data is in memory.
+ * @chunk_stored:
+ *	The number of chunks whose data has been written to the difference
+ *	storage.
+ * @chunk_failed:
+ *	The number of chunks that failed to be processed.
+ * @copied_sect:
+ *	The number of sectors copied from the original block device to preserve
+ *	the snapshot image.
+ * @image_redirected_sect:
+ *	The number of sectors read from the snapshot image that were redirected
+ *	to the original block device.
+ * @image_memory_sect:
+ *	The number of sectors read from the snapshot image that were copied from
+ *	the chunks in memory.
+ * @image_stored_sect:
+ *	The number of sectors read from the snapshot image that were read from
+ *	the difference storage.
+ *
+ * The chunks that have not been accessed are absent from the chunk map and
+ * are not counted in any state. Before the snapshot is taken, all values
+ * except the device ID are zero.
+ */
+struct blksnap_device_stats {
+	__u32 dev_id_mj;
+	__u32 dev_id_mn;
+	__u64 chunk_size;
+	__u64 chunk_count;
+	__u64 chunk_new;
+	__u64 chunk_in_memory;
+	__u64 chunk_stored;
+	__u64 chunk_failed;
+	__u64 copied_sect;
+	__u64 image_redirected_sect;
+	__u64 image_memory_sect;
+	__u64 image_stored_sect;
+};
+
+/**
+ * struct blksnap_snapshot_stats - Argument for the
+ *	&IOCTL_BLKSNAP_SNAPSHOT_STATS control.
+ *
+ * @id:
+ *	Snapshot ID.
+ * @capacity_sect:
+ *	Total amount of available difference storage space in sectors,
+ *	including all block devices appended to the difference storage.
+ * @limit_sect:
+ *	The limit to which the difference storage can be allowed to grow in
+ *	sectors.
+ * @filled_sect:
+ *	The number of sectors of the difference storage already filled in on
+ *	all its block devices.
+ * @requested_sect:
+ *	The number of sectors of the difference storage already requested.
+ * @reallocate_count:
+ *	The number of times the difference storage file has been expanded.
+ * @reallocate_ns:
+ *	The time spent on expanding the difference storage file in nanoseconds.
+ * @count:
+ *	Size of &blksnap_snapshot_stats.devices in the number of
+ *	struct blksnap_device_stats.
+ * @devices:
+ *	Pointer to the array of struct blksnap_device_stats for output.
+ */
+struct blksnap_snapshot_stats {
+	struct blksnap_uuid id;
+	__u64 capacity_sect;
+	__u64 limit_sect;
+	__u64 filled_sect;
+	__u64 requested_sect;
+	__u64 reallocate_count;
+	__u64 reallocate_ns;
+	__u32 count;
+	__u64 devices;
+};
+
+/**
+ * define IOCTL_BLKSNAP_SNAPSHOT_STATS - Get the statistics of the snapshot.
+ *
+ * The control allows to find out how the difference storage is filled and
+ * how the copy-on-write algorithm and the snapshot images work for each
+ * block device. The values are not consistent with each other, since they
+ * are collected while the snapshot is in use.
+ *
+ * The array &blksnap_snapshot_stats.devices is filled in the same way as
+ * for &IOCTL_BLKSNAP_SNAPSHOT_COLLECT. If the pointer is null, the required
+ * array size is set in &blksnap_snapshot_stats.count.
+ *
+ * Return: 0 if succeeded, -ENODATA if there is not enough space in the array,
+ * or negative errno otherwise.
+ */
+#define IOCTL_BLKSNAP_SNAPSHOT_STATS						\
+	_IOWR(BLKSNAP, BLKSNAP_IOCTL_SNAPSHOT_STATS,				\
+	     struct blksnap_snapshot_stats)
+
 #endif /* _UAPI_LINUX_BLKSNAP_H */
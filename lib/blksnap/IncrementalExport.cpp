@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 Veeam Software Group GmbH <https://www.veeam.com/contacts.html>
+ *
+ * This file is part of libblksnap
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Lesser Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <blksnap/IncrementalExport.h>
+#include <system_error>
+
+using namespace blksnap;
+
+class CIncrementalExport : public IIncrementalExport
+{
+public:
+    CIncrementalExport(const std::string& original, const SReaderConfig& config);
+    ~CIncrementalExport() override
+    {};
+
+    bool SetBase(const uuid_t& generationId, const uint8_t snapNumber) override;
+    void Export(const ReaderCallback& callback) override;
+
+    bool IsIncremental() override
+    {
+        return m_incremental;
+    };
+    std::shared_ptr<SCbtInfo> GetCbtInfo() override
+    {
+        return m_cbtInfo;
+    };
+    unsigned long long GetCapacity() override
+    {
+        return m_reader->GetCapacity();
+    };
+
+private:
+    std::string m_original;
+    std::shared_ptr<ICbt> m_cbt;
+    std::shared_ptr<SCbtInfo> m_cbtInfo;
+    std::shared_ptr<ISnapshotReader> m_reader;
+    bool m_incremental;
+};
+
+std::shared_ptr<IIncrementalExport> IIncrementalExport::Create(const std::string& original,
+                                                               const SReaderConfig& config)
+{
+    return std::make_shared<CIncrementalExport>(original, config);
+}
+
+CIncrementalExport::CIncrementalExport(const std::string& original, const SReaderConfig& config)
+    : m_original(original)
+    , m_cbt(ICbt::Create(original))
+    , m_incremental(false)
+{
+    std::string image = m_cbt->GetImage();
+    if (image == "/dev/")
+        throw std::system_error(ENOENT, std::generic_category(),
+                                "The snapshot was not taken for the device [" + m_original + "].");
+
+    int error = m_cbt->GetError();
+    if (error)
+        throw std::system_error(error, std::generic_category(),
+                                "The snapshot of the device [" + m_original + "] is corrupted.");
+
+    /*
+     * The change tracker state should be received after the snapshot is
+     * taken. Then it describes the changes up to the moment of the snapshot.
+     */
+    m_cbtInfo = m_cbt->GetCbtInfo();
+    m_reader = ISnapshotReader::Create(image, config);
+}
+
+bool CIncrementalExport::SetBase(const uuid_t& generationId, const uint8_t snapNumber)
+{
+    /*
+     * The change number of the base cannot be greater than the current one
+     * in the same generation. If it is, then the base was not created by
+     * this change tracker.
+     */
+    if (uuid_compare(generationId, m_cbtInfo->generationId) || (snapNumber > m_cbtInfo->snapNumber))
+    {
+        m_incremental = false;
+        return false;
+    }
+
+    auto cbtData = m_cbt->GetCbtData();
+    m_reader->SetCbtFilter(*m_cbtInfo, *cbtData, snapNumber);
+    m_incremental = true;
+    return true;
+}
+
+void CIncrementalExport::Export(const ReaderCallback& callback)
+{
+    if (!m_incremental)
+        m_reader->SetRanges({SRange(0, m_reader->GetCapacity() >> SECTOR_SHIFT)});
+
+    m_reader->Read(callback);
+}
@@ -23,8 +23,10 @@
 #include <stdlib.h>
 #include <unistd.h>
  #include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <system_error>
+#include <linux/blksnap.h>
 
 using namespace blksnap;
 
@@ -45,3 +47,149 @@ int COpenFileHolder::Get()
 {
     return m_fd;
 };
+
+static const char* blksnap_filename = "/dev/" BLKSNAP_CTL;
+
+/*
+ * It is enough for hundreds of devices to be polled without reopening.
+ */
+static const size_t handleCacheCapacityDefault = 256;
+
+CHandleCache& CHandleCache::Instance()
+{
+    static CHandleCache cache;
+
+    return cache;
+}
+
+CHandleCache::CHandleCache()
+    : m_capacity(handleCacheCapacityDefault)
+    , m_deviceFlags(O_DIRECT)
+{ }
+
+std::shared_ptr<COpenFileHolder> CHandleCache::Control()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_control)
+        m_stats.hits++;
+    else
+    {
+        m_control = std::make_shared<COpenFileHolder>(blksnap_filename, O_RDWR);
+        m_stats.opens++;
+    }
+    return m_control;
+}
+
+std::shared_ptr<COpenFileHolder> CHandleCache::Open(const std::string& filename, int flags)
+{
+    const std::string key = filename + "\n" + std::to_string(flags);
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        struct stat st;
+
+        // Check that the path still points to the file that is open
+        if (!::stat(filename.c_str(), &st) && (st.st_dev == it->second->dev) &&
+            (st.st_ino == it->second->ino) && (st.st_rdev == it->second->rdev))
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            m_stats.hits++;
+            return it->second->file;
+        }
+
+        m_lru.erase(it->second);
+        m_index.erase(it);
+        m_stats.stale++;
+    }
+
+    auto file = std::make_shared<COpenFileHolder>(filename, flags);
+    m_stats.opens++;
+    if (!m_capacity)
+        return file;
+
+    struct stat st;
+    if (::fstat(file->Get(), &st))
+        return file;
+
+    m_lru.push_front({key, filename, file, st.st_dev, st.st_ino, st.st_rdev});
+    m_index[key] = m_lru.begin();
+    Evict();
+    return file;
+}
+
+void CHandleCache::Evict()
+{
+    while (m_lru.size() > m_capacity)
+    {
+        m_index.erase(m_lru.back().key);
+        m_lru.pop_back();
+        m_stats.evictions++;
+    }
+}
+
+void CHandleCache::SetCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_capacity = capacity;
+    Evict();
+}
+
+void CHandleCache::SetDeviceFlags(int flags)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_deviceFlags = flags;
+}
+
+int CHandleCache::DeviceFlags()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_deviceFlags;
+}
+
+void CHandleCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_control.reset();
+    m_index.clear();
+    m_lru.clear();
+}
+
+void CHandleCache::ReleaseControl()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_control.reset();
+}
+
+void CHandleCache::Release(const std::string& filename)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto it = m_lru.begin(); it != m_lru.end();)
+    {
+        if (it->filename != filename)
+        {
+            it++;
+            continue;
+        }
+
+        m_index.erase(it->key);
+        it = m_lru.erase(it);
+    }
+}
+
+SHandleCacheStats CHandleCache::GetStats()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    SHandleCacheStats stats = m_stats;
+
+    stats.cached = m_lru.size() + (m_control ? 1 : 0);
+    return stats;
+}
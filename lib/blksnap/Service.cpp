@@ -30,21 +30,28 @@
 #include <sstream>
 
 
-static const char* blksnap_filename = "/dev/" BLKSNAP_CTL;
-
 using namespace blksnap;
 
 CService::CService()
-    : m_ctl(blksnap_filename, O_RDWR)
+    : m_ctl(CHandleCache::Instance().Control())
 { }
 
-void CService::Version(unsigned short& major, unsigned short& minor, unsigned short& revision, unsigned short& build)
+static inline void Ioctl(int fd, unsigned long request, void* arg, std::error_code& ec) noexcept
+{
+    if (::ioctl(fd, request, arg))
+        ec.assign(errno, std::generic_category());
+    else
+        ec.clear();
+}
+
+void CService::Version(unsigned short& major, unsigned short& minor, unsigned short& revision, unsigned short& build,
+                       std::error_code& ec) noexcept
 {
     struct blksnap_version version = {};
 
-    if (::ioctl(m_ctl.Get(), IOCTL_BLKSNAP_VERSION, &version))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to get version.");
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_VERSION, &version, ec);
+    if (ec)
+        return;
 
     major = version.major;
     minor = version.minor;
@@ -52,25 +59,47 @@ void CService::Version(unsigned short& major, unsigned short& minor, unsigned sh
     build = version.build;
 }
 
-void CService::Collect(std::vector<CSnapshotId>& ids)
+void CService::Version(unsigned short& major, unsigned short& minor, unsigned short& revision, unsigned short& build)
+{
+    std::error_code ec;
+
+    Version(major, minor, revision, build, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to get version.");
+}
+
+void CService::Collect(std::vector<CSnapshotId>& ids, std::error_code& ec) noexcept
 {
     struct blksnap_snapshot_collect param = {0};
 
     ids.clear();
-    if (::ioctl(m_ctl.Get(), IOCTL_BLKSNAP_SNAPSHOT_COLLECT, &param))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to get list of active snapshots.");
-
-    if (param.count == 0)
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_COLLECT, &param, ec);
+    if (ec || (param.count == 0))
         return;
 
-    std::vector<struct blksnap_uuid> id_array(param.count);
-    param.ids = (__u64)id_array.data();
+    try
+    {
+        std::vector<struct blksnap_uuid> id_array(param.count);
+        param.ids = (__u64)id_array.data();
+
+        Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_COLLECT, &param, ec);
+        if (ec)
+            return;
 
-    if (::ioctl(m_ctl.Get(), IOCTL_BLKSNAP_SNAPSHOT_COLLECT, &param))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to get list of snapshots.");
+        for (size_t inx = 0; inx < param.count; inx++)
+            ids.emplace_back(id_array[inx].b);
+    }
+    catch (std::bad_alloc&)
+    {
+        ec = std::make_error_code(std::errc::not_enough_memory);
+    }
+}
+
+void CService::Collect(std::vector<CSnapshotId>& ids)
+{
+    std::error_code ec;
 
-    for (size_t inx = 0; inx < param.count; inx++)
-        ids.emplace_back(id_array[inx].b);
+    Collect(ids, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to get list of snapshots.");
 }
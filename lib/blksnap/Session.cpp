@@ -16,7 +16,13 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 
 #include <blksnap/Tracker.h>
 #include <blksnap/Snapshot.h>
@@ -28,7 +34,10 @@
 #include <iostream>
 #include <linux/fiemap.h>
 #include <linux/fs.h>
+#include <list>
+#include <map>
 #include <mutex>
+#include <set>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
@@ -48,6 +57,87 @@ struct SState
     std::string diffStorage;
     std::mutex lock;
     std::list<std::string> errorMessage;
+    SDiffStorageExtension extension;
+    size_t nextSpareDevice;
+    SessionEventCallback callback;
+    std::map<unsigned int, SSessionEventCounter> eventCounters;
+};
+
+/*
+ * The pool of threads that is shared by all sessions of the session manager.
+ */
+class CWorkerPool
+{
+public:
+    CWorkerPool(const unsigned int threadsCount);
+    ~CWorkerPool();
+
+    void Run(const std::function<void()>& task);
+    unsigned int Size() const
+    {
+        return m_threads.size();
+    };
+
+private:
+    void Worker();
+
+    bool m_stop;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+};
+
+struct SEventLoopEntry
+{
+    std::shared_ptr<CSnapshot> ptrSnapshot;
+    std::shared_ptr<SState> ptrState;
+    unsigned int devices;
+};
+
+/*
+ * Receives the events of all snapshots of the session manager in one thread.
+ * The events are processed by the pool, so a slow callback of one session
+ * does not delay the events of the others. The events of one session are
+ * processed one by one and in order: its snapshot is not polled while its
+ * event is being processed.
+ */
+class CEventLoop
+{
+public:
+    CEventLoop(CWorkerPool* pool);
+    ~CEventLoop();
+
+    void Register(const std::shared_ptr<SEventLoopEntry>& ptrEntry);
+    void Unregister(const std::shared_ptr<SState>& ptrState);
+    void Stop();
+
+    unsigned int Sessions();
+    unsigned int Devices();
+    unsigned long long Events()
+    {
+        return m_events;
+    };
+
+private:
+    void Worker();
+    void Dispatch(const std::shared_ptr<SEventLoopEntry>& ptrEntry, const SBlksnapEvent& ev);
+    void Remove(const std::shared_ptr<SState>& ptrState);
+    void Processed(SState* state);
+
+    bool m_stop;
+    CWorkerPool* m_pool;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::list<std::shared_ptr<SEventLoopEntry>> m_entries;
+    /*
+     * The states of the sessions whose event is being received or processed,
+     * and the threads that do it. Unregister waits until they leave the state.
+     */
+    std::map<SState*, std::thread::id> m_processing;
+    std::condition_variable m_processedCv;
+    std::atomic<unsigned long long> m_events;
+    std::thread m_thread;
 };
 
 class CSession : public ISession
@@ -55,31 +145,296 @@ class CSession : public ISession
 public:
     CSession(const std::vector<std::string>& devices,
              const std::string& diffStorageFilePath,
-             const unsigned long long limit);
+             const unsigned long long limit,
+             const unsigned int maxThreads,
+             const SDiffStorageExtension& extension,
+             CWorkerPool* pool = nullptr,
+             const std::shared_ptr<CEventLoop>& ptrEventLoop = nullptr);
     ~CSession() override;
 
     bool GetError(std::string& errorMessage) override;
+    SSessionStats GetStats() override
+    {
+        return m_stats;
+    };
+    void OnEvent(const SessionEventCallback& callback) override;
+    SSessionEventCounter GetEventCounter(const unsigned int code) override;
 
 private:
     CSnapshotId m_id;
+    SSessionStats m_stats;
 
     std::shared_ptr<CSnapshot> m_ptrSnapshot;
     std::shared_ptr<SState> m_ptrState;
     std::shared_ptr<std::thread> m_ptrThread;
+    std::shared_ptr<CEventLoop> m_ptrEventLoop;
 };
 
+class CSessionManager : public ISessionManager
+{
+public:
+    CSessionManager(const unsigned int maxThreads);
+    ~CSessionManager() override;
+
+    std::shared_ptr<ISession> CreateSession(const std::vector<std::string>& devices,
+                                            const std::string& diffStorageFilePath,
+                                            const unsigned long long limit,
+                                            const SDiffStorageExtension& extension) override;
+    SSessionManagerStats GetStats() override;
+
+private:
+    CWorkerPool m_pool;
+    std::shared_ptr<CEventLoop> m_ptrEventLoop;
+
+    std::mutex m_lock;
+    SSessionManagerStats m_stats;
+    /*
+     * The devices of the sessions. Their files are released from the handle
+     * cache when the manager is destroyed.
+     */
+    std::set<std::string> m_devices;
+};
+
+std::shared_ptr<ISession> ISession::Create(
+    const std::vector<std::string>& devices,
+    const std::string& diffStorageFilePath,
+    const unsigned long long limit,
+    const unsigned int maxThreads)
+{
+    return std::make_shared<CSession>(devices, diffStorageFilePath, limit, maxThreads, SDiffStorageExtension());
+}
+
 std::shared_ptr<ISession> ISession::Create(
     const std::vector<std::string>& devices,
     const std::string& diffStorageFilePath,
-    const unsigned long long limit)
+    const unsigned long long limit,
+    const SDiffStorageExtension& extension,
+    const unsigned int maxThreads)
+{
+    return std::make_shared<CSession>(devices, diffStorageFilePath, limit, maxThreads, extension);
+}
+
+std::shared_ptr<ISessionManager> ISessionManager::Create(const unsigned int maxThreads)
+{
+    return std::make_shared<CSessionManager>(maxThreads);
+}
+
+/*
+ * For a large number of devices, more threads do not give a gain, since
+ * the module takes the same locks when attaching and adding devices.
+ */
+static const unsigned int maxThreadsDefault = 16;
+
+static inline unsigned int ThreadsCountDefault()
+{
+    return std::min(maxThreadsDefault, std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+CWorkerPool::CWorkerPool(const unsigned int threadsCount)
+    : m_stop(false)
+{
+    for (unsigned int inx = 0; inx < threadsCount; inx++)
+        m_threads.emplace_back(&CWorkerPool::Worker, this);
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void CWorkerPool::Run(const std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_tasks.push_back(task);
+    }
+    m_cv.notify_one();
+}
+
+void CWorkerPool::Worker()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+
+            m_cv.wait(guard, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+/*
+ * Call the function for each index from 0 to count-1 in threadsCount
+ * threads. If the pool is set, its threads are used instead of creating
+ * new ones. The first exception thrown is rethrown after all threads have
+ * completed.
+ */
+static void ParallelFor(const size_t count, const unsigned int threadsCount,
+                        const std::function<void(size_t)>& func,
+                        CWorkerPool* pool = nullptr)
+{
+    std::atomic<size_t> next(0);
+    std::mutex errorLock;
+    std::exception_ptr error;
+    std::vector<std::thread> threads;
+
+    auto worker = [&]() {
+        size_t inx;
+
+        while ((inx = next++) < count)
+        {
+            try
+            {
+                func(inx);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    if (threadsCount <= 1)
+        worker();
+    else if (pool)
+    {
+        /*
+         * The calling thread also processes the indexes, so the progress
+         * does not depend on whether the pool is busy with other sessions.
+         */
+        std::mutex doneLock;
+        std::condition_variable doneCv;
+        unsigned int running = threadsCount - 1;
+
+        for (unsigned int inx = 1; inx < threadsCount; inx++)
+            pool->Run([&]() {
+                worker();
+
+                std::lock_guard<std::mutex> guard(doneLock);
+                if (--running == 0)
+                    doneCv.notify_one();
+            });
+        worker();
+
+        std::unique_lock<std::mutex> guard(doneLock);
+        doneCv.wait(guard, [&] { return running == 0; });
+    }
+    else
+    {
+        for (unsigned int inx = 0; inx < threadsCount; inx++)
+            threads.emplace_back(worker);
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+static inline unsigned long long ElapsedUs(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Append the next spare device to the difference storage, or ask the
+ * callback for the device if there are no more spare devices.
+ */
+static void ExtendDiffStorage(CSnapshot& snapshot, SState& state, const unsigned long long requestedSectors)
 {
-    return std::make_shared<CSession>(devices, diffStorageFilePath, limit);
+    while (state.nextSpareDevice < state.extension.spareDevices.size())
+    {
+        const std::string& devicePath = state.extension.spareDevices[state.nextSpareDevice++];
+
+        try
+        {
+            if (snapshot.AppendStorage(devicePath))
+                return;
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << ex.what() << std::endl;
+            std::lock_guard<std::mutex> guard(state.lock);
+            state.errorMessage.push_back(std::string(ex.what()));
+        }
+    }
+
+    if (state.extension.extend)
+    {
+        const std::string devicePath = state.extension.extend(requestedSectors);
+
+        if (!devicePath.empty() && snapshot.AppendStorage(devicePath))
+            return;
+    }
+
+    throw std::runtime_error("The free space in the difference storage is running out");
+}
+
+static void ProcessEvent(CSnapshot& snapshot, SState& state, const SBlksnapEvent& ev)
+{
+    SessionEventCallback callback;
+
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        SSessionEventCounter& counter = state.eventCounters[ev.code];
+
+        counter.count++;
+        counter.lastTime = ev.time;
+        callback = state.callback;
+    }
+
+    try
+    {
+        if (callback)
+            callback(ev);
+
+        switch (ev.code)
+        {
+        case blksnap_event_code_low_space:
+            ExtendDiffStorage(snapshot, state, ev.lowSpace.requestedSectors);
+            break;
+        case blksnap_event_code_corrupted:
+            throw std::system_error(ev.corrupted.errorCode, std::generic_category(),
+                std::string("Snapshot corrupted for device " + std::to_string(ev.corrupted.origDevIdMj) + ":" + std::to_string(ev.corrupted.origDevIdMn)));
+        case blksnap_event_code_no_space:
+            {
+                const std::string noSpaceMsg = "The limit size of the difference storage has been reached";
+
+                std::cerr << noSpaceMsg << std::endl;
+                std::lock_guard<std::mutex> guard(state.lock);
+                state.errorMessage.push_back(std::string(noSpaceMsg));
+            }
+            break;
+        default:
+            throw std::runtime_error("Invalid blksnap event code received.");
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.errorMessage.push_back(std::string(ex.what()));
+    }
 }
 
 static void BlksnapThread(std::shared_ptr<CSnapshot> ptrCtl, std::shared_ptr<SState> ptrState)
 {
     struct SBlksnapEvent ev;
-    int diffStorageNumber = 1;
     bool is_eventReady;
 
     while (!ptrState->stop)
@@ -99,81 +454,291 @@ static void BlksnapThread(std::shared_ptr<CSnapshot> ptrCtl, std::shared_ptr<SSt
         if (!is_eventReady)
             continue;
 
-        try
+        ProcessEvent(*ptrCtl, *ptrState, ev);
+    }
+}
+
+CEventLoop::CEventLoop(CWorkerPool* pool)
+    : m_stop(false)
+    , m_pool(pool)
+    , m_events(0)
+    , m_thread(&CEventLoop::Worker, this)
+{}
+
+CEventLoop::~CEventLoop()
+{
+    Stop();
+}
+
+void CEventLoop::Register(const std::shared_ptr<SEventLoopEntry>& ptrEntry)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_entries.push_back(ptrEntry);
+    }
+    m_cv.notify_one();
+}
+
+void CEventLoop::Remove(const std::shared_ptr<SState>& ptrState)
+{
+    ptrState->stop = true;
+    m_entries.remove_if([&](const std::shared_ptr<SEventLoopEntry>& ptrEntry) {
+        return ptrEntry->ptrState == ptrState;
+    });
+}
+
+/*
+ * After the return, the worker does not access the snapshot of the session
+ * and does not call its callback. If it is called from the callback itself,
+ * it cannot wait for the worker.
+ */
+void CEventLoop::Unregister(const std::shared_ptr<SState>& ptrState)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    Remove(ptrState);
+    auto it = m_processing.find(ptrState.get());
+    if ((it != m_processing.end()) && (it->second == std::this_thread::get_id()))
+        return;
+    m_processedCv.wait(guard, [&] { return !m_processing.count(ptrState.get()); });
+}
+
+void CEventLoop::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_stop)
+            return;
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+
+    // Wait for the events that are processed by the pool
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_processedCv.wait(guard, [this] { return m_processing.empty(); });
+}
+
+void CEventLoop::Processed(SState* state)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_processing.erase(state);
+    }
+    m_processedCv.notify_all();
+}
+
+void CEventLoop::Dispatch(const std::shared_ptr<SEventLoopEntry>& ptrEntry, const SBlksnapEvent& ev)
+{
+    m_pool->Run([this, ptrEntry, ev]() {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_processing[ptrEntry->ptrState.get()] = std::this_thread::get_id();
+        }
+        ProcessEvent(*ptrEntry->ptrSnapshot, *ptrEntry->ptrState, ev);
+        Processed(ptrEntry->ptrState.get());
+    });
+}
+
+unsigned int CEventLoop::Sessions()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_entries.size();
+}
+
+unsigned int CEventLoop::Devices()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    unsigned int devices = 0;
+
+    for (const auto& ptrEntry : m_entries)
+        devices += ptrEntry->devices;
+    return devices;
+}
+
+/*
+ * Each snapshot has its own event queue, so the queues are checked one by
+ * one without waiting. If there were no events in any of them, the thread
+ * sleeps for the same time that the session thread waits for an event.
+ */
+void CEventLoop::Worker()
+{
+    while (true)
+    {
+        std::vector<std::shared_ptr<SEventLoopEntry>> entries;
+        bool is_eventReady = false;
+
         {
-            switch (ev.code)
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (m_stop)
+                break;
+            entries.assign(m_entries.begin(), m_entries.end());
+        }
+
+        for (const auto& ptrEntry : entries)
+        {
+            struct SBlksnapEvent ev;
+            std::error_code ec;
+            bool is_received;
+
             {
-            case blksnap_event_code_corrupted:
-                throw std::system_error(ev.corrupted.errorCode, std::generic_category(),
-                    std::string("Snapshot corrupted for device " + std::to_string(ev.corrupted.origDevIdMj) + ":" + std::to_string(ev.corrupted.origDevIdMn)));
-            case blksnap_event_code_no_space:
-                {
-                    const std::string noSpaceMsg = "The limit size of the difference storage has been reached";
+                std::lock_guard<std::mutex> guard(m_lock);
+                if (ptrEntry->ptrState->stop || m_processing.count(ptrEntry->ptrState.get()))
+                    continue;
+                m_processing[ptrEntry->ptrState.get()] = std::this_thread::get_id();
+            }
+
+            // Polling many snapshots, so the non-throwing variant is used
+            is_received = ptrEntry->ptrSnapshot->WaitEvent(0, ev, ec);
+            if (is_received)
+            {
+                is_eventReady = true;
+                m_events++;
+                // The state is left by the pool thread when the event is processed
+                Dispatch(ptrEntry, ev);
+                continue;
+            }
+            else if (ec && !ptrEntry->ptrState->stop)
+            {
+                const std::string errorMessage = "Failed to get event from snapshot: " + ec.message();
 
-                    std::cerr << noSpaceMsg << std::endl;
-                    std::lock_guard<std::mutex> guard(ptrState->lock);
-                    ptrState->errorMessage.push_back(std::string(noSpaceMsg));
+                std::cerr << errorMessage << std::endl;
+                {
+                    std::lock_guard<std::mutex> guard(ptrEntry->ptrState->lock);
+                    ptrEntry->ptrState->errorMessage.push_back(errorMessage);
                 }
-            default:
-                throw std::runtime_error("Invalid blksnap event code received.");
             }
+
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                if (ec)
+                    Remove(ptrEntry->ptrState);
+                m_processing.erase(ptrEntry->ptrState.get());
+            }
+            m_processedCv.notify_all();
         }
-        catch (std::exception& ex)
+
+        if (!is_eventReady)
         {
-            std::cerr << ex.what() << std::endl;
-            std::lock_guard<std::mutex> guard(ptrState->lock);
-            ptrState->errorMessage.push_back(std::string(ex.what()));
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_cv.wait_for(guard, std::chrono::milliseconds(100), [this] { return m_stop; });
         }
     }
 }
 
-CSession::CSession(const std::vector<std::string>& devices, const std::string& diffStorageFilePath, const unsigned long long limit)
+CSession::CSession(const std::vector<std::string>& devices, const std::string& diffStorageFilePath,
+                   const unsigned long long limit, const unsigned int maxThreads,
+                   const SDiffStorageExtension& extension,
+                   CWorkerPool* pool, const std::shared_ptr<CEventLoop>& ptrEventLoop)
+    : m_ptrEventLoop(ptrEventLoop)
 {
-    for (const auto& name : devices)
-        CTracker(name).Attach();
+    std::vector<std::shared_ptr<CTracker>> trackers(devices.size());
+    unsigned int threadsCount = maxThreads ? maxThreads : ThreadsCountDefault();
+    auto start = std::chrono::steady_clock::now();
+
+    threadsCount = std::max(std::min(threadsCount, static_cast<unsigned int>(devices.size())), 1u);
+    m_stats.devices = devices.size();
+    m_stats.threads = threadsCount;
+
+    // Open each device once and attach the filter
+    ParallelFor(devices.size(), threadsCount, [&](size_t inx) {
+        trackers[inx] = std::make_shared<CTracker>(devices[inx]);
+        trackers[inx]->Attach();
+    }, pool);
+    m_stats.attachUs = ElapsedUs(start);
 
     // Create snapshot
+    start = std::chrono::steady_clock::now();
     m_ptrSnapshot = CSnapshot::Create(diffStorageFilePath, limit);
+    m_stats.createUs = ElapsedUs(start);
 
     // Add devices to snapshot
-    for (const auto& name : devices)
-        CTracker(name).SnapshotAdd(m_ptrSnapshot->Id().Get());
+    start = std::chrono::steady_clock::now();
+    try
+    {
+        ParallelFor(devices.size(), threadsCount, [&](size_t inx) {
+            trackers[inx]->SnapshotAdd(m_ptrSnapshot->Id().Get());
+        }, pool);
+    }
+    catch (std::exception&)
+    {
+        // Do not leave a snapshot that contains only a part of the devices
+        try
+        {
+            m_ptrSnapshot->Destroy();
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << ex.what() << std::endl;
+        }
+        throw;
+    }
+    trackers.clear();
+    m_stats.addUs = ElapsedUs(start);
 
     // Prepare state structure for thread
     m_ptrState = std::make_shared<SState>();
     m_ptrState->stop = false;
+    m_ptrState->extension = extension;
+    m_ptrState->nextSpareDevice = 0;
 
     // Append first portion for diff storage
     struct SBlksnapEvent ev;
     if (m_ptrSnapshot->WaitEvent(100, ev))
     {
-        switch (ev.code)
-        {
-        case blksnap_event_code_corrupted:
+        if (ev.code == blksnap_event_code_corrupted)
             throw std::system_error(ev.corrupted.errorCode, std::generic_category(),
                                     std::string("Failed to create snapshot for device "
                                                 + std::to_string(ev.corrupted.origDevIdMj) + ":"
                                                 + std::to_string(ev.corrupted.origDevIdMn)));
-        case blksnap_event_code_no_space:
-            {
-                const std::string noSpaceMsg = "The limit size of the difference storage has been reached";
 
-                std::cerr << noSpaceMsg << std::endl;
-                std::lock_guard<std::mutex> guard(m_ptrState->lock);
-                m_ptrState->errorMessage.push_back(std::string(noSpaceMsg));
-            }
-        default:
-            throw std::runtime_error("Invalid blksnap event code received.");
-        }
+        ProcessEvent(*m_ptrSnapshot, *m_ptrState, ev);
     }
 
-    // Start stretch snapshot thread
-    m_ptrThread = std::make_shared<std::thread>(BlksnapThread, m_ptrSnapshot, m_ptrState);
+    // Start stretch snapshot thread or pass the snapshot to the session manager
+    if (m_ptrEventLoop)
+    {
+        auto ptrEntry = std::make_shared<SEventLoopEntry>();
+
+        ptrEntry->ptrSnapshot = m_ptrSnapshot;
+        ptrEntry->ptrState = m_ptrState;
+        ptrEntry->devices = devices.size();
+        m_ptrEventLoop->Register(ptrEntry);
+    }
+    else
+        m_ptrThread = std::make_shared<std::thread>(BlksnapThread, m_ptrSnapshot, m_ptrState);
     ::usleep(0);
 
 
     // Take snapshot
-    m_ptrSnapshot->Take();
+    start = std::chrono::steady_clock::now();
+    STakeTiming timing;
+    try
+    {
+        timing = m_ptrSnapshot->Take();
+    }
+    catch (std::exception&)
+    {
+        // The destructor is not called, so stop receiving events here
+        if (m_ptrEventLoop)
+            m_ptrEventLoop->Unregister(m_ptrState);
+        else
+        {
+            m_ptrState->stop = true;
+            m_ptrThread->join();
+        }
+        try
+        {
+            m_ptrSnapshot->Destroy();
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << ex.what() << std::endl;
+        }
+        throw;
+    }
+    m_stats.takeUs = ElapsedUs(start);
+    m_stats.frozenUs = timing.frozenNs / 1000;
 }
 
 CSession::~CSession()
@@ -181,8 +746,13 @@ CSession::~CSession()
     // std::cout << "Destroy blksnap session" << std::endl;
 
     // Stop thread
-    m_ptrState->stop = true;
-    m_ptrThread->join();
+    if (m_ptrEventLoop)
+        m_ptrEventLoop->Unregister(m_ptrState);
+    else
+    {
+        m_ptrState->stop = true;
+        m_ptrThread->join();
+    }
 
     // Destroy snapshot
     try
@@ -196,6 +766,22 @@ CSession::~CSession()
     }
 }
 
+void CSession::OnEvent(const SessionEventCallback& callback)
+{
+    std::lock_guard<std::mutex> guard(m_ptrState->lock);
+    m_ptrState->callback = callback;
+}
+
+SSessionEventCounter CSession::GetEventCounter(const unsigned int code)
+{
+    std::lock_guard<std::mutex> guard(m_ptrState->lock);
+    auto it = m_ptrState->eventCounters.find(code);
+
+    if (it == m_ptrState->eventCounters.end())
+        return SSessionEventCounter();
+    return it->second;
+}
+
 bool CSession::GetError(std::string& errorMessage)
 {
     std::lock_guard<std::mutex> guard(m_ptrState->lock);
@@ -206,3 +792,53 @@ bool CSession::GetError(std::string& errorMessage)
     m_ptrState->errorMessage.pop_front();
     return true;
 }
+
+CSessionManager::CSessionManager(const unsigned int maxThreads)
+    : m_pool(maxThreads ? maxThreads : ThreadsCountDefault())
+    , m_ptrEventLoop(std::make_shared<CEventLoop>(&m_pool))
+{
+    m_stats.threads = m_pool.Size();
+}
+
+CSessionManager::~CSessionManager()
+{
+    m_ptrEventLoop->Stop();
+    // Allow the module to be unloaded after the sessions are released
+    for (const std::string& device : m_devices)
+        CHandleCache::Instance().Release(device);
+    CHandleCache::Instance().ReleaseControl();
+}
+
+std::shared_ptr<ISession> CSessionManager::CreateSession(const std::vector<std::string>& devices,
+                                                         const std::string& diffStorageFilePath,
+                                                         const unsigned long long limit,
+                                                         const SDiffStorageExtension& extension)
+{
+    auto ptrSession = std::make_shared<CSession>(devices, diffStorageFilePath, limit,
+                                                 m_pool.Size(), extension, &m_pool, m_ptrEventLoop);
+    SSessionStats stats = ptrSession->GetStats();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stats.sessionsCreated++;
+    m_stats.attachUs += stats.attachUs;
+    m_stats.createUs += stats.createUs;
+    m_stats.addUs += stats.addUs;
+    m_stats.takeUs += stats.takeUs;
+    m_stats.frozenUs += stats.frozenUs;
+    m_devices.insert(devices.begin(), devices.end());
+    return ptrSession;
+}
+
+SSessionManagerStats CSessionManager::GetStats()
+{
+    SSessionManagerStats stats;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        stats = m_stats;
+    }
+    stats.sessions = m_ptrEventLoop->Sessions();
+    stats.devices = m_ptrEventLoop->Devices();
+    stats.events = m_ptrEventLoop->Events();
+    return stats;
+}
@@ -27,8 +27,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <system_error>
-
-static const char* blksnap_filename = "/dev/" BLKSNAP_CTL;
+#include <vector>
 
 using namespace blksnap;
 
@@ -37,65 +36,188 @@ CSnapshot::CSnapshot(const CSnapshotId& id, const std::shared_ptr<COpenFileHolde
     , m_ctl(ctl)
 { }
 
-std::shared_ptr<CSnapshot> CSnapshot::Create(const std::string& filePath, const unsigned long long limit)
+static inline void Ioctl(int fd, unsigned long request, void* arg, std::error_code& ec) noexcept
 {
-    if (filePath.empty())
-        throw std::runtime_error("The parameter 'filePath' cannot be empty");
+    if (::ioctl(fd, request, arg))
+        ec.assign(errno, std::generic_category());
+    else
+        ec.clear();
+}
 
+std::shared_ptr<CSnapshot> CSnapshot::Create(const std::string& filePath, const unsigned long long limit,
+                                             std::error_code& ec) noexcept
+{
     struct blksnap_snapshot_create param = {0};
+    std::shared_ptr<COpenFileHolder> ctl;
+
+    if (filePath.empty())
+    {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return nullptr;
+    }
+
     param.diff_storage_limit_sect = limit / 512;
     param.diff_storage_filename = (__u64)filePath.c_str();
+    try
+    {
+        ctl = CHandleCache::Instance().Control();
+    }
+    catch (std::system_error& ex)
+    {
+        ec = ex.code();
+        return nullptr;
+    }
+    catch (std::bad_alloc&)
+    {
+        ec = std::make_error_code(std::errc::not_enough_memory);
+        return nullptr;
+    }
 
-    auto ctl = std::make_shared<COpenFileHolder>(blksnap_filename, O_RDWR);
-    if (::ioctl(ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_CREATE, &param))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to create snapshot object.");
+    Ioctl(ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_CREATE, &param, ec);
+    if (ec)
+        return nullptr;
 
-    return std::shared_ptr<CSnapshot>(new
-        CSnapshot(CSnapshotId(param.id.b), ctl));
+    try
+    {
+        return std::shared_ptr<CSnapshot>(new CSnapshot(CSnapshotId(param.id.b), ctl));
+    }
+    catch (std::bad_alloc&)
+    {
+        // Do not leave the snapshot that cannot be held by anyone
+        std::error_code destroyEc;
+
+        Ioctl(ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_DESTROY, &param.id, destroyEc);
+        ec = std::make_error_code(std::errc::not_enough_memory);
+        return nullptr;
+    }
+}
+
+std::shared_ptr<CSnapshot> CSnapshot::Create(const std::string& filePath, const unsigned long long limit)
+{
+    std::error_code ec;
+
+    if (filePath.empty())
+        throw std::runtime_error("The parameter 'filePath' cannot be empty");
+
+    auto ptrSnapshot = Create(filePath, limit, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to create snapshot object.");
+    return ptrSnapshot;
 }
 
 std::shared_ptr<CSnapshot> CSnapshot::Open(const CSnapshotId& id)
 {
     return std::shared_ptr<CSnapshot>(new
-        CSnapshot(id, std::make_shared<COpenFileHolder>(blksnap_filename, O_RDWR)));
+        CSnapshot(id, CHandleCache::Instance().Control()));
 }
 
-void CSnapshot::Take()
+void CSnapshot::Take(std::error_code& ec) noexcept
 {
     struct blksnap_uuid param;
 
     uuid_copy(param.b, m_id.Get());
-    if (::ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_TAKE, &param))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to take snapshot.");
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_TAKE, &param, ec);
 }
 
-void CSnapshot::Destroy()
+STakeTiming CSnapshot::Take()
+{
+    std::error_code ec;
+
+    Take(ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to take snapshot.");
+
+    /*
+     * The snapshot has already been taken, so the failure to get the timing
+     * should not be reported as a failure to take it.
+     */
+    STakeTiming timing = Timing(ec);
+    if (ec)
+        return STakeTiming();
+    return timing;
+}
+
+STakeTiming CSnapshot::Timing(std::error_code& ec) noexcept
+{
+    STakeTiming timing;
+    struct blksnap_snapshot_timing param = {0};
+
+    uuid_copy(param.id.b, m_id.Get());
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_TIMING, &param, ec);
+    if (ec)
+    {
+        // The module does not support the timing
+        if (ec.value() == ENOTTY)
+            ec.clear();
+        return timing;
+    }
+
+    try
+    {
+        std::vector<struct blksnap_device_timing> devices;
+
+        if (param.count)
+        {
+            devices.resize(param.count);
+            param.devices = (__u64)devices.data();
+            Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_TIMING, &param, ec);
+            if (ec)
+                return timing;
+        }
+
+        timing.takeNs = param.take_ns;
+        timing.frozenNs = param.frozen_ns;
+        for (unsigned int inx = 0; inx < param.count; inx++)
+            timing.devices.push_back({devices[inx].dev_id_mj, devices[inx].dev_id_mn,
+                                      devices[inx].freeze_ns, devices[inx].switch_ns, devices[inx].thaw_ns});
+    }
+    catch (std::bad_alloc&)
+    {
+        ec = std::make_error_code(std::errc::not_enough_memory);
+    }
+    return timing;
+}
+
+STakeTiming CSnapshot::Timing()
+{
+    std::error_code ec;
+    STakeTiming timing = Timing(ec);
+
+    if (ec)
+        throw std::system_error(ec, "Failed to get snapshot timing.");
+    return timing;
+}
+
+void CSnapshot::Destroy(std::error_code& ec) noexcept
 {
     struct blksnap_uuid param;
 
     uuid_copy(param.b, m_id.Get());
-    if (::ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_DESTROY, &param))
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to destroy snapshot.");
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_DESTROY, &param, ec);
 }
 
-bool CSnapshot::WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev)
+void CSnapshot::Destroy()
+{
+    std::error_code ec;
+
+    Destroy(ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to destroy snapshot.");
+}
+
+bool CSnapshot::WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev, std::error_code& ec) noexcept
 {
     struct blksnap_snapshot_event param = {0};
 
     uuid_copy(param.id.b, m_id.Get());
     param.timeout_ms = timeoutMs;
 
-    if (::ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_WAIT_EVENT, &param))
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_WAIT_EVENT, &param, ec);
+    if (ec)
     {
-        if ((errno == ENOENT) || (errno == EINTR))
-            return false;
-        if (errno == ESRCH)
-            throw std::system_error(errno, std::generic_category(), "Snapshot not found");
-
-        throw std::system_error(errno, std::generic_category(), "Failed to get event from snapshot.");
+        if ((ec.value() == ENOENT) || (ec.value() == EINTR))
+            ec.clear();
+        return false;
     }
     ev.code = param.code;
     ev.time = param.time_label;
@@ -118,8 +240,112 @@ bool CSnapshot::WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev)
         ev.noSpace.requestedSectors = data->requested_nr_sect;
         break;
     }
+    case blksnap_event_code_low_space:
+    {
+        struct blksnap_event_low_space* data = (struct blksnap_event_low_space*)(param.data);
+
+        ev.lowSpace.freeSectors = data->free_nr_sect;
+        ev.lowSpace.requestedSectors = data->requested_nr_sect;
+        break;
+    }
     default:
-        throw std::runtime_error("An unsupported event ["+std::to_string(param.code)+"] was received.");
+        // Not EOPNOTSUPP, which the module may return itself
+        ec = std::make_error_code(std::errc::bad_message);
+        return false;
     }
     return true;
 }
+
+bool CSnapshot::WaitEvent(unsigned int timeoutMs, SBlksnapEvent& ev)
+{
+    std::error_code ec;
+    bool ret = WaitEvent(timeoutMs, ev, ec);
+
+    if (!ec)
+        return ret;
+    if (ec.value() == ESRCH)
+        throw std::system_error(ec, "Snapshot not found");
+    if (ec == std::errc::bad_message)
+        throw std::runtime_error("An unsupported event ["+std::to_string(ev.code)+"] was received.");
+
+    throw std::system_error(ec, "Failed to get event from snapshot.");
+}
+
+bool CSnapshot::AppendStorage(const std::string& devicePath, std::error_code& ec) noexcept
+{
+    struct blksnap_snapshot_append_storage param = {0};
+
+    uuid_copy(param.id.b, m_id.Get());
+    param.devpath = (__u64)devicePath.c_str();
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE, &param, ec);
+    if (ec.value() == EALREADY)
+    {
+        ec.clear();
+        return false;
+    }
+    return !ec;
+}
+
+bool CSnapshot::AppendStorage(const std::string& devicePath)
+{
+    std::error_code ec;
+    bool ret = AppendStorage(devicePath, ec);
+
+    if (ec)
+        throw std::system_error(ec, "Failed to append device [" + devicePath + "] to the difference storage.");
+    return ret;
+}
+
+SSnapshotStats CSnapshot::Stats(std::error_code& ec) noexcept
+{
+    SSnapshotStats stats;
+    struct blksnap_snapshot_stats param = {0};
+
+    uuid_copy(param.id.b, m_id.Get());
+    Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_STATS, &param, ec);
+    if (ec)
+        return stats;
+
+    try
+    {
+        std::vector<struct blksnap_device_stats> devices;
+
+        if (param.count)
+        {
+            devices.resize(param.count);
+            param.devices = (__u64)devices.data();
+            Ioctl(m_ctl->Get(), IOCTL_BLKSNAP_SNAPSHOT_STATS, &param, ec);
+            if (ec)
+                return stats;
+        }
+
+        stats.capacitySectors = param.capacity_sect;
+        stats.limitSectors = param.limit_sect;
+        stats.filledSectors = param.filled_sect;
+        stats.requestedSectors = param.requested_sect;
+        stats.reallocateCount = param.reallocate_count;
+        stats.reallocateNs = param.reallocate_ns;
+        for (unsigned int inx = 0; inx < param.count; inx++)
+            stats.devices.push_back({devices[inx].dev_id_mj, devices[inx].dev_id_mn,
+                                     devices[inx].chunk_size, devices[inx].chunk_count,
+                                     devices[inx].chunk_new, devices[inx].chunk_in_memory,
+                                     devices[inx].chunk_stored, devices[inx].chunk_failed,
+                                     devices[inx].copied_sect, devices[inx].image_redirected_sect,
+                                     devices[inx].image_memory_sect, devices[inx].image_stored_sect});
+    }
+    catch (std::bad_alloc&)
+    {
+        ec = std::make_error_code(std::errc::not_enough_memory);
+    }
+    return stats;
+}
+
+SSnapshotStats CSnapshot::Stats()
+{
+    std::error_code ec;
+    SSnapshotStats stats = Stats(ec);
+
+    if (ec)
+        throw std::system_error(ec, "Failed to get snapshot statistics.");
+    return stats;
+}
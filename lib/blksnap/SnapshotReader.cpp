@@ -0,0 +1,813 @@
+/*
+ * Copyright (C) 2022 Veeam Software Group GmbH <https://www.veeam.com/contacts.html>
+ *
+ * This file is part of libblksnap
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Lesser Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <blksnap/OpenFileHolder.h>
+#include <blksnap/SnapshotReader.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <exception>
+#include <fcntl.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+using namespace blksnap;
+
+struct SIoRequest
+{
+    size_t index;
+    SRange range;
+    void* buffer;
+    struct iovec iov;
+    long result;
+};
+
+/*
+ * The interface of the asynchronous I/O mechanism.
+ * Each worker has its own instance, so the implementations are not
+ * thread-safe.
+ */
+class IIoEngine
+{
+public:
+    virtual ~IIoEngine() = default;
+
+    /*
+     * Queue the request. The request is sent to the kernel by Reap().
+     */
+    virtual void Submit(SIoRequest* req) = 0;
+    /*
+     * Send the queued requests and wait for at least one of them.
+     */
+    virtual void Reap(std::vector<SIoRequest*>& completed) = 0;
+};
+
+class CUringEngine : public IIoEngine
+{
+public:
+    CUringEngine(int fd, unsigned int depth)
+        : m_fd(fd)
+        , m_ring(-1)
+        , m_sqPtr(MAP_FAILED)
+        , m_cqPtr(MAP_FAILED)
+        , m_sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED))
+        , m_toSubmit(0)
+    {
+        struct io_uring_params params;
+
+        memset(&params, 0, sizeof(params));
+        m_ring = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+        if (m_ring < 0)
+            throw std::system_error(errno, std::generic_category(), "Failed to setup io_uring.");
+
+        m_sqSize = params.sq_off.array + params.sq_entries * sizeof(__u32);
+        m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+        m_sqPtr = ::mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ring, IORING_OFF_SQ_RING);
+        if (m_sqPtr == MAP_FAILED)
+            Fail("Failed to map io_uring submission queue.");
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            m_cqPtr = m_sqPtr;
+        else
+        {
+            m_cqPtr = ::mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             m_ring, IORING_OFF_CQ_RING);
+            if (m_cqPtr == MAP_FAILED)
+                Fail("Failed to map io_uring completion queue.");
+        }
+
+        m_sqes = static_cast<struct io_uring_sqe*>(::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                                                          MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES));
+        if (m_sqes == MAP_FAILED)
+            Fail("Failed to map io_uring submission queue entries.");
+
+        char* sq = static_cast<char*>(m_sqPtr);
+        m_sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(m_cqPtr);
+        m_cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    };
+    ~CUringEngine() override
+    {
+        Release();
+    };
+
+    void Submit(SIoRequest* req) override
+    {
+        unsigned int tail = *m_sqTail;
+        unsigned int index = tail & m_sqMask;
+        struct io_uring_sqe* sqe = &m_sqes[index];
+
+        req->iov.iov_base = req->buffer;
+        req->iov.iov_len = req->range.count << SECTOR_SHIFT;
+
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = m_fd;
+        sqe->addr = reinterpret_cast<__u64>(&req->iov);
+        sqe->len = 1;
+        sqe->off = req->range.sector << SECTOR_SHIFT;
+        sqe->user_data = reinterpret_cast<__u64>(req);
+
+        m_sqArray[index] = index;
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        m_toSubmit++;
+    };
+
+    void Reap(std::vector<SIoRequest*>& completed) override
+    {
+        while (completed.empty())
+        {
+            int ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ring, m_toSubmit, 1,
+                                                 IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Failed to enter io_uring.");
+            }
+            m_toSubmit -= static_cast<unsigned int>(ret);
+
+            unsigned int head = *m_cqHead;
+            unsigned int tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++)
+            {
+                struct io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+                SIoRequest* req = reinterpret_cast<SIoRequest*>(cqe->user_data);
+
+                req->result = cqe->res;
+                completed.push_back(req);
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        }
+    };
+
+private:
+    void Release()
+    {
+        if (m_sqes != MAP_FAILED)
+            ::munmap(m_sqes, m_sqesSize);
+        if ((m_cqPtr != MAP_FAILED) && (m_cqPtr != m_sqPtr))
+            ::munmap(m_cqPtr, m_cqSize);
+        if (m_sqPtr != MAP_FAILED)
+            ::munmap(m_sqPtr, m_sqSize);
+        if (m_ring >= 0)
+            ::close(m_ring);
+    };
+
+    void Fail(const char* message)
+    {
+        int err = errno;
+
+        Release();
+        throw std::system_error(err, std::generic_category(), message);
+    };
+
+    int m_fd;
+    int m_ring;
+    void* m_sqPtr;
+    void* m_cqPtr;
+    size_t m_sqSize;
+    size_t m_cqSize;
+    size_t m_sqesSize;
+    struct io_uring_sqe* m_sqes;
+    unsigned int* m_sqTail;
+    unsigned int m_sqMask;
+    unsigned int* m_sqArray;
+    unsigned int* m_cqHead;
+    unsigned int* m_cqTail;
+    unsigned int m_cqMask;
+    struct io_uring_cqe* m_cqes;
+    unsigned int m_toSubmit;
+};
+
+class CAioEngine : public IIoEngine
+{
+public:
+    CAioEngine(int fd, unsigned int depth)
+        : m_fd(fd)
+        , m_ctx(0)
+        , m_events(depth)
+    {
+        if (::syscall(__NR_io_setup, depth, &m_ctx) < 0)
+            throw std::system_error(errno, std::generic_category(), "Failed to setup AIO context.");
+    };
+    ~CAioEngine() override
+    {
+        ::syscall(__NR_io_destroy, m_ctx);
+    };
+
+    void Submit(SIoRequest* req) override
+    {
+        struct iocb cb;
+
+        memset(&cb, 0, sizeof(cb));
+        cb.aio_fildes = m_fd;
+        cb.aio_lio_opcode = IOCB_CMD_PREAD;
+        cb.aio_buf = reinterpret_cast<__u64>(req->buffer);
+        cb.aio_nbytes = req->range.count << SECTOR_SHIFT;
+        cb.aio_offset = req->range.sector << SECTOR_SHIFT;
+        cb.aio_data = reinterpret_cast<__u64>(req);
+        m_pending.push_back(cb);
+    };
+
+    void Reap(std::vector<SIoRequest*>& completed) override
+    {
+        if (!m_pending.empty())
+        {
+            std::vector<struct iocb*> cbs;
+            size_t offset = 0;
+
+            for (auto& cb : m_pending)
+                cbs.push_back(&cb);
+            while (offset < cbs.size())
+            {
+                long ret = ::syscall(__NR_io_submit, m_ctx, cbs.size() - offset, cbs.data() + offset);
+                if (ret < 0)
+                {
+                    if (errno == EINTR || errno == EAGAIN)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "Failed to submit AIO request.");
+                }
+                offset += static_cast<size_t>(ret);
+            }
+            m_pending.clear();
+        }
+
+        while (completed.empty())
+        {
+            long ret = ::syscall(__NR_io_getevents, m_ctx, 1, m_events.size(), m_events.data(), nullptr);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Failed to get AIO events.");
+            }
+            for (long inx = 0; inx < ret; inx++)
+            {
+                SIoRequest* req = reinterpret_cast<SIoRequest*>(m_events[inx].data);
+
+                req->result = static_cast<long>(m_events[inx].res);
+                completed.push_back(req);
+            }
+        }
+    };
+
+private:
+    int m_fd;
+    aio_context_t m_ctx;
+    std::vector<struct iocb> m_pending;
+    std::vector<struct io_event> m_events;
+};
+
+class CSyncEngine : public IIoEngine
+{
+public:
+    CSyncEngine(int fd)
+        : m_fd(fd)
+    {};
+    ~CSyncEngine() override
+    {};
+
+    void Submit(SIoRequest* req) override
+    {
+        m_pending.push_back(req);
+    };
+
+    void Reap(std::vector<SIoRequest*>& completed) override
+    {
+        for (SIoRequest* req : m_pending)
+        {
+            ssize_t ret;
+
+            do
+                ret = ::pread(m_fd, req->buffer, req->range.count << SECTOR_SHIFT, req->range.sector << SECTOR_SHIFT);
+            while ((ret < 0) && (errno == EINTR));
+
+            req->result = (ret < 0) ? -errno : ret;
+            completed.push_back(req);
+        }
+        m_pending.clear();
+    };
+
+private:
+    int m_fd;
+    std::vector<SIoRequest*> m_pending;
+};
+
+static std::shared_ptr<IIoEngine> CreateEngine(EIoEngine engine, int fd, unsigned int depth)
+{
+    switch (engine)
+    {
+    case eIoEngineUring:
+        return std::make_shared<CUringEngine>(fd, depth);
+    case eIoEngineAio:
+        return std::make_shared<CAioEngine>(fd, depth);
+    case eIoEngineSync:
+        return std::make_shared<CSyncEngine>(fd);
+    default:
+        throw std::runtime_error("Invalid I/O engine.");
+    }
+}
+
+/*
+ * The pool of buffers aligned for O_DIRECT.
+ */
+class CBufferPool
+{
+public:
+    CBufferPool(size_t size, size_t alignment, unsigned int count)
+        : m_stop(false)
+    {
+        for (unsigned int inx = 0; inx < count; inx++)
+        {
+            void* buffer = nullptr;
+            int ret = ::posix_memalign(&buffer, alignment, size);
+
+            if (ret)
+            {
+                Free();
+                throw std::system_error(ret, std::generic_category(), "Failed to allocate aligned buffer.");
+            }
+            m_all.push_back(buffer);
+            m_free.push_back(buffer);
+        }
+    };
+    ~CBufferPool()
+    {
+        Free();
+    };
+
+    /*
+     * Get a buffer from the pool. If the pool is empty, then wait for the
+     * buffer to be returned, or return nullptr when the wait is not allowed
+     * or the pool is stopped.
+     */
+    void* Get(bool wait)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+
+        if (wait)
+            m_cv.wait(guard, [this] { return m_stop || !m_free.empty(); });
+        if (m_stop || m_free.empty())
+            return nullptr;
+
+        void* buffer = m_free.back();
+        m_free.pop_back();
+        return buffer;
+    };
+
+    void Put(void* buffer)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_free.push_back(buffer);
+        }
+        m_cv.notify_one();
+    };
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+    };
+
+private:
+    void Free()
+    {
+        for (void* buffer : m_all)
+            ::free(buffer);
+        m_all.clear();
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    bool m_stop;
+    std::vector<void*> m_all;
+    std::vector<void*> m_free;
+};
+
+/*
+ * Allows to call the callback in the order of the offset. The data that
+ * has been read ahead of the order is held until its turn comes.
+ */
+class CReorder
+{
+public:
+    CReorder(const ReaderCallback& callback)
+        : m_callback(callback)
+        , m_next(0)
+    {};
+
+    void Complete(size_t index, const SRange& range, void* buffer, CBufferPool* pool)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        if (index != m_next)
+        {
+            m_held.emplace(index, SHeld{range, buffer, pool});
+            return;
+        }
+
+        Deliver(range, buffer, pool);
+        for (auto it = m_held.find(m_next); it != m_held.end(); it = m_held.find(m_next))
+        {
+            Deliver(it->second.range, it->second.buffer, it->second.pool);
+            m_held.erase(it);
+        }
+    };
+
+private:
+    struct SHeld
+    {
+        SRange range;
+        void* buffer;
+        CBufferPool* pool;
+    };
+
+    void Deliver(const SRange& range, void* buffer, CBufferPool* pool)
+    {
+        m_callback(range, buffer);
+        pool->Put(buffer);
+        m_next++;
+    };
+
+    const ReaderCallback& m_callback;
+    std::mutex m_lock;
+    size_t m_next;
+    std::map<size_t, SHeld> m_held;
+};
+
+class CSnapshotReader : public ISnapshotReader
+{
+public:
+    CSnapshotReader(const std::string& imagePath, const SReaderConfig& config);
+    ~CSnapshotReader() override
+    {};
+
+    void SetRanges(const std::vector<SRange>& ranges) override;
+    void SetCbtFilter(const SCbtInfo& cbtInfo, const SCbtData& cbtData, const uint8_t snapNumber) override;
+    void Read(const ReaderCallback& callback) override;
+
+    EIoEngine GetEngine() override
+    {
+        return m_engine;
+    };
+    unsigned long long GetCapacity() override
+    {
+        return m_capacity;
+    };
+
+private:
+    void Worker(CBufferPool& pool, CReorder* reorder, const ReaderCallback& callback);
+    void SetError(std::exception_ptr error);
+
+    std::string m_imagePath;
+    SReaderConfig m_config;
+    COpenFileHolder m_image;
+    EIoEngine m_engine;
+    unsigned long long m_capacity;
+    unsigned int m_logicalBlockSize;
+    sector_t m_blockSectors;
+    std::vector<SRange> m_ranges;
+
+    std::vector<SRange> m_portions;
+    std::atomic<size_t> m_nextPortion;
+    std::atomic<bool> m_stop;
+    std::mutex m_errorLock;
+    std::exception_ptr m_error;
+    std::vector<std::shared_ptr<CBufferPool>> m_pools;
+};
+
+std::shared_ptr<ISnapshotReader> ISnapshotReader::Create(const std::string& imagePath, const SReaderConfig& config)
+{
+    return std::make_shared<CSnapshotReader>(imagePath, config);
+}
+
+CSnapshotReader::CSnapshotReader(const std::string& imagePath, const SReaderConfig& config)
+    : m_imagePath(imagePath)
+    , m_config(config)
+    , m_image(imagePath, O_RDONLY | O_DIRECT)
+    , m_engine(config.engine)
+    , m_nextPortion(0)
+    , m_stop(false)
+{
+    int logicalBlockSize = SECTOR_SIZE;
+    struct stat st;
+
+    if (::fstat(m_image.Get(), &st) < 0)
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to get status of the image [" + m_imagePath + "].");
+    if (S_ISBLK(st.st_mode))
+    {
+        if (::ioctl(m_image.Get(), BLKGETSIZE64, &m_capacity) < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to get size of the image [" + m_imagePath + "].");
+        if (::ioctl(m_image.Get(), BLKSSZGET, &logicalBlockSize) < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to get logical block size of the image [" + m_imagePath + "].");
+    }
+    else
+    {
+        /*
+         * A copy of the image in a regular file can also be read.
+         */
+        m_capacity = static_cast<unsigned long long>(st.st_size) & ~static_cast<unsigned long long>(SECTOR_SIZE - 1);
+    }
+    m_logicalBlockSize = static_cast<unsigned int>(logicalBlockSize);
+
+    if (!m_config.queueDepth)
+        m_config.queueDepth = 1;
+    if (!m_config.workers)
+        m_config.workers = 1;
+    m_config.blockSize = std::max(m_config.blockSize, static_cast<size_t>(m_logicalBlockSize));
+    m_config.blockSize = (m_config.blockSize + m_logicalBlockSize - 1) / m_logicalBlockSize * m_logicalBlockSize;
+    m_blockSectors = m_config.blockSize >> SECTOR_SHIFT;
+
+    /*
+     * Check that the I/O mechanism is supported by the kernel. If the
+     * mechanism is not specified, then the best of the available ones is
+     * selected.
+     */
+    if (m_engine == eIoEngineAuto)
+    {
+        for (EIoEngine engine : {eIoEngineUring, eIoEngineAio})
+        {
+            try
+            {
+                CreateEngine(engine, m_image.Get(), m_config.queueDepth);
+                m_engine = engine;
+                break;
+            }
+            catch (std::system_error&)
+            {
+            }
+        }
+        if (m_engine == eIoEngineAuto)
+            m_engine = eIoEngineSync;
+    }
+    else
+        CreateEngine(m_engine, m_image.Get(), m_config.queueDepth);
+
+    m_ranges.emplace_back(0, m_capacity >> SECTOR_SHIFT);
+}
+
+void CSnapshotReader::SetRanges(const std::vector<SRange>& ranges)
+{
+    const sector_t alignment = m_logicalBlockSize >> SECTOR_SHIFT;
+    const sector_t capacity = m_capacity >> SECTOR_SHIFT;
+
+    m_ranges.clear();
+    for (const SRange& range : ranges)
+    {
+        if ((range.sector % alignment) || (range.count % alignment))
+            throw std::system_error(EINVAL, std::generic_category(),
+                                    "The range is not aligned to the logical block size of the image.");
+        if (range.sector >= capacity)
+            continue;
+
+        m_ranges.emplace_back(range.sector, std::min(range.count, capacity - range.sector));
+    }
+}
+
+void CSnapshotReader::SetCbtFilter(const SCbtInfo& cbtInfo, const SCbtData& cbtData, const uint8_t snapNumber)
+{
+    const sector_t blockSectors = cbtInfo.blockSize >> SECTOR_SHIFT;
+    const sector_t capacity = std::min(static_cast<unsigned long long>(cbtInfo.deviceCapacity), m_capacity)
+                              >> SECTOR_SHIFT;
+    const size_t blockCount = std::min(static_cast<size_t>(cbtInfo.blockCount), cbtData.vec.size());
+    std::vector<SRange> ranges;
+
+    for (size_t inx = 0; inx < blockCount; inx++)
+    {
+        if (cbtData.vec[inx] <= snapNumber)
+            continue;
+
+        sector_t sector = inx * blockSectors;
+        if (sector >= capacity)
+            break;
+
+        sector_t count = std::min(blockSectors, capacity - sector);
+        if (!ranges.empty() && (ranges.back().sector + ranges.back().count == sector))
+            ranges.back().count += count;
+        else
+            ranges.emplace_back(sector, count);
+    }
+
+    SetRanges(ranges);
+}
+
+/*
+ * If the completions cannot be received, the engine is retried with an
+ * increasing pause, so the worker does not spin on a persistent error.
+ */
+static const unsigned int reapErrorsMax = 8;
+static const unsigned int reapPauseMaxMs = 100;
+
+void CSnapshotReader::SetError(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_errorLock);
+        if (!m_error)
+            m_error = error;
+    }
+    m_stop = true;
+    for (auto& ptrPool : m_pools)
+        ptrPool->Stop();
+}
+
+void CSnapshotReader::Worker(CBufferPool& pool, CReorder* reorder, const ReaderCallback& callback)
+{
+    std::vector<SIoRequest> requests(m_config.queueDepth);
+    std::vector<SIoRequest*> freeRequests;
+    std::vector<SIoRequest*> completed;
+    unsigned int inflight = 0;
+    unsigned int reapErrors = 0;
+    bool exhausted = false;
+    std::shared_ptr<IIoEngine> ptrEngine;
+
+    try
+    {
+        ptrEngine = CreateEngine(m_engine, m_image.Get(), m_config.queueDepth);
+    }
+    catch (...)
+    {
+        SetError(std::current_exception());
+        return;
+    }
+
+    for (auto& req : requests)
+        freeRequests.push_back(&req);
+
+    for (;;)
+    {
+        while (!m_stop && !exhausted && !freeRequests.empty())
+        {
+            /*
+             * A buffer is waited for only when there are no requests in
+             * flight. Otherwise, the completed requests must be processed
+             * first, because the held buffers can only be released after
+             * that.
+             */
+            void* buffer = pool.Get(inflight == 0);
+            if (!buffer)
+                break;
+
+            size_t index = m_nextPortion++;
+            if (index >= m_portions.size())
+            {
+                pool.Put(buffer);
+                exhausted = true;
+                break;
+            }
+
+            SIoRequest* req = freeRequests.back();
+            freeRequests.pop_back();
+
+            req->index = index;
+            req->range = m_portions[index];
+            req->buffer = buffer;
+            req->result = 0;
+            ptrEngine->Submit(req);
+            inflight++;
+        }
+
+        if (!inflight)
+            break;
+
+        completed.clear();
+        try
+        {
+            ptrEngine->Reap(completed);
+            reapErrors = 0;
+        }
+        catch (...)
+        {
+            /*
+             * The requests in flight are still referenced by the kernel,
+             * so their buffers cannot be released. Reading is stopped, but
+             * the completions are still waited for. After too many errors
+             * the worker gives up, and the engine is released, which cancels
+             * the requests in flight.
+             */
+            SetError(std::current_exception());
+            if (++reapErrors >= reapErrorsMax)
+                break;
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(std::min(1U << reapErrors, reapPauseMaxMs)));
+            continue;
+        }
+
+        for (SIoRequest* req : completed)
+        {
+            inflight--;
+            freeRequests.push_back(req);
+
+            if (m_stop)
+            {
+                pool.Put(req->buffer);
+                continue;
+            }
+
+            try
+            {
+                if (req->result < 0)
+                    throw std::system_error(static_cast<int>(-req->result), std::generic_category(),
+                                            "Failed to read the image [" + m_imagePath + "].");
+                if (static_cast<unsigned long long>(req->result) != (req->range.count << SECTOR_SHIFT))
+                    throw std::system_error(EIO, std::generic_category(),
+                                            "Unexpected end of the image [" + m_imagePath + "].");
+
+                if (reorder)
+                    reorder->Complete(req->index, req->range, req->buffer, &pool);
+                else
+                {
+                    callback(req->range, req->buffer);
+                    pool.Put(req->buffer);
+                }
+            }
+            catch (...)
+            {
+                SetError(std::current_exception());
+            }
+        }
+    }
+}
+
+void CSnapshotReader::Read(const ReaderCallback& callback)
+{
+    std::vector<std::thread> workers;
+    std::shared_ptr<CReorder> ptrReorder;
+    const size_t alignment = std::max(static_cast<size_t>(::sysconf(_SC_PAGESIZE)),
+                                      static_cast<size_t>(m_logicalBlockSize));
+
+    m_portions.clear();
+    for (const SRange& range : m_ranges)
+    {
+        for (sector_t offset = 0; offset < range.count; offset += m_blockSectors)
+            m_portions.emplace_back(range.sector + offset, std::min(m_blockSectors, range.count - offset));
+    }
+    m_nextPortion = 0;
+    m_stop = false;
+    m_error = nullptr;
+
+    m_pools.clear();
+    for (unsigned int inx = 0; inx < m_config.workers; inx++)
+        m_pools.push_back(std::make_shared<CBufferPool>(m_config.blockSize, alignment, m_config.queueDepth));
+
+    if (m_config.ordered)
+        ptrReorder = std::make_shared<CReorder>(callback);
+
+    for (auto& ptrPool : m_pools)
+        workers.emplace_back(&CSnapshotReader::Worker, this, std::ref(*ptrPool), ptrReorder.get(),
+                             std::cref(callback));
+    for (auto& worker : workers)
+        worker.join();
+    m_pools.clear();
+
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
@@ -31,22 +31,36 @@ using namespace blksnap;
 
 #define BLKSNAP_FILTER_NAME {'b','l','k','s','n','a','p','\0'}
 
-CTracker::CTracker(const std::string& devicePath)
+static inline void Ioctl(int fd, unsigned long request, void* arg, std::error_code& ec) noexcept
 {
-    m_fd = ::open(devicePath.c_str(), O_DIRECT, 0600);
-    if (m_fd < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to open block device ["+devicePath+"].");
+    if (::ioctl(fd, request, arg) < 0)
+        ec.assign(errno, std::generic_category());
+    else
+        ec.clear();
 }
-CTracker::~CTracker()
+
+/*
+ * The device is opened only to send the ioctls to the filter. A character
+ * device that stands in for a block device in tests cannot be opened with
+ * O_DIRECT.
+ */
+CTracker::CTracker(const std::string& devicePath)
+    : m_devicePath(devicePath)
 {
-    if (m_fd > 0) {
-        ::close(m_fd);
-        m_fd = 0;
+    try
+    {
+        m_device = CHandleCache::Instance().Open(devicePath, CHandleCache::Instance().DeviceFlags());
     }
+    catch (std::system_error& ex)
+    {
+        throw std::system_error(ex.code(), "Failed to open block device ["+devicePath+"].");
+    }
+    m_fd = m_device->Get();
 }
+CTracker::~CTracker()
+{ }
 
-bool CTracker::Attach()
+bool CTracker::Attach(std::error_code& ec) noexcept
 {
     struct blkfilter_attach arg = {
         .name = BLKSNAP_FILTER_NAME,
@@ -54,28 +68,43 @@ bool CTracker::Attach()
         .optlen = 0u,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_ATTACH, &arg) < 0) {
-        if (errno == EALREADY)
-            return false;
-        else
-            throw std::system_error(errno, std::generic_category(),
-                "Failed to attach 'blksnap' filter.");
+    Ioctl(m_fd, BLKFILTER_ATTACH, &arg, ec);
+    if (ec.value() == EALREADY) {
+        ec.clear();
+        return false;
     }
-    return true;
+    return !ec;
 }
-void CTracker::Detach()
+bool CTracker::Attach()
+{
+    std::error_code ec;
+    bool ret = Attach(ec);
+
+    if (ec)
+        throw std::system_error(ec, "Failed to attach 'blksnap' filter.");
+    return ret;
+}
+
+void CTracker::Detach(std::error_code& ec) noexcept
 {
     struct blkfilter_detach arg = {
         .name = BLKSNAP_FILTER_NAME,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_DETACH, &arg) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to detach 'blksnap' filter.");
+    Ioctl(m_fd, BLKFILTER_DETACH, &arg, ec);
+    if (!ec)
+        CHandleCache::Instance().Release(m_devicePath);
+}
+void CTracker::Detach()
+{
+    std::error_code ec;
 
+    Detach(ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to detach 'blksnap' filter.");
 }
 
-void CTracker::CbtInfo(struct blksnap_cbtinfo& cbtInfo)
+void CTracker::CbtInfo(struct blksnap_cbtinfo& cbtInfo, std::error_code& ec) noexcept
 {
     struct blkfilter_ctl ctl = {
         .name = BLKSNAP_FILTER_NAME,
@@ -84,11 +113,19 @@ void CTracker::CbtInfo(struct blksnap_cbtinfo& cbtInfo)
         .opt = (__u64)&cbtInfo,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_CTL, &ctl) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to get CBT information.");
+    Ioctl(m_fd, BLKFILTER_CTL, &ctl, ec);
 }
-void CTracker::ReadCbtMap(unsigned int offset, unsigned int length, uint8_t* buff)
+void CTracker::CbtInfo(struct blksnap_cbtinfo& cbtInfo)
+{
+    std::error_code ec;
+
+    CbtInfo(cbtInfo, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to get CBT information.");
+}
+
+void CTracker::ReadCbtMap(unsigned int offset, unsigned int length, uint8_t* buff,
+                          std::error_code& ec) noexcept
 {
     struct blksnap_cbtmap arg = {
         .offset = offset,
@@ -102,12 +139,18 @@ void CTracker::ReadCbtMap(unsigned int offset, unsigned int length, uint8_t* buf
         .opt = (__u64)&arg,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_CTL, &ctl) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to read CBT map.");
+    Ioctl(m_fd, BLKFILTER_CTL, &ctl, ec);
+}
+void CTracker::ReadCbtMap(unsigned int offset, unsigned int length, uint8_t* buff)
+{
+    std::error_code ec;
 
+    ReadCbtMap(offset, length, buff, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to read CBT map.");
 }
-void CTracker::MarkDirtyBlock(std::vector<struct blksnap_sectors>& ranges)
+
+void CTracker::MarkDirtyBlock(std::vector<struct blksnap_sectors>& ranges, std::error_code& ec) noexcept
 {
     struct blksnap_cbtdirty arg = {
         .count = static_cast<unsigned int>(ranges.size()),
@@ -120,11 +163,18 @@ void CTracker::MarkDirtyBlock(std::vector<struct blksnap_sectors>& ranges)
         .opt = (__u64)&arg,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_CTL, &ctl) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to mark block as 'dirty' in CBT map.");
+    Ioctl(m_fd, BLKFILTER_CTL, &ctl, ec);
 }
-void CTracker::SnapshotAdd(const uuid_t& id)
+void CTracker::MarkDirtyBlock(std::vector<struct blksnap_sectors>& ranges)
+{
+    std::error_code ec;
+
+    MarkDirtyBlock(ranges, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to mark block as 'dirty' in CBT map.");
+}
+
+void CTracker::SnapshotAdd(const uuid_t& id, std::error_code& ec) noexcept
 {
     struct blksnap_snapshotadd arg;
     uuid_copy(arg.id.b, id);
@@ -136,11 +186,18 @@ void CTracker::SnapshotAdd(const uuid_t& id)
         .opt = (__u64)&arg,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_CTL, &ctl) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to add device to snapshot.");
+    Ioctl(m_fd, BLKFILTER_CTL, &ctl, ec);
 }
-void CTracker::SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo)
+void CTracker::SnapshotAdd(const uuid_t& id)
+{
+    std::error_code ec;
+
+    SnapshotAdd(id, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to add device to snapshot.");
+}
+
+void CTracker::SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo, std::error_code& ec) noexcept
 {
     struct blkfilter_ctl ctl = {
         .name = BLKSNAP_FILTER_NAME,
@@ -149,7 +206,13 @@ void CTracker::SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo)
         .opt = (__u64)&snapshotinfo,
     };
 
-    if (::ioctl(m_fd, BLKFILTER_CTL, &ctl) < 0)
-        throw std::system_error(errno, std::generic_category(),
-            "Failed to get snapshot information.");
+    Ioctl(m_fd, BLKFILTER_CTL, &ctl, ec);
+}
+void CTracker::SnapshotInfo(struct blksnap_snapshotinfo& snapshotinfo)
+{
+    std::error_code ec;
+
+    SnapshotInfo(snapshotinfo, ec);
+    if (ec)
+        throw std::system_error(ec, "Failed to get snapshot information.");
 }
@@ -0,0 +1,112 @@
+#!/bin/bash -e
+#
+# SPDX-License-Identifier: GPL-2.0+
+
+. ./functions.sh
+. ./blksnap.sh
+
+BLk_SZ=128
+DIFF_STORAGE_SZ=32
+
+echo "---"
+echo "Append difference storage test start"
+
+# diff_storage_minimum=32768 - set 32 K sectors, it's 16MiB diff_storage portion size
+blksnap_load "diff_storage_minimum=32768"
+
+# check module is ready
+blksnap_version
+
+TESTDIR=${HOME}/blksnap-test
+rm -rf ${TESTDIR}
+mkdir -p ${TESTDIR}
+
+MPDIR=/mnt/blksnap-test
+rm -rf ${MPDIR}
+mkdir -p ${MPDIR}
+
+# create small difference storage device and spare device
+DIFF_STOGAGE_FILE=${TESTDIR}/diff_storage.img
+imagefile_make ${DIFF_STOGAGE_FILE} ${DIFF_STORAGE_SZ}
+DIFF_STOGAGE_DEVICE=$(loop_device_attach ${DIFF_STOGAGE_FILE})
+echo "new device ${DIFF_STOGAGE_DEVICE}"
+
+SPARE_FILE=${TESTDIR}/spare.img
+imagefile_make ${SPARE_FILE} ${BLk_SZ}
+SPARE_DEVICE=$(loop_device_attach ${SPARE_FILE})
+echo "new device ${SPARE_DEVICE}"
+
+# create first device
+IMAGEFILE_1=${TESTDIR}/simple_1.img
+imagefile_make ${IMAGEFILE_1} ${BLk_SZ}
+
+DEVICE_1=$(loop_device_attach ${IMAGEFILE_1})
+mkfs.ext4 ${DEVICE_1}
+echo "new device ${DEVICE_1}"
+
+MOUNTPOINT_1=${MPDIR}/simple_1
+mkdir -p ${MOUNTPOINT_1}
+mount ${DEVICE_1} ${MOUNTPOINT_1}
+
+dd if=/dev/urandom of=${MOUNTPOINT_1}/before bs=1M count=96 status=none oflag=direct
+(cd ${MOUNTPOINT_1} && md5sum before > hash.md5)
+drop_cache
+
+blksnap_snapshot_create "${DEVICE_1}" "${DIFF_STOGAGE_DEVICE}" "${BLk_SZ}M"
+blksnap_snapshot_take
+
+echo "Write to original until the free space is running out"
+dd if=/dev/urandom of=${MOUNTPOINT_1}/before bs=1M count=24 status=none oflag=direct conv=notrunc
+EVENT=$(${BLKSNAP} snapshot_waitevent --id=${ID} --timeout=1000 | grep "event=" || true)
+if [ "${EVENT}" != "event=low_space" ]
+then
+	echo "The low_space event was expected, but '${EVENT}' was received"
+	exit 1
+fi
+
+echo "Append spare device ${SPARE_DEVICE}"
+${BLKSNAP} snapshot_append_storage --id=${ID} --device=${SPARE_DEVICE}
+RESULT=$(${BLKSNAP} snapshot_append_storage --id=${ID} --device=${SPARE_DEVICE})
+if [ "${RESULT}" != "result=already" ]
+then
+	echo "The device should not be appended twice"
+	exit 1
+fi
+
+echo "Write to original more than the first device can store"
+dd if=/dev/urandom of=${MOUNTPOINT_1}/before bs=1M count=64 seek=24 status=none oflag=direct conv=notrunc
+drop_cache
+
+ERROR_CODE=$(${BLKSNAP} snapshot_info --device=${DEVICE_1} --field=error_code)
+if [ "${ERROR_CODE}" != "0" ]
+then
+	echo "The snapshot is corrupted with error ${ERROR_CODE}"
+	exit 1
+fi
+
+echo "Check snapshots"
+DEVICE_IMAGE_1=$(blksnap_get_image ${DEVICE_1})
+IMAGE_1=${TESTDIR}/image0
+mkdir -p ${IMAGE_1}
+mount -o ro ${DEVICE_IMAGE_1} ${IMAGE_1}
+check_files ${IMAGE_1}
+umount ${IMAGE_1}
+
+blksnap_snapshot_destroy
+
+echo "Destroy first device"
+blksnap_detach ${DEVICE_1}
+umount ${MOUNTPOINT_1}
+loop_device_detach ${DEVICE_1}
+imagefile_cleanup ${IMAGEFILE_1}
+
+echo "Destroy diff storage devices"
+loop_device_detach ${SPARE_DEVICE}
+imagefile_cleanup ${SPARE_FILE}
+loop_device_detach ${DIFF_STOGAGE_DEVICE}
+imagefile_cleanup ${DIFF_STOGAGE_FILE}
+
+blksnap_unload
+
+echo "Append difference storage test finish"
+echo "---"
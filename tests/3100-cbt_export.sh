@@ -0,0 +1,113 @@
+#!/bin/bash -e
+#
+# SPDX-License-Identifier: GPL-2.0+
+
+if [ -z $1 ]
+then
+	DIFF_STORAGE_DIR=${HOME}
+else
+	DIFF_STORAGE_DIR=$1
+fi
+
+. ./functions.sh
+. ./blksnap.sh
+BLOCK_SIZE=$(block_size_mnt ${DIFF_STORAGE_DIR})
+
+echo "---"
+echo "Incremental export test"
+
+blksnap_load "diff_storage_minimum=262144"
+
+# check module is ready
+blksnap_version
+
+TESTDIR=${HOME}/blksnap-test
+MPDIR=/mnt/blksnap-test
+DIFF_STORAGE="${DIFF_STORAGE_DIR}/diff_storage"
+EXPORT_IMAGE=${TESTDIR}/export.img
+
+rm -rf ${TESTDIR}
+rm -rf ${MPDIR}
+mkdir -p ${TESTDIR}
+mkdir -p ${MPDIR}
+
+IMAGEFILE_1=${TESTDIR}/simple_1.img
+imagefile_make ${IMAGEFILE_1} 1024
+
+DEVICE_1=$(loop_device_attach ${IMAGEFILE_1} ${BLOCK_SIZE})
+mkfs.ext4 ${DEVICE_1}
+echo "new device ${DEVICE_1}"
+
+MOUNTPOINT_1=${MPDIR}/simple_1
+mkdir -p ${MOUNTPOINT_1}
+mount ${DEVICE_1} ${MOUNTPOINT_1}
+
+generate_files_direct ${MOUNTPOINT_1} "before" 5
+drop_cache
+
+rm -f ${DIFF_STORAGE}
+fallocate --length 1GiB ${DIFF_STORAGE}
+
+echo "Full export"
+blksnap_snapshot_create ${DEVICE_1} "${DIFF_STORAGE}" "1G"
+blksnap_snapshot_take
+IMAGE_1=$(blksnap_get_image ${DEVICE_1})
+
+RESULT=$(blksnap_export ${DEVICE_1} ${EXPORT_IMAGE})
+echo "${RESULT}"
+GENERATION=$(echo "${RESULT}" | sed -n 's/^generation_id=//p')
+CHANGES_NUMBER=$(echo "${RESULT}" | sed -n 's/^changes_number=//p')
+cmp ${IMAGE_1} ${EXPORT_IMAGE}
+
+generate_block_MB ${MOUNTPOINT_1} "full" 10
+blksnap_snapshot_destroy
+
+for INCREMENT in 1 2 3
+do
+	echo "Incremental export #${INCREMENT}"
+	blksnap_snapshot_create ${DEVICE_1} "${DIFF_STORAGE}" "1G"
+	blksnap_snapshot_take
+	IMAGE_1=$(blksnap_get_image ${DEVICE_1})
+
+	RESULT=$(blksnap_export ${DEVICE_1} ${EXPORT_IMAGE} --incremental --generation=${GENERATION} --changes_number=${CHANGES_NUMBER})
+	echo "${RESULT}"
+	if [ "$(echo "${RESULT}" | sed -n 's/^mode=//p')" != "incremental" ]
+	then
+		echo "The export was not incremental"
+		exit 1
+	fi
+	GENERATION=$(echo "${RESULT}" | sed -n 's/^generation_id=//p')
+	CHANGES_NUMBER=$(echo "${RESULT}" | sed -n 's/^changes_number=//p')
+	cmp ${IMAGE_1} ${EXPORT_IMAGE}
+
+	generate_block_MB ${MOUNTPOINT_1} "inc-${INCREMENT}" 10
+	blksnap_snapshot_destroy
+done
+
+echo "Export with mismatched generation"
+blksnap_snapshot_create ${DEVICE_1} "${DIFF_STORAGE}" "1G"
+blksnap_snapshot_take
+IMAGE_1=$(blksnap_get_image ${DEVICE_1})
+
+RESULT=$(blksnap_export ${DEVICE_1} ${EXPORT_IMAGE} --incremental --generation=$(uuidgen) --changes_number=${CHANGES_NUMBER})
+echo "${RESULT}"
+if [ "$(echo "${RESULT}" | sed -n 's/^mode=//p')" != "full" ]
+then
+	echo "The export should fall back to full"
+	exit 1
+fi
+cmp ${IMAGE_1} ${EXPORT_IMAGE}
+blksnap_snapshot_destroy
+
+rm -f ${EXPORT_IMAGE}
+
+echo "Destroy first device"
+blksnap_detach ${DEVICE_1}
+umount ${MOUNTPOINT_1}
+loop_device_detach ${DEVICE_1}
+imagefile_cleanup ${IMAGEFILE_1}
+
+blksnap_unload
+
+echo "Incremental export test finish"
+echo "---"
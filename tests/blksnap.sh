@@ -111,6 +111,15 @@ blksnap_markdirty()
 	${BLKSNAP} markdirtyblock --file=${DIRTYFILE}
 }
 
+blksnap_export()
+{
+	local DEVICE=$1
+	local OUTPUT=$2
+
+	shift 2
+	${BLKSNAP} export --device=${DEVICE} --output=${OUTPUT} $@
+}
+
 blksnap_snapshot_watcher()
 {
 	${BLKSNAP} snapshot_watcher --id=${ID} &
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "helpers/AlignedBuffer.hpp"
+#include "helpers/BlockDevice.h"
+#include "helpers/Log.h"
+#include "ImageChecker.h"
+#include "TestSector.h"
+
+static const size_t portionSize = 1024 * 1024;
+static const off_t rangeSize = 64 * 1024 * 1024;
+
+void CheckImage(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
+                const int seqNumber, const clock_t seqTime, const size_t alignment, unsigned int threads)
+{
+    const off_t sizeBdev = ptrBdev->Size();
+    const size_t rangeCount = static_cast<size_t>((sizeBdev + rangeSize - 1) / rangeSize);
+    std::atomic<size_t> nextRange(0);
+    std::atomic<bool> isStop(false);
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    if (!threads)
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    threads = static_cast<unsigned int>(std::min(static_cast<size_t>(threads), std::max(rangeCount, size_t(1))));
+
+    auto worker = [&]() {
+        try
+        {
+            AlignedBuffer<unsigned char> portion(alignment, portionSize);
+            SFailCollector collector;
+
+            while (!isStop)
+            {
+                const size_t range = nextRange++;
+                if (range >= rangeCount)
+                    break;
+
+                const off_t rangeOffset = static_cast<off_t>(range) * rangeSize;
+                const off_t rangeEnd = std::min(rangeOffset + rangeSize, sizeBdev);
+
+                for (off_t offset = rangeOffset; offset < rangeEnd; offset += portion.Size())
+                {
+                    size_t size = std::min(portion.Size(), static_cast<size_t>(rangeEnd - offset));
+
+                    ptrBdev->Read(portion.Data(), size, offset);
+                    ptrGen->Check(portion.Data(), size, offset >> SECTOR_SHIFT, seqNumber, seqTime, false, collector);
+                }
+            }
+            ptrGen->MergeFails(collector);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(errorLock);
+
+            if (!error)
+                error = std::current_exception();
+            isStop = true;
+        }
+    };
+
+    logger.Info("Check on image [" + ptrBdev->Name() + "] by " + std::to_string(threads) + " threads");
+
+    ::sync();
+
+    std::vector<std::thread> workers;
+    for (unsigned int inx = 1; inx < threads; inx++)
+        workers.emplace_back(worker);
+    worker();
+    for (std::thread& th : workers)
+        th.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <ctime>
+#include <memory>
+
+class CBlockDevice;
+class CTestSectorGenetor;
+
+/**
+ * Checks the test data on the whole block device.
+ * The device is divided into ranges that are read and checked by several
+ * threads. Each thread collects the failures separately, and they are merged
+ * into the generator when the thread completes. The merged failed ranges are
+ * sorted, so the result does not depend on the order of the threads.
+ * If threads is zero, the number of threads is equal to the number of CPUs.
+ */
+void CheckImage(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
+                const int seqNumber, const clock_t seqTime, const size_t alignment, unsigned int threads);
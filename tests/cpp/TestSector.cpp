@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
-#include <boost/crc.hpp>
+#include <algorithm>
 #include <string.h>
+#include "helpers/Crc32c.h"
 #include "helpers/Log.h"
 #include "helpers/RandomHelper.h"
 #include "TestSector.h"
@@ -21,21 +22,21 @@ void STestHeader::Init(const int inSeqNumber, const sector_t inSector, const clo
 
 void CTestSectorGenetor::Generate(unsigned char* buffer, size_t size, sector_t sector, const clock_t seqTime)
 {
+    /*
+     * The whole buffer is filled with random data at once, then the headers
+     * of the sectors are overwritten.
+     */
+    CRandomHelper::GenerateBuffer(buffer, size);
+
     for (size_t offset = 0; offset < size; offset += SECTOR_SIZE)
     {
         STestSector* t = (STestSector*)(buffer + offset);
 
         t->header.Init(m_seqNumber, sector, seqTime);
 
-        CRandomHelper::GenerateBuffer(t->body, sizeof(t->body));
-
         if (m_useCrc32)
-        {
-            boost::crc_32_type calc;
-            calc.process_bytes(buffer + offset + offsetof(STestHeader, seqNumber),
-                               SECTOR_SIZE - offsetof(STestHeader, seqNumber));
-            t->header.crc = calc.checksum();
-        }
+            t->header.crc = static_cast<int>(CCrc32c::Calculate(buffer + offset + offsetof(STestHeader, seqNumber),
+                                                                SECTOR_SIZE - offsetof(STestHeader, seqNumber)));
 
         sector++;
     }
@@ -47,6 +48,11 @@ void CTestSectorGenetor::Generate(unsigned char* buffer, size_t size, sector_t s
 }
 
 void CTestSectorGenetor::Check(unsigned char* buffer, size_t size, sector_t sector, const int seqNumber, const clock_t seqTime, bool isStrictly/*=false*/)
+{
+    Check(buffer, size, sector, seqNumber, seqTime, isStrictly, m_fails);
+}
+
+void CTestSectorGenetor::Check(unsigned char* buffer, size_t size, sector_t sector, const int seqNumber, const clock_t seqTime, const bool isStrictly, SFailCollector& collector)
 {
     for (size_t offset = 0; offset < size; offset += SECTOR_SIZE)
     {
@@ -54,12 +60,8 @@ void CTestSectorGenetor::Check(unsigned char* buffer, size_t size, sector_t sect
 
         int crc = 0xDEC032CC;
         if (m_useCrc32)
-        {
-            boost::crc_32_type calc;
-            calc.process_bytes(buffer + offsetof(STestHeader, seqNumber),
-                               SECTOR_SIZE - offsetof(STestHeader, seqNumber));
-            crc = calc.checksum();
-        }
+            crc = static_cast<int>(CCrc32c::Calculate(buffer + offsetof(STestHeader, seqNumber),
+                                                      SECTOR_SIZE - offsetof(STestHeader, seqNumber)));
 
         bool isCorrupted = (crc != t->header.crc);
         bool isIncorrect = (sector != t->header.sector);
@@ -69,10 +71,11 @@ void CTestSectorGenetor::Check(unsigned char* buffer, size_t size, sector_t sect
         if (isCorrupted || isIncorrect || isInvalidSeqNumber || isInvalidSeqTime)
         {
             std::string failMessage;
+            const int logLineCount = m_logLineCount;
 
-            if (m_logLineCount == 30)
+            if (logLineCount == 30)
                 failMessage = "Too many sectors failed\n";
-            else if (m_logLineCount < 30)
+            else if (logLineCount < 30)
             {
                 if (isCorrupted)
                 {
@@ -105,7 +108,7 @@ void CTestSectorGenetor::Check(unsigned char* buffer, size_t size, sector_t sect
                 }
             }
 
-            SetFailedSector(sector, failMessage);
+            SetFailedSector(sector, failMessage, collector);
             //logger.Err(buffer, 128);
         }
 
@@ -123,13 +126,13 @@ void CTestSectorGenetor::LogSector(sector_t sector, const std::string& failMessa
     logger.Err(failMessage);
 }
 
-void CTestSectorGenetor::SetFailedSector(sector_t sector, const std::string& failMessage)
+void CTestSectorGenetor::SetFailedSector(sector_t sector, const std::string& failMessage, SFailCollector& collector)
 {
-    m_failCount++;
+    collector.failCount++;
 
-    if (!m_failedRanges.empty())
+    if (!collector.failedRanges.empty())
     {
-        SRange& lastRange = m_failedRanges[m_failedRanges.size() - 1];
+        SRange& lastRange = collector.failedRanges[collector.failedRanges.size() - 1];
         if ((lastRange.sector + lastRange.count) == sector)
         {
             lastRange.count++;
@@ -138,6 +141,32 @@ void CTestSectorGenetor::SetFailedSector(sector_t sector, const std::string& fai
         }
     }
 
-    m_failedRanges.emplace_back(sector, 1);
+    collector.failedRanges.emplace_back(sector, 1);
     LogSector(sector, failMessage);
 }
+
+void CTestSectorGenetor::MergeFails(const SFailCollector& collector)
+{
+    std::lock_guard<std::mutex> guard(m_mergeLock);
+    std::vector<SRange>& ranges = m_fails.failedRanges;
+
+    m_fails.failCount += collector.failCount;
+    if (collector.failedRanges.empty())
+        return;
+
+    ranges.insert(ranges.end(), collector.failedRanges.begin(), collector.failedRanges.end());
+    std::sort(ranges.begin(), ranges.end(), [](const SRange& a, const SRange& b) {
+        return a.sector < b.sector;
+    });
+
+    size_t last = 0;
+    for (size_t inx = 1; inx < ranges.size(); inx++)
+    {
+        if ((ranges[last].sector + ranges[last].count) >= ranges[inx].sector)
+            ranges[last].count = std::max(ranges[last].sector + ranges[last].count,
+                                          ranges[inx].sector + ranges[inx].count) - ranges[last].sector;
+        else
+            ranges[++last] = ranges[inx];
+    }
+    ranges.resize(last + 1);
+}
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0+
 #include <atomic>
 #include <ctime>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <blksnap/Sector.h>
 
@@ -27,13 +29,26 @@ enum EFailType
     eFailIncorrectSector,
 };
 
+/**
+ * The failures found by one checking thread. Each thread should use its own
+ * collector, so the threads do not share any data while checking. The
+ * collectors are merged into the generator when the checking is complete.
+ */
+struct SFailCollector
+{
+    SFailCollector()
+        : failCount(0) {};
+
+    int failCount;
+    std::vector<blksnap::SRange> failedRanges;
+};
+
 class CTestSectorGenetor
 {
 public:
     CTestSectorGenetor(const bool useCrc32)
         : m_useCrc32(useCrc32)
         , m_seqNumber(0)
-        , m_failCount(0)
         , m_logLineCount(0) {};
     ~CTestSectorGenetor() {};
 
@@ -50,11 +65,16 @@ public:
     void Generate(unsigned char* buffer, size_t size, blksnap::sector_t sector);
     void Generate(unsigned char* buffer, size_t size, blksnap::sector_t sector, clock_t seqTime);
     void Check(unsigned char* buffer, size_t size, blksnap::sector_t sector, const int seqNumber, const clock_t seqTime, const bool isStrictly = false);
+    /**
+     * The failures are stored in the collector of the calling thread.
+     * It allows to check one device by several threads.
+     */
+    void Check(unsigned char* buffer, size_t size, blksnap::sector_t sector, const int seqNumber, const clock_t seqTime, const bool isStrictly, SFailCollector& collector);
 
 
     inline int Fails()
     {
-        return m_failCount;
+        return m_fails.failCount;
     };
     /**
      * The function ShowFails() does not contain locks, since it should be
@@ -62,19 +82,24 @@ public:
      */
     inline const std::vector<blksnap::SRange>& GetFails()
     {
-        return m_failedRanges;
+        return m_fails.failedRanges;
     };
+    /**
+     * Adds the failures of the thread collector to the failures of the
+     * generator. The ranges are sorted and the adjacent ones are merged, so
+     * the result does not depend on the order of merging.
+     */
+    void MergeFails(const SFailCollector& collector);
 
 private:
     bool m_useCrc32;
     std::atomic<int> m_seqNumber;
-    int m_failCount;
-    int m_logLineCount;
-    std::vector<blksnap::SRange> m_failedRanges;
-    bool m_isCrc32Checking;
+    std::atomic<int> m_logLineCount;
+    SFailCollector m_fails;
+    std::mutex m_mergeLock;
 
 private:
     void LogSector(blksnap::sector_t sector, const std::string& failMessage);
-    void SetFailedSector(blksnap::sector_t sector, const std::string& failMessage);
+    void SetFailedSector(blksnap::sector_t sector, const std::string& failMessage, SFailCollector& collector);
 
 };
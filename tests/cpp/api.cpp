@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <blksnap/Service.h>
+#include <blksnap/Session.h>
+#include <blksnap/Snapshot.h>
+#include <blksnap/Tracker.h>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "helpers/Log.h"
+
+namespace po = boost::program_options;
+
+/*
+ * The test checks the control interface of the module through the libblksnap
+ * library: the snapshot is created, taken and destroyed, and the change
+ * tracking map is checked. The images of the snapshots are not read, so the
+ * test can be run against the fake of the module (fake_control) as well as
+ * against the module.
+ */
+
+static void Check(const bool condition, const std::string& message)
+{
+    if (!condition)
+        throw std::runtime_error(message);
+}
+
+static bool IsCollected(const blksnap::CSnapshotId& id)
+{
+    std::vector<blksnap::CSnapshotId> ids;
+
+    blksnap::CService().Collect(ids);
+    for (const auto& collected : ids)
+        if (!uuid_compare(collected.Get(), id.Get()))
+            return true;
+    return false;
+}
+
+static std::vector<uint8_t> ReadCbtMap(blksnap::CTracker& tracker, struct blksnap_cbtinfo& cbtInfo)
+{
+    tracker.CbtInfo(cbtInfo);
+
+    std::vector<uint8_t> map(cbtInfo.block_count);
+    tracker.ReadCbtMap(0, cbtInfo.block_count, map.data());
+    return map;
+}
+
+static void WriteBlock(const std::string& device, const off_t offset)
+{
+    std::vector<char> buf(4096, 'x');
+    int fd = ::open(device.c_str(), O_RDWR | O_SYNC);
+
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "Failed to open device [" + device + "]");
+    ssize_t ret = ::pwrite(fd, buf.data(), buf.size(), offset);
+    int err = errno;
+    ::close(fd);
+    if (ret != static_cast<ssize_t>(buf.size()))
+        throw std::system_error(err, std::generic_category(), "Failed to write to device [" + device + "]");
+}
+
+/*
+ * The fake of the module generates the event for all snapshots by the text
+ * command. The module does not accept the commands, and then false is
+ * returned.
+ */
+static bool GenerateEvent(const std::string& code)
+{
+    const std::string command = "event " + code;
+    int fd = ::open("/dev/" BLKSNAP_CTL, O_WRONLY);
+
+    if (fd < 0)
+        return false;
+    ssize_t ret = ::write(fd, command.c_str(), command.size());
+    ::close(fd);
+    return ret == static_cast<ssize_t>(command.size());
+}
+
+/*
+ * The session is destroyed while its event callback is blocked. The
+ * destructor should wait until the callback is completed, since the callback
+ * may use the objects that are released after the session.
+ */
+static void CheckSessionDestroy(const std::string& device, const std::string& diffStorage,
+                                const unsigned long long limit)
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    bool isEntered = false;
+    bool isCompleted = false;
+
+    auto ptrManager = blksnap::ISessionManager::Create();
+    auto ptrSession = ptrManager->CreateSession({device}, diffStorage, limit);
+    ptrSession->OnEvent([&](const blksnap::SBlksnapEvent& ev) {
+        if (ev.code != blksnap_event_code_no_space)
+            return;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            isEntered = true;
+        }
+        cv.notify_all();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        std::lock_guard<std::mutex> guard(lock);
+        isCompleted = true;
+    });
+
+    if (!GenerateEvent("no_space"))
+    {
+        logger.Info("The events cannot be generated, skip");
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        Check(cv.wait_for(guard, std::chrono::seconds(5), [&] { return isEntered; }),
+              "The event callback was not called");
+    }
+
+    ptrSession.reset();
+
+    std::lock_guard<std::mutex> guard(lock);
+    Check(isCompleted, "The session was destroyed before the event callback was completed");
+}
+
+void CheckApi(const std::string& device, const std::string& diffStorage, const unsigned long long limit,
+              const unsigned int events)
+{
+    logger.Info("--- Test: api ---");
+    logger.Info("device: " + device);
+
+    unsigned short major, minor, revision, build;
+    blksnap::CService().Version(major, minor, revision, build);
+    logger.Info("version: " + std::to_string(major) + "." + std::to_string(minor) + "." + std::to_string(revision)
+                + "." + std::to_string(build));
+
+    blksnap::CTracker tracker(device);
+    if (!tracker.Attach())
+        logger.Info("The tracker has already been attached");
+
+    struct blksnap_cbtinfo cbtInfo;
+    tracker.CbtInfo(cbtInfo);
+    Check(cbtInfo.block_count > 5, "The device is too small");
+    const off_t writeOffset = 3 * static_cast<off_t>(cbtInfo.block_size);
+    const unsigned long long dirtySector = (5ULL * cbtInfo.block_size) >> SECTOR_SHIFT;
+
+    logger.Info("- Create and take snapshot");
+    {
+        std::error_code ec;
+        Check(!blksnap::CSnapshot::Create("", limit, ec) && (ec.value() == EINVAL),
+              "The snapshot was created without the difference storage");
+
+        auto ptrSnapshot = blksnap::CSnapshot::Create(diffStorage, limit, ec);
+        Check(!ec && ptrSnapshot, "Failed to create snapshot: " + ec.message());
+        const blksnap::CSnapshotId id = ptrSnapshot->Id();
+
+        tracker.SnapshotAdd(id.Get());
+        tracker.SnapshotAdd(id.Get(), ec);
+        Check(ec.value() == EALREADY, "The device was added to the snapshot twice");
+
+        Check(IsCollected(id), "The created snapshot was not collected");
+
+        blksnap::STakeTiming timing = ptrSnapshot->Take();
+        logger.Info("take " + std::to_string(timing.takeNs) + " ns");
+
+        struct blksnap_snapshotinfo snapshotInfo;
+        tracker.SnapshotInfo(snapshotInfo);
+        Check(snapshotInfo.error_code == 0, "The snapshot is corrupted");
+        Check(snapshotInfo.image[0] != '\0', "The image of the snapshot was not created");
+
+        WriteBlock(device, writeOffset);
+
+        blksnap::SSnapshotStats stats = ptrSnapshot->Stats(ec);
+        if (ec.value() == ENOTTY)
+            logger.Info("The statistics of the snapshot are not supported");
+        else
+        {
+            Check(!ec, "Failed to get the statistics of the snapshot");
+            Check(stats.devices.size() == 1, "Unexpected number of devices in the statistics");
+            Check(stats.devices[0].copiedSectors > 0, "The written chunk was not copied");
+            logger.Info("copied " + std::to_string(stats.devices[0].copiedSectors) + " sectors");
+        }
+
+        blksnap::SBlksnapEvent ev;
+        for (unsigned int inx = 0; inx < events; inx++)
+        {
+            Check(ptrSnapshot->WaitEvent(1000, ev), "The event was not received");
+            Check(ev.code == blksnap_event_code_low_space, "Unexpected event " + std::to_string(ev.code));
+        }
+        Check(!ptrSnapshot->WaitEvent(100, ev), "Unexpected event " + std::to_string(ev.code));
+
+        ptrSnapshot->Destroy();
+        Check(!IsCollected(id), "The destroyed snapshot was collected");
+
+        ptrSnapshot->Destroy(ec);
+        Check(!!ec, "The snapshot was destroyed twice");
+    }
+
+    logger.Info("- Check change tracking");
+    {
+        auto ptrSnapshot = blksnap::CSnapshot::Create(diffStorage, limit);
+        tracker.SnapshotAdd(ptrSnapshot->Id().Get());
+
+        struct blksnap_cbtinfo cbtInfoPrev;
+        tracker.CbtInfo(cbtInfoPrev);
+        ptrSnapshot->Take();
+
+        std::vector<uint8_t> map = ReadCbtMap(tracker, cbtInfo);
+        if (uuid_compare(cbtInfoPrev.generation_id.b, cbtInfo.generation_id.b))
+            logger.Info("The generation of the change tracking map has been changed");
+        else
+            Check(map[writeOffset / cbtInfo.block_size] == cbtInfo.changes_number,
+                  "The written block is not marked in the change tracking map");
+
+        std::vector<struct blksnap_sectors> ranges = {{dirtySector, 1}};
+        tracker.MarkDirtyBlock(ranges);
+        map = ReadCbtMap(tracker, cbtInfo);
+        Check(map[5] >= cbtInfo.changes_number, "The dirty block is not marked in the change tracking map");
+
+        ptrSnapshot->Destroy();
+    }
+
+    logger.Info("- Destroy session while the event callback is blocked");
+    CheckSessionDestroy(device, diffStorage, limit);
+
+    struct blksnap_snapshotinfo snapshotInfo;
+    tracker.SnapshotInfo(snapshotInfo);
+    Check(snapshotInfo.image[0] == '\0', "The image of the destroyed snapshot exists");
+
+    logger.Info("--- Success: api ---");
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string("Checking the control interface of the blksnap module through libblksnap.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("device,d", po::value<std::string>(), "Device name. The change tracker is attached to it.")
+        ("diff_storage,s", po::value<std::string>(),
+            "The directory for the difference storage file or the difference storage file.")
+        ("diff_storage_limit", po::value<unsigned long long>()->default_value(1024ULL * 1024 * 1024),
+            "The maximum size of the difference storage in bytes.")
+        ("events", po::value<unsigned int>()->default_value(0),
+            "The number of the low_space events that should be received after taking the snapshot.")
+        ("no_direct", "Open the devices without O_DIRECT. The devices of the fake module do not support it.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    if (!vm.count("device"))
+        throw std::invalid_argument("Argument 'device' is missed.");
+    if (!vm.count("diff_storage"))
+        throw std::invalid_argument("Argument 'diff_storage' is missed.");
+    if (vm.count("no_direct"))
+        blksnap::CHandleCache::Instance().SetDeviceFlags(O_RDONLY);
+
+    CheckApi(vm["device"].as<std::string>(), vm["diff_storage"].as<std::string>(),
+             vm["diff_storage_limit"].as<unsigned long long>(), vm["events"].as<unsigned int>());
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
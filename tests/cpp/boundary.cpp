@@ -15,6 +15,8 @@
 #include "helpers/AlignedBuffer.hpp"
 #include "helpers/BlockDevice.h"
 #include "helpers/Log.h"
+#include "helpers/RandomHelper.h"
+#include "ImageChecker.h"
 #include "TestSector.h"
 
 namespace po = boost::program_options;
@@ -23,6 +25,7 @@ using blksnap::sector_t;
 using blksnap::SRange;
 
 int g_blksz = 512;
+unsigned int g_checkThreads = 0;
 
 void FillBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen,
                 const std::shared_ptr<CBlockDevice>& ptrBdev,
@@ -79,36 +82,19 @@ void FillAll(const std::shared_ptr<CTestSectorGenetor> ptrGen, const std::shared
 }
 
 /**
- * Fill the contents of the block device with special test data.
+ * Check the contents of the block device.
  */
 void CheckAll(const std::shared_ptr<CTestSectorGenetor> ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
               const int seqNumber, const clock_t seqTime)
 {
-    AlignedBuffer<unsigned char> portion(g_blksz, 1024 * 1024);
-    off_t sizeBdev = ptrBdev->Size();
-    sector_t sector = 0;
-
-    logger.Info("Check on image [" + ptrBdev->Name() + "]");
-
-    ::sync();
-
-    for (off_t offset = 0; offset < sizeBdev; offset += portion.Size())
-    {
-        size_t portionSize = std::min(portion.Size(), static_cast<size_t>(sizeBdev - offset));
-
-        ptrBdev->Read(portion.Data(), portionSize, offset);
-
-        ptrGen->Check(portion.Data(), portionSize, sector, seqNumber, seqTime);
-
-        sector += (portionSize >> SECTOR_SHIFT);
-    }
+    CheckImage(ptrGen, ptrBdev, seqNumber, seqTime, g_blksz, g_checkThreads);
 }
 
 static inline off_t randomChunk(const int chunkSize, const off_t downLimit, const off_t upLimit, std::map<off_t, bool>& excludeHistory)
 {
     while (true)
     {
-        off_t ret = downLimit + (std::rand() * static_cast<off_t>(chunkSize)) % upLimit;
+        off_t ret = downLimit + static_cast<off_t>(CRandomHelper::Uniform(upLimit / chunkSize)) * chunkSize;
 
         if (excludeHistory.find(ret) == excludeHistory.end())
             return ret;
@@ -119,7 +105,7 @@ static inline off_t randomChunk(const int chunkSize, const off_t downLimit, cons
 
 static inline int randomInt(const int upLimit, const int order)
 {
-    return (std::rand() % upLimit) & ~(order - 1);
+    return static_cast<int>(CRandomHelper::Uniform(upLimit)) & ~(order - 1);
 }
 
 static inline std::string GetBlksnapVersion()
@@ -137,8 +123,6 @@ void CheckBoundary(const std::string& origDevName, const std::string& diffStorag
                    const unsigned long long diffStorageLimit, const int durationLimitSec,
                    const bool isSync, const int chunkSize)
 {
-    std::srand(std::time(nullptr));
-
     logger.Info("--- Test: boundary conditions ---");
     logger.Info("version: " + GetBlksnapVersion());
     logger.Info("device: " + origDevName);
@@ -381,7 +365,10 @@ void Main(int argc, char* argv[])
         ("duration,u", po::value<int>(), "The test duration limit in minutes.")
         ("sync", "Use O_SYNC for access to original device.")
         ("blksz", po::value<int>()->default_value(512), "Align reads and writes to the block size.")
+        ("check_threads", po::value<unsigned int>()->default_value(0),
+            "The number of threads that check the snapshot image. By default, it is equal to the number of CPUs.")
         ("chunksize", po::value<int>(), "The size of chunks buffer.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to replay a failed run.")
         ;
     po::variables_map vm;
     po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
@@ -440,6 +427,12 @@ void Main(int argc, char* argv[])
     g_blksz = vm["blksz"].as<int>();
     logger.Info("blksz: " + std::to_string(g_blksz));
 
+    g_checkThreads = vm["check_threads"].as<unsigned int>();
+    logger.Info("check_threads: " + std::to_string(g_checkThreads));
+
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+
     try
     {
         CheckBoundary(origDevName, diffStorage, diffStorageLimit,
@@ -448,6 +441,7 @@ void Main(int argc, char* argv[])
     catch (std::exception& ex)
     {
         logger.Err(ex.what());
+        logger.Err("To replay the run, use --seed " + std::to_string(CRandomHelper::Seed()));
         throw std::runtime_error("--- Failed: boundary conditions ---");
     }
     logger.Info("--- Success: boundary conditions ---");
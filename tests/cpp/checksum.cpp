@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <boost/crc.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+
+#include "helpers/AlignedBuffer.hpp"
+#include "helpers/Crc32c.h"
+#include "helpers/Log.h"
+#include "helpers/RandomHelper.h"
+#include "TestSector.h"
+
+namespace po = boost::program_options;
+
+/*
+ * The test measures the throughput of the test sector generation and
+ * verification, and of the checksum algorithms used by them. It does not
+ * require the blksnap module. The corrupt and boundary tests should be able
+ * to generate the data faster than the block device can write it.
+ */
+
+static uint64_t ParseSize(std::string str)
+{
+    uint64_t multiple = 1;
+
+    switch (str.back())
+    {
+    case 'G':
+        multiple *= 1024;
+    case 'M':
+        multiple *= 1024;
+    case 'K':
+        multiple *= 1024;
+        str.pop_back();
+    default:
+        return std::stoull(str) * multiple;
+    }
+}
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void LogThroughput(const std::string& name, const size_t bytes, const uint64_t ns)
+{
+    const double mbPerSec = (ns ? (static_cast<double>(bytes) * 1000000000.0 / ns) : 0.0) / (1024 * 1024);
+
+    std::stringstream ss;
+
+    ss << std::left << std::setw(24) << name << std::right << std::setw(12) << std::fixed << std::setprecision(1)
+       << mbPerSec << " MiB/s";
+    logger.Info(ss.str());
+}
+
+static uint64_t Measure(const unsigned int iterations, const std::function<void()>& func)
+{
+    const uint64_t startNs = NowNs();
+
+    for (unsigned int inx = 0; inx < iterations; inx++)
+        func();
+    return NowNs() - startNs;
+}
+
+/*
+ * All implementations should give the same result for any length and any
+ * alignment of the data.
+ */
+static void CheckImplementations()
+{
+    const unsigned char check[] = "123456789";
+    AlignedBuffer<unsigned char> buf(SECTOR_SIZE, 64 * 1024);
+
+    CRandomHelper::GenerateBuffer(buf.Data(), buf.Size());
+    for (int impl = 0; impl < CCrc32c::eImplementationCount; impl++)
+    {
+        auto eImpl = static_cast<CCrc32c::EImplementation>(impl);
+
+        if (!CCrc32c::IsSupported(eImpl))
+            continue;
+
+        if (CCrc32c::Calculate(eImpl, check, 9) != 0xE3069283)
+            throw std::runtime_error(std::string("Invalid check value of the '") + CCrc32c::Name(eImpl)
+                                     + "' implementation");
+
+        for (size_t size = 0; size < buf.Size() - 8; size = size * 3 / 2 + 1)
+            for (size_t offset = 0; offset < 8; offset++)
+                if (CCrc32c::Calculate(eImpl, buf.Data() + offset, size)
+                    != CCrc32c::Calculate(CCrc32c::eScalar, buf.Data() + offset, size))
+                    throw std::runtime_error(std::string("The '") + CCrc32c::Name(eImpl)
+                                             + "' implementation gives an invalid result for size "
+                                             + std::to_string(size));
+    }
+}
+
+void CheckChecksum(const size_t bufferSize, const unsigned int iterations)
+{
+    logger.Info("--- Test: checksum ---");
+    logger.Info("buffer size: " + std::to_string(bufferSize) + " bytes");
+    logger.Info("best implementation: " + std::string(CCrc32c::Name(CCrc32c::Best())));
+
+    CheckImplementations();
+
+    AlignedBuffer<unsigned char> buf(SECTOR_SIZE, bufferSize);
+    CRandomHelper::GenerateBuffer(buf.Data(), buf.Size());
+    const size_t totalBytes = buf.Size() * iterations;
+    volatile uint32_t sink = 0;
+
+    logger.Info("Checksum of each sector:");
+    LogThroughput("crc32 boost", totalBytes, Measure(iterations, [&]() {
+        for (size_t offset = 0; offset < buf.Size(); offset += SECTOR_SIZE)
+        {
+            boost::crc_32_type calc;
+
+            calc.process_bytes(buf.Data() + offset, SECTOR_SIZE);
+            sink = sink ^ calc.checksum();
+        }
+    }));
+    for (int impl = 0; impl < CCrc32c::eImplementationCount; impl++)
+    {
+        auto eImpl = static_cast<CCrc32c::EImplementation>(impl);
+
+        if (!CCrc32c::IsSupported(eImpl))
+            continue;
+
+        LogThroughput(std::string("crc32c ") + CCrc32c::Name(eImpl), totalBytes, Measure(iterations, [&]() {
+            for (size_t offset = 0; offset < buf.Size(); offset += SECTOR_SIZE)
+                sink = sink ^ CCrc32c::Calculate(eImpl, buf.Data() + offset, SECTOR_SIZE);
+        }));
+    }
+
+    logger.Info("Test sectors:");
+    CTestSectorGenetor gen(true);
+    const clock_t seqTime = std::clock();
+    LogThroughput("generate", totalBytes, Measure(iterations, [&]() {
+        gen.Generate(buf.Data(), buf.Size(), 0, seqTime);
+    }));
+    LogThroughput("check", totalBytes, Measure(iterations, [&]() {
+        gen.Check(buf.Data(), buf.Size(), 0, gen.GetSequenceNumber(), seqTime, true);
+    }));
+
+    if (gen.Fails())
+        throw std::runtime_error("--- Failed: checksum ---");
+
+    logger.Info("--- Success: checksum ---");
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string("Measuring the throughput of the test data generation and verification.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("size,s", po::value<std::string>()->default_value("64M"),
+            "The size of the buffer. The suffixes G, M and K is allowed.")
+        ("iterations,n", po::value<unsigned int>()->default_value(16),
+            "The number of passes over the buffer for each algorithm.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    size_t bufferSize = ParseSize(vm["size"].as<std::string>());
+    if (!bufferSize || (bufferSize % SECTOR_SIZE))
+        throw std::invalid_argument("Argument 'size' should be a multiple of the sector size.");
+
+    unsigned int iterations = vm["iterations"].as<unsigned int>();
+    if (!iterations)
+        throw std::invalid_argument("Argument 'iterations' should be greater than zero.");
+
+    CRandomHelper::SetSeed(CRandomHelper::MakeSeed());
+    CheckChecksum(bufferSize, iterations);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "ChunkShift.h"
+
+/*
+ * The test checks that the estimate command of the blksnap tool calculates
+ * the size of the chunk in the same way as the module. The expected values
+ * are calculated by the algorithm of diff_area_calculate_chunk_size().
+ */
+
+struct SCase
+{
+    const char* name;
+    unsigned long long capacity;
+    unsigned int ioMin;
+    unsigned int pageShift;
+    SChunkParams params;
+};
+
+static SChunkParams Params(const unsigned int minimumShift, const unsigned int maximumShift,
+                           const unsigned int maximumCountShift)
+{
+    SChunkParams params;
+
+    params.minimumShift = minimumShift;
+    params.maximumShift = maximumShift;
+    params.maximumCountShift = maximumCountShift;
+    return params;
+}
+
+static void Check(const SCase& test, const unsigned int expected)
+{
+    const unsigned int shift = ChunkShift(test.capacity, test.ioMin, test.pageShift, test.params);
+
+    if (shift != expected)
+        throw std::runtime_error(std::string(test.name) + ": the chunk shift is " + std::to_string(shift)
+                                 + " instead of " + std::to_string(expected));
+    std::cout << test.name << ": " << shift << std::endl;
+}
+
+int main()
+{
+    const unsigned long long GiB = 1ULL << (30 - SECTOR_SHIFT);
+
+    try
+    {
+        // The minimum shift of the module is used for the device of 1 GiB
+        Check({"default", GiB, 4096, 12, SChunkParams()}, 18);
+        // The chunk is not smaller than the minimal I/O size
+        Check({"io_min 1 MiB", GiB, 1 << 20, 12, SChunkParams()}, 20);
+        // The chunk is not smaller than the page, even if the logical block is smaller
+        Check({"page 64 KiB", GiB, 512, 16, Params(9, 26, 40)}, 16);
+        Check({"io_min 512", GiB, 512, 12, Params(9, 26, 40)}, 12);
+        // The chunk is enlarged until the number of chunks fits the limit
+        Check({"count limit", GiB, 4096, 12, Params(18, 26, 10)}, 20);
+        Check({"count limit reached", 1024 * GiB, 4096, 12, Params(18, 26, 10)}, 26);
+        // The minimal I/O size is larger than the maximum chunk
+        Check({"io_min 128 MiB", GiB, 1 << 27, 12, SChunkParams()}, 27);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
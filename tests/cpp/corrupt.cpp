@@ -15,6 +15,9 @@
 #include "helpers/AlignedBuffer.hpp"
 #include "helpers/BlockDevice.h"
 #include "helpers/Log.h"
+#include "helpers/RandomHelper.h"
+#include "helpers/Workload.h"
+#include "ImageChecker.h"
 #include "TestSector.h"
 
 namespace po = boost::program_options;
@@ -23,6 +26,8 @@ using blksnap::sector_t;
 using blksnap::SRange;
 
 int g_blksz = 512;
+unsigned int g_checkThreads = 0;
+CWorkload::SParams g_workloadParams;
 
 /**
  * Fill the contents of the block device with special test data.
@@ -47,29 +52,12 @@ void FillAll(const std::shared_ptr<CTestSectorGenetor> ptrGen, const std::shared
 }
 
 /**
- * Fill the contents of the block device with special test data.
+ * Check the contents of the block device.
  */
 void CheckAll(const std::shared_ptr<CTestSectorGenetor> ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
               const int seqNumber, const clock_t seqTime)
 {
-    AlignedBuffer<unsigned char> portion(g_blksz, 1024 * 1024);
-    off_t sizeBdev = ptrBdev->Size();
-    sector_t sector = 0;
-
-    logger.Info("Check on image [" + ptrBdev->Name() + "]");
-
-    ::sync();
-
-    for (off_t offset = 0; offset < sizeBdev; offset += portion.Size())
-    {
-        size_t portionSize = std::min(portion.Size(), static_cast<size_t>(sizeBdev - offset));
-
-        ptrBdev->Read(portion.Data(), portionSize, offset);
-
-        ptrGen->Check(portion.Data(), portionSize, sector, seqNumber, seqTime);
-
-        sector += (portionSize >> SECTOR_SHIFT);
-    }
+    CheckImage(ptrGen, ptrBdev, seqNumber, seqTime, g_blksz, g_checkThreads);
 }
 
 void FillBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
@@ -81,13 +69,24 @@ void FillBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::sh
     ptrBdev->Write(portion.Data(), size, offset);
 }
 
+/**
+ * The maximum size of a random write is (0x1F + blkszSectors) blocks.
+ * The workload selects the first block of the write among the blocks at which
+ * such a write fits on the device.
+ */
+std::shared_ptr<CWorkload> CreateWorkload(const std::shared_ptr<CBlockDevice>& ptrBdev)
+{
+    const off_t maxSize = static_cast<off_t>(0x1F + (g_blksz >> SECTOR_SHIFT)) * g_blksz;
+
+    return std::make_shared<CWorkload>((ptrBdev->Size() - maxSize) / g_blksz + 1, g_workloadParams);
+}
+
 /**
  * Fill some random blocks with random offset
  */
 void FillRandomBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CBlockDevice>& ptrBdev,
-                      const int count)
+                      CWorkload& workload, const int count)
 {
-    off_t sizeBdev = ptrBdev->Size();
     size_t blkszSectors = g_blksz >> SECTOR_SHIFT;
     size_t totalSize = 0;
     std::stringstream ss;
@@ -95,18 +94,8 @@ void FillRandomBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const s
     logger.Detail(std::string("write " + std::to_string(count) + " transactions"));
     for (int cnt = 0; cnt < count; cnt++)
     {
-        size_t size = static_cast<size_t>((std::rand() & 0x1F) + blkszSectors) * blkszSectors * SECTOR_SIZE;
-
-#if 0
-        //ordered by default chunk size
-        off_t offset = static_cast<off_t>(std::rand()) << (SECTOR_SHIFT + 9);
-        if (offset > (sizeBdev - size))
-            offset = (offset % (sizeBdev - size)) & ~((1 << 9) - 1);
-#else
-        off_t offset = static_cast<off_t>(std::rand()) * blkszSectors * SECTOR_SIZE;
-        if (offset > (sizeBdev - size))
-            offset = offset % (sizeBdev - size);
-#endif
+        size_t size = static_cast<size_t>(CRandomHelper::Uniform(0x20) + blkszSectors) * g_blksz;
+        off_t offset = static_cast<off_t>(workload.Next()) * g_blksz;
 
         ss << (offset >> SECTOR_SHIFT) << ":" << (size >> SECTOR_SHIFT) << " ";
         FillBlocks(ptrGen, ptrBdev, offset, size);
@@ -253,6 +242,7 @@ void SimpleCorruption(const std::string& origDevName,
 
     logger.Info("-- Fill original device collection by test pattern");
     FillAll(ptrGen, ptrOrininal);
+    auto ptrWorkload = CreateWorkload(ptrOrininal);
 
     std::vector<std::string> devices;
     devices.push_back(origDevName);
@@ -302,12 +292,9 @@ void SimpleCorruption(const std::string& origDevName,
         ss << (offset >> SECTOR_SHIFT) << ":" << (size >> SECTOR_SHIFT) << " ";
 
         //Write random block
-        off_t sizeBdev = ptrOrininal->Size();
         size_t blkszSectors = g_blksz >> SECTOR_SHIFT;
-        offset = static_cast<off_t>(std::rand()) * blkszSectors * SECTOR_SIZE;
-        size = static_cast<size_t>((std::rand() & 0x1F) + blkszSectors) * blkszSectors * SECTOR_SIZE;
-        if (offset > (sizeBdev - size))
-            offset = offset % (sizeBdev - size);
+        offset = static_cast<off_t>(ptrWorkload->Next()) * g_blksz;
+        size = static_cast<size_t>(CRandomHelper::Uniform(0x20) + blkszSectors) * g_blksz;
         FillBlocks(ptrGen, ptrOrininal, offset, size);
         ss << (offset >> SECTOR_SHIFT) << ":" << (size >> SECTOR_SHIFT) << " ";
 
@@ -317,7 +304,7 @@ void SimpleCorruption(const std::string& origDevName,
         // write some random blocks
         logger.Info("- Fill some random blocks");
         ptrGen->IncSequence();
-        FillRandomBlocks(ptrGen, ptrOrininal, 2);
+        FillRandomBlocks(ptrGen, ptrOrininal, *ptrWorkload, 2);
 #endif
         logger.Info("- Check image corruption");
 
@@ -373,6 +360,7 @@ void CheckCorruption(const std::string& origDevName,
 
     logger.Info("-- Fill original device collection by test pattern");
     FillAll(ptrGen, ptrOrininal);
+    auto ptrWorkload = CreateWorkload(ptrOrininal);
 
     std::vector<std::string> devices;
     devices.push_back(origDevName);
@@ -440,7 +428,8 @@ void CheckCorruption(const std::string& origDevName,
         {
             logger.Info("- Fill some random blocks");
             ptrGen->IncSequence();
-            FillRandomBlocks(ptrGen, ptrOrininal, std::rand() / static_cast<int>((RAND_MAX + 1ull) / blocksCountMax));
+            FillRandomBlocks(ptrGen, ptrOrininal, *ptrWorkload,
+                             static_cast<int>(CRandomHelper::Uniform(blocksCountMax)));
 
             // Rewrite first sector again
             FillBlocks(ptrGen, ptrOrininal, 0, g_blksz);
@@ -502,12 +491,14 @@ struct SGeneratorContext
     std::list<std::string> errorMessages;
     std::shared_ptr<CBlockDevice> ptrBdev;
     std::shared_ptr<CTestSectorGenetor> ptrGen;
+    unsigned int stream;
 
     SGeneratorContext(const std::shared_ptr<CBlockDevice>& in_ptrBdev,
-                      const std::shared_ptr<CTestSectorGenetor>& in_ptrGen)
+                      const std::shared_ptr<CTestSectorGenetor>& in_ptrGen, const unsigned int in_stream)
         : stop(false)
         , ptrBdev(in_ptrBdev)
-        , ptrGen(in_ptrGen){};
+        , ptrGen(in_ptrGen)
+        , stream(in_stream){};
 };
 
 void GeneratorThreadFunction(std::shared_ptr<SGeneratorContext> ptrCtx)
@@ -515,10 +506,12 @@ void GeneratorThreadFunction(std::shared_ptr<SGeneratorContext> ptrCtx)
     try
     {
         logger.Info("- Start writing to device [" + ptrCtx->ptrBdev->Name() + "].");
+        CRandomHelper::SetStream(ptrCtx->stream);
+        auto ptrWorkload = CreateWorkload(ptrCtx->ptrBdev);
         while (!ptrCtx->stop)
         {
-            FillRandomBlocks(ptrCtx->ptrGen, ptrCtx->ptrBdev, std::rand() & 0x3F);
-            std::this_thread::sleep_for(std::chrono::milliseconds(std::rand() & 0x1FF));
+            FillRandomBlocks(ptrCtx->ptrGen, ptrCtx->ptrBdev, *ptrWorkload, CRandomHelper::Uniform(0x40));
+            std::this_thread::sleep_for(std::chrono::milliseconds(CRandomHelper::Uniform(0x200)));
         }
         logger.Info("- Stop writing to device [" + ptrCtx->ptrBdev->Name() + "].");
     }
@@ -620,7 +613,8 @@ void MultithreadCheckCorruption(const std::vector<std::string>& origDevNames, co
 
     for (const std::string& origDevName : origDevNames)
         genCtxs.push_back(
-          std::make_shared<SGeneratorContext>(std::make_shared<CBlockDevice>(origDevName, true), genMap[origDevName]));
+          std::make_shared<SGeneratorContext>(std::make_shared<CBlockDevice>(origDevName, true), genMap[origDevName],
+                                              genCtxs.size() + 1));
 
     // Initiate block device content for each original device
     logger.Info("-- Fill original device collection by test pattern");
@@ -826,7 +820,15 @@ void Main(int argc, char* argv[])
         ("duration,u", po::value<int>()->default_value(5), "The test duration limit in minutes.")
         ("sync", "Use O_SYNC for access to original device.")
         ("blksz", po::value<int>()->default_value(512), "Align reads and writes to the block size.")
+        ("check_threads", po::value<unsigned int>()->default_value(0),
+            "The number of threads that check the snapshot image. By default, it is equal to the number of CPUs.")
         ("blocks", po::value<int>()->default_value(4096), "The maximum limit of writing blocks.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to replay a failed run.")
+        ("distribution", po::value<std::string>()->default_value("uniform"),
+            "The distribution of random writes: 'uniform', 'zipf' or 'sequential'.")
+        ("zipf_theta", po::value<double>()->default_value(0.99), "The skew of the zipf distribution.")
+        ("burst", po::value<unsigned long long>()->default_value(64),
+            "The number of consecutive blocks in the sequential distribution.")
         ;
     po::variables_map vm;
     po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
@@ -885,10 +887,20 @@ void Main(int argc, char* argv[])
     g_blksz = vm["blksz"].as<int>();
     logger.Info("blksz: " + std::to_string(g_blksz));
 
+    g_checkThreads = vm["check_threads"].as<unsigned int>();
+    logger.Info("check_threads: " + std::to_string(g_checkThreads));
+
     int blocksCountMax = vm["blocks"].as<int>();
     logger.Info("blocks: " + std::to_string(blocksCountMax));
 
-    std::srand(std::time(0));
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+
+    g_workloadParams.distribution = CWorkload::ParseDistribution(vm["distribution"].as<std::string>());
+    g_workloadParams.theta = vm["zipf_theta"].as<double>();
+    g_workloadParams.burst = vm["burst"].as<unsigned long long>();
+    logger.Info(std::string("distribution: ") + CWorkload::Name(g_workloadParams.distribution));
+
     if (!!vm.count("multithread"))
         MultithreadCheckCorruption(origDevNames, diffStorage,
                                    diffStorageLimit, duration * 60);
@@ -918,6 +930,7 @@ int main(int argc, char* argv[])
     catch (std::exception& ex)
     {
         logger.Err(ex.what());
+        logger.Err("To replay the run, use --seed " + std::to_string(CRandomHelper::Seed()));
         return 1;
     }
 #endif
@@ -35,11 +35,10 @@ void GenerateRangeMap(std::vector<SRange>& availableRanges, std::vector<SRange>&
     const int granularity, const sector_t deviceSize)
 {
     std::vector<sector_t> clip;
-    double scaling =static_cast<double>(deviceSize) / (RAND_MAX + 1ul);
 
     for (int inx=0; inx<granularity; inx++)
     {
-        sector_t sector = static_cast<sector_t>(std::rand() * scaling) & ~sector_mask;
+        sector_t sector = static_cast<sector_t>(CRandomHelper::Uniform(deviceSize)) & ~sector_mask;
 
         if ((sector == 0) || (sector > deviceSize))
             continue;
@@ -58,7 +57,7 @@ void GenerateRangeMap(std::vector<SRange>& availableRanges, std::vector<SRange>&
         if (clipSize <= 16)
             continue;
 
-        int diffStoreRangeSize = (page_sectors + std::rand() / static_cast<int>((RAND_MAX + 1ull) / (clipSize >> 1))) & ~sector_mask;
+        int diffStoreRangeSize = (page_sectors + CRandomHelper::Uniform(clipSize >> 1)) & ~sector_mask;
 
         availableRanges.emplace_back(prevOffset, clipSize - diffStoreRangeSize);
         diffStorageRanges.emplace_back(currentOffset - diffStoreRangeSize, diffStoreRangeSize);
@@ -193,8 +192,6 @@ static void GenerateRandomRanges(std::shared_ptr<CBlockDevice> ptrOrininal,
                                  const int granularity, const int blockSizeLimit)
 {
     sector_t deviceSize = ptrOrininal->Size() >> SECTOR_SHIFT;
-    double offsetScaling = static_cast<double>(deviceSize) / (RAND_MAX + 1ul);
-    int blockSizeScaling = static_cast<unsigned int>((RAND_MAX + 1ul) / (blockSizeLimit - (g_blksz >> SECTOR_SHIFT)));
     unsigned long long blockSizeMask = ~(static_cast<unsigned long long>((g_blksz >> SECTOR_SHIFT)) - 1ull);
 
     logger.Info("Write block list generating with granularity=" + std::to_string(granularity) +
@@ -204,8 +201,8 @@ static void GenerateRandomRanges(std::shared_ptr<CBlockDevice> ptrOrininal,
     {
         SRange rg;
 
-        rg.sector = static_cast<sector_t>(std::rand() * offsetScaling) & blockSizeMask;
-        rg.count = (page_sectors + std::rand() / blockSizeScaling) & blockSizeMask;
+        rg.sector = static_cast<sector_t>(CRandomHelper::Uniform(deviceSize)) & blockSizeMask;
+        rg.count = (page_sectors + CRandomHelper::Uniform(blockSizeLimit - (g_blksz >> SECTOR_SHIFT))) & blockSizeMask;
 
         if (!NormalizeRange(availableRanges, rg))
             continue;
@@ -374,7 +371,8 @@ void Main(int argc, char* argv[])
         ("device,d", po::value<std::string>(), "Device name. ")
         ("duration,u", po::value<int>()->default_value(5), "The test duration limit in minutes.")
         ("sync", "Use O_SYNC for access to original device.")
-        ("blksz", po::value<int>()->default_value(512), "Align reads and writes to the block size.");
+        ("blksz", po::value<int>()->default_value(512), "Align reads and writes to the block size.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to replay a failed run.");
     po::variables_map vm;
     po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
     po::store(parsed, vm);
@@ -413,7 +411,9 @@ void Main(int argc, char* argv[])
     page_sectors = getpagesize() / 512;
     sector_mask = page_sectors - 1;
 
-    std::srand(std::time(0));
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+
     CheckDiffStorage(origDevName, duration * 60, isSync);
 }
 
@@ -0,0 +1,1169 @@
+// SPDX-License-Identifier: GPL-2.0+
+#define FUSE_USE_VERSION 31
+
+#include <algorithm>
+#include <atomic>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cuse_lowlevel.h>
+#include <errno.h>
+#include <fuse_lowlevel.h>
+#include <iostream>
+#include <limits.h>
+#include <linux/blk-filter.h>
+#include <linux/blksnap.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "helpers/Log.h"
+#include "model/Snapshot.h"
+
+namespace po = boost::program_options;
+using blksnap::sector_t;
+
+/*
+ * The fake of the blksnap module for testing the libblksnap library without
+ * the module. The control device /dev/blksnap-control and the devices that
+ * stand in for the original block devices are created by CUSE. The ioctls
+ * are processed by the userspace model of the module.
+ *
+ * The original devices are the character devices backed by the regular
+ * files. They accept the BLKFILTER_ATTACH, BLKFILTER_DETACH and BLKFILTER_CTL
+ * ioctls, and the reading and writing of data, which is tracked and copied
+ * as the module does. The snapshot images are not created, the names of the
+ * images are returned only for information.
+ *
+ * The text commands can be written to the control device:
+ *   latency <us> - the delay of each ioctl;
+ *   event <low_space|no_space|corrupted> - the event for all snapshots.
+ */
+
+static const unsigned short g_versionMajor = 2;
+
+struct SFakeDevice
+{
+    std::string name;
+    std::string path;
+    std::mutex lock;
+    std::shared_ptr<CModelTracker> ptrTracker;
+};
+
+struct SFakeSnapshot
+{
+    std::shared_ptr<CModelSnapshot> ptrSnapshot;
+    unsigned long long takeNs;
+    std::vector<struct blksnap_device_timing> timing;
+};
+
+struct SFakeState
+{
+    SFakeState()
+        : latencyUs(0)
+        , eventsOnTake(0) {};
+
+    SModelParams params;
+    std::atomic<unsigned int> latencyUs;
+    unsigned int eventsOnTake;
+
+    std::mutex lock;
+    std::map<std::string, std::shared_ptr<SFakeSnapshot>> snapshots;
+    std::vector<std::shared_ptr<SFakeDevice>> devices;
+};
+
+static SFakeState g_state;
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static inline std::string Key(const struct blksnap_uuid& id)
+{
+    return std::string(reinterpret_cast<const char*>(id.b), sizeof(id.b));
+}
+
+static std::shared_ptr<SFakeSnapshot> FindSnapshot(const struct blksnap_uuid& id)
+{
+    std::lock_guard<std::mutex> guard(g_state.lock);
+    auto it = g_state.snapshots.find(Key(id));
+
+    return (it == g_state.snapshots.end()) ? nullptr : it->second;
+}
+
+static void PushEvent(const std::shared_ptr<CModelSnapshot>& ptrSnapshot, const unsigned int code)
+{
+    switch (code)
+    {
+    case blksnap_event_code_low_space:
+    {
+        struct blksnap_event_low_space data = {0, g_state.params.diffStorageMinimum};
+
+        ptrSnapshot->Events()->Push(code, &data, sizeof(data));
+        break;
+    }
+    case blksnap_event_code_no_space:
+    {
+        struct blksnap_event_no_space data = {ptrSnapshot->DiffStorage()->GetStatistic().requested};
+
+        ptrSnapshot->Events()->Push(code, &data, sizeof(data));
+        break;
+    }
+    case blksnap_event_code_corrupted:
+    {
+        struct blksnap_event_corrupted data = {0, 0, EIO};
+
+        if (!ptrSnapshot->Trackers().empty())
+        {
+            data.dev_id_mj = ptrSnapshot->Trackers().front()->DevIdMj();
+            data.dev_id_mn = ptrSnapshot->Trackers().front()->DevIdMn();
+        }
+        ptrSnapshot->Events()->Push(code, &data, sizeof(data));
+        break;
+    }
+    }
+}
+
+/*
+ * The ioctl of the CUSE device is unrestricted. The kernel does not know the
+ * layout of the argument, so the memory regions of the caller are requested
+ * by retries. On each call the regions requested by the previous retry are
+ * passed in the input buffer one after another. The regions are added in the
+ * same order on each call, so the input buffer grows until all of them are
+ * received.
+ */
+class CIoctlArgs
+{
+public:
+    CIoctlArgs(fuse_req_t req, const void* inBuf, const size_t inSize, const size_t outSize)
+        : m_req(req)
+        , m_inBuf(static_cast<const unsigned char*>(inBuf))
+        , m_inSize(inSize)
+        , m_inOffset(0)
+        , m_outSize(outSize)
+        , m_outOffset(0) {};
+
+    /*
+     * Returns the pointer to the region if it has already been received.
+     */
+    const void* In(const uint64_t addr, const size_t size)
+    {
+        const void* ptr = ((m_inOffset + size) <= m_inSize) ? (m_inBuf + m_inOffset) : nullptr;
+
+        m_in.push_back({reinterpret_cast<void*>(addr), size});
+        m_inOffset += size;
+        return ptr;
+    };
+    template <typename T>
+    const T* In(const void* addr)
+    {
+        return static_cast<const T*>(In(reinterpret_cast<uint64_t>(addr), sizeof(T)));
+    };
+
+    void Out(const uint64_t addr, const size_t size)
+    {
+        m_out.push_back({reinterpret_cast<void*>(addr), size});
+        m_outOffset += size;
+    };
+
+    /*
+     * Returns false if the retry is requested. In this case the request is
+     * completed and the handler should return.
+     */
+    bool Ready()
+    {
+        if ((m_inOffset <= m_inSize) && (m_outOffset <= m_outSize))
+            return true;
+
+        fuse_reply_ioctl_retry(m_req, m_in.data(), m_in.size(), m_out.data(), m_out.size());
+        return false;
+    };
+
+    /*
+     * The string is requested by the parts that do not cross the page
+     * boundary, so the region after the end of the string is not accessed.
+     * Returns false if the retry is requested or the error is replied.
+     */
+    bool InString(uint64_t addr, std::string& str)
+    {
+        const uint64_t pageSize = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+
+        str.clear();
+        while (str.size() < PATH_MAX)
+        {
+            const size_t size = static_cast<size_t>(pageSize - (addr & (pageSize - 1)));
+            const char* ptr = static_cast<const char*>(In(addr, size));
+
+            if (!ptr)
+                return Ready();
+
+            size_t len = strnlen(ptr, size);
+            str.append(ptr, len);
+            if (len < size)
+                return true;
+            addr += size;
+        }
+        Error(ENAMETOOLONG);
+        return false;
+    };
+
+    void Reply(const int result, const std::vector<struct iovec>& data)
+    {
+        Delay();
+        fuse_reply_ioctl_iov(m_req, result, data.data(), static_cast<int>(data.size()));
+    };
+    void Reply(const int result)
+    {
+        Delay();
+        fuse_reply_ioctl(m_req, result, nullptr, 0);
+    };
+    void Error(const int err)
+    {
+        Delay();
+        fuse_reply_err(m_req, std::abs(err));
+    };
+
+private:
+    fuse_req_t m_req;
+    const unsigned char* m_inBuf;
+    size_t m_inSize;
+    size_t m_inOffset;
+    size_t m_outSize;
+    size_t m_outOffset;
+    std::vector<struct iovec> m_in;
+    std::vector<struct iovec> m_out;
+
+    static void Delay()
+    {
+        unsigned int latencyUs = g_state.latencyUs;
+
+        if (latencyUs)
+            std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+    };
+};
+
+static inline struct iovec Iov(const void* ptr, const size_t size)
+{
+    return {const_cast<void*>(ptr), size};
+}
+
+static void IoctlVersion(CIoctlArgs& args, void* arg)
+{
+    struct blksnap_version version = {g_versionMajor, 0, 0, 0};
+
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(version));
+    if (!args.Ready())
+        return;
+
+    args.Reply(0, {Iov(&version, sizeof(version))});
+}
+
+static void IoctlSnapshotCreate(CIoctlArgs& args, void* arg)
+{
+    auto param = args.In<struct blksnap_snapshot_create>(arg);
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(struct blksnap_snapshot_create));
+    if (!args.Ready())
+        return;
+
+    std::string filename;
+    if (!args.InString(param->diff_storage_filename, filename))
+        return;
+
+    auto ptrSnapshot = std::make_shared<SFakeSnapshot>();
+    ptrSnapshot->ptrSnapshot = std::make_shared<CModelSnapshot>(g_state.params);
+    ptrSnapshot->takeNs = 0;
+
+    int ret = ptrSnapshot->ptrSnapshot->SetDiffStorage(filename, param->diff_storage_limit_sect);
+    if (ret)
+    {
+        logger.Err("Failed to set difference storage [" + filename + "], error " + std::to_string(ret));
+        args.Error(ret);
+        return;
+    }
+
+    struct blksnap_snapshot_create result = *param;
+    uuid_copy(result.id.b, ptrSnapshot->ptrSnapshot->Id());
+    {
+        std::lock_guard<std::mutex> guard(g_state.lock);
+        g_state.snapshots[Key(result.id)] = ptrSnapshot;
+    }
+    logger.Info("Snapshot created, difference storage [" + filename + "]");
+    args.Reply(0, {Iov(&result, sizeof(result))});
+}
+
+static void IoctlSnapshotDestroy(CIoctlArgs& args, void* arg)
+{
+    auto id = args.In<struct blksnap_uuid>(arg);
+    if (!args.Ready())
+        return;
+
+    std::shared_ptr<SFakeSnapshot> ptrSnapshot;
+    {
+        std::lock_guard<std::mutex> guard(g_state.lock);
+        auto it = g_state.snapshots.find(Key(*id));
+
+        if (it != g_state.snapshots.end())
+        {
+            ptrSnapshot = it->second;
+            g_state.snapshots.erase(it);
+        }
+    }
+    if (!ptrSnapshot)
+    {
+        args.Error(ENODEV);
+        return;
+    }
+
+    ptrSnapshot->ptrSnapshot->Destroy();
+    logger.Info("Snapshot destroyed");
+    args.Reply(0);
+}
+
+static void IoctlSnapshotTake(CIoctlArgs& args, void* arg)
+{
+    auto id = args.In<struct blksnap_uuid>(arg);
+    if (!args.Ready())
+        return;
+
+    auto ptrSnapshot = FindSnapshot(*id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    const uint64_t startNs = NowNs();
+    int ret = ptrSnapshot->ptrSnapshot->Take();
+    if (ret)
+    {
+        args.Error(ret);
+        return;
+    }
+    ptrSnapshot->takeNs = NowNs() - startNs;
+
+    /*
+     * There is no file system to freeze, so all the time is spent on the
+     * switching.
+     */
+    const auto& trackers = ptrSnapshot->ptrSnapshot->Trackers();
+    ptrSnapshot->timing.clear();
+    for (const auto& ptrTracker : trackers)
+        ptrSnapshot->timing.push_back(
+            {ptrTracker->DevIdMj(), ptrTracker->DevIdMn(), 0, ptrSnapshot->takeNs / trackers.size(), 0});
+
+    for (unsigned int inx = 0; inx < g_state.eventsOnTake; inx++)
+        PushEvent(ptrSnapshot->ptrSnapshot, blksnap_event_code_low_space);
+
+    logger.Info("Snapshot taken");
+    args.Reply(0);
+}
+
+static void IoctlSnapshotCollect(CIoctlArgs& args, void* arg)
+{
+    auto param = args.In<struct blksnap_snapshot_collect>(arg);
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(struct blksnap_snapshot_collect));
+    if (!args.Ready())
+        return;
+
+    std::vector<struct blksnap_uuid> ids;
+    {
+        std::lock_guard<std::mutex> guard(g_state.lock);
+
+        for (const auto& it : g_state.snapshots)
+        {
+            struct blksnap_uuid id;
+
+            memcpy(id.b, it.first.data(), sizeof(id.b));
+            ids.push_back(id);
+        }
+    }
+
+    struct blksnap_snapshot_collect result = *param;
+    result.count = static_cast<__u32>(ids.size());
+    if (!param->ids || ids.empty())
+    {
+        args.Reply(0, {Iov(&result, sizeof(result))});
+        return;
+    }
+    if (param->count < ids.size())
+    {
+        args.Error(ENODATA);
+        return;
+    }
+
+    args.Out(param->ids, ids.size() * sizeof(struct blksnap_uuid));
+    if (!args.Ready())
+        return;
+    args.Reply(0, {Iov(&result, sizeof(result)), Iov(ids.data(), ids.size() * sizeof(struct blksnap_uuid))});
+}
+
+static void IoctlSnapshotWaitEvent(CIoctlArgs& args, void* arg)
+{
+    const size_t headerSize = sizeof(struct blksnap_uuid) + sizeof(__u32);
+    auto header = static_cast<const unsigned char*>(args.In(reinterpret_cast<uint64_t>(arg), headerSize));
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(struct blksnap_snapshot_event));
+    if (!args.Ready())
+        return;
+
+    std::unique_ptr<struct blksnap_snapshot_event> result(new struct blksnap_snapshot_event);
+    memset(result.get(), 0, sizeof(struct blksnap_snapshot_event));
+    memcpy(result.get(), header, headerSize);
+
+    auto ptrSnapshot = FindSnapshot(result->id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    SModelEvent ev;
+    int ret = ptrSnapshot->ptrSnapshot->WaitEvent(ev, result->timeout_ms);
+    if (ret)
+    {
+        args.Error(ret);
+        return;
+    }
+
+    result->code = ev.code;
+    result->time_label = ev.time;
+    memcpy(result->data, ev.data.data(), std::min(ev.data.size(), sizeof(result->data)));
+    args.Reply(0, {Iov(result.get(), sizeof(struct blksnap_snapshot_event))});
+}
+
+static void IoctlSnapshotTiming(CIoctlArgs& args, void* arg)
+{
+    auto param = args.In<struct blksnap_snapshot_timing>(arg);
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(struct blksnap_snapshot_timing));
+    if (!args.Ready())
+        return;
+
+    auto ptrSnapshot = FindSnapshot(param->id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    struct blksnap_snapshot_timing result = *param;
+    const size_t size = ptrSnapshot->timing.size() * sizeof(struct blksnap_device_timing);
+    result.take_ns = ptrSnapshot->takeNs;
+    result.frozen_ns = 0;
+    result.count = static_cast<__u32>(ptrSnapshot->timing.size());
+    if (!param->devices || !size)
+    {
+        args.Reply(0, {Iov(&result, sizeof(result))});
+        return;
+    }
+    if (param->count < ptrSnapshot->timing.size())
+    {
+        args.Error(ENODATA);
+        return;
+    }
+
+    args.Out(param->devices, size);
+    if (!args.Ready())
+        return;
+    args.Reply(0, {Iov(&result, sizeof(result)), Iov(ptrSnapshot->timing.data(), size)});
+}
+
+static void IoctlSnapshotAppendStorage(CIoctlArgs& args, void* arg)
+{
+    auto param = args.In<struct blksnap_snapshot_append_storage>(arg);
+    if (!args.Ready())
+        return;
+
+    std::string devpath;
+    if (!args.InString(param->devpath, devpath))
+        return;
+
+    auto ptrSnapshot = FindSnapshot(param->id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    int ret = ptrSnapshot->ptrSnapshot->AppendStorage(devpath);
+    if (ret)
+        args.Error(ret);
+    else
+        args.Reply(0);
+}
+
+static void IoctlSnapshotStats(CIoctlArgs& args, void* arg)
+{
+    auto param = args.In<struct blksnap_snapshot_stats>(arg);
+    args.Out(reinterpret_cast<uint64_t>(arg), sizeof(struct blksnap_snapshot_stats));
+    if (!args.Ready())
+        return;
+
+    auto ptrSnapshot = FindSnapshot(param->id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    const auto storageStat = ptrSnapshot->ptrSnapshot->DiffStorage()->GetStatistic();
+    const auto& trackers = ptrSnapshot->ptrSnapshot->Trackers();
+    struct blksnap_snapshot_stats result = *param;
+    result.capacity_sect = storageStat.capacity;
+    result.limit_sect = storageStat.limit;
+    result.filled_sect = storageStat.filled;
+    result.requested_sect = storageStat.requested;
+    result.reallocate_count = storageStat.reallocations;
+    result.reallocate_ns = 0;
+    result.count = static_cast<__u32>(trackers.size());
+    if (!param->devices || trackers.empty())
+    {
+        args.Reply(0, {Iov(&result, sizeof(result))});
+        return;
+    }
+    if (param->count < trackers.size())
+    {
+        args.Error(ENODATA);
+        return;
+    }
+
+    /*
+     * The model does not keep the chunks that have not been loaded, and the
+     * number of the copied sectors is calculated from the number of the
+     * copied chunks.
+     */
+    std::vector<struct blksnap_device_stats> devices(trackers.size());
+    for (size_t inx = 0; inx < trackers.size(); inx++)
+    {
+        struct blksnap_device_stats& stats = devices[inx];
+        auto ptrDiffArea = trackers[inx]->DiffArea();
+
+        memset(&stats, 0, sizeof(stats));
+        stats.dev_id_mj = trackers[inx]->DevIdMj();
+        stats.dev_id_mn = trackers[inx]->DevIdMn();
+        if (!ptrDiffArea)
+            continue;
+
+        const auto stat = ptrDiffArea->GetStatistic();
+        stats.chunk_size = 1ULL << ptrDiffArea->ChunkShift();
+        stats.chunk_count = ptrDiffArea->ChunkCount();
+        stats.chunk_in_memory = stat.chunksInMemory;
+        stats.chunk_stored = stat.chunksStored;
+        stats.chunk_failed = stat.chunksFailed;
+        stats.copied_sect = stat.chunksCopied << (ptrDiffArea->ChunkShift() - SECTOR_SHIFT);
+        stats.image_redirected_sect = stat.imageUntouchedSectors;
+        stats.image_memory_sect = stat.imageInMemorySectors;
+        stats.image_stored_sect = stat.imageStoredSectors;
+    }
+
+    const size_t size = devices.size() * sizeof(struct blksnap_device_stats);
+    args.Out(param->devices, size);
+    if (!args.Ready())
+        return;
+    args.Reply(0, {Iov(&result, sizeof(result)), Iov(devices.data(), size)});
+}
+
+static void ControlIoctl(fuse_req_t req, int cmd, void* arg, struct fuse_file_info* fi, unsigned int flags,
+                         const void* inBuf, size_t inSize, size_t outSize)
+{
+    CIoctlArgs args(req, inBuf, inSize, outSize);
+
+    (void)fi;
+    if (flags & FUSE_IOCTL_COMPAT)
+    {
+        args.Error(ENOSYS);
+        return;
+    }
+
+    switch (static_cast<unsigned int>(cmd))
+    {
+    case IOCTL_BLKSNAP_VERSION:
+        IoctlVersion(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_CREATE:
+        IoctlSnapshotCreate(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_DESTROY:
+        IoctlSnapshotDestroy(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_TAKE:
+        IoctlSnapshotTake(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_COLLECT:
+        IoctlSnapshotCollect(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_WAIT_EVENT:
+        IoctlSnapshotWaitEvent(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_TIMING:
+        IoctlSnapshotTiming(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE:
+        IoctlSnapshotAppendStorage(args, arg);
+        break;
+    case IOCTL_BLKSNAP_SNAPSHOT_STATS:
+        IoctlSnapshotStats(args, arg);
+        break;
+    default:
+        args.Error(ENOTTY);
+    }
+}
+
+static void ControlOpen(fuse_req_t req, struct fuse_file_info* fi)
+{
+    fuse_reply_open(req, fi);
+}
+
+/*
+ * The commands are accepted only by one write.
+ */
+static void ControlWrite(fuse_req_t req, const char* buf, size_t size, off_t off, struct fuse_file_info* fi)
+{
+    std::stringstream ss(std::string(buf, size));
+    std::string command;
+    std::string value;
+
+    (void)off;
+    (void)fi;
+    ss >> command >> value;
+    if (command == "latency")
+    {
+        try
+        {
+            g_state.latencyUs = static_cast<unsigned int>(std::stoul(value));
+        }
+        catch (std::exception&)
+        {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+    }
+    else if (command == "event")
+    {
+        const std::map<std::string, unsigned int> codes = {
+            {"corrupted", blksnap_event_code_corrupted},
+            {"no_space", blksnap_event_code_no_space},
+            {"low_space", blksnap_event_code_low_space},
+        };
+        auto it = codes.find(value);
+        if (it == codes.end())
+        {
+            fuse_reply_err(req, EINVAL);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(g_state.lock);
+        for (const auto& snapshot : g_state.snapshots)
+            PushEvent(snapshot.second->ptrSnapshot, it->second);
+    }
+    else
+    {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+
+    logger.Info("Command: " + command + " " + value);
+    fuse_reply_write(req, size);
+}
+
+static std::shared_ptr<CModelTracker> Tracker(SFakeDevice* dev)
+{
+    std::lock_guard<std::mutex> guard(dev->lock);
+
+    return dev->ptrTracker;
+}
+
+static int FilterAttach(SFakeDevice* dev)
+{
+    std::lock_guard<std::mutex> guard(dev->lock);
+    struct stat st;
+
+    if (dev->ptrTracker)
+        return -EALREADY;
+    if (::stat(("/dev/" + dev->name).c_str(), &st))
+        return -errno;
+
+    dev->ptrTracker = std::make_shared<CModelTracker>(g_state.params, dev->path, major(st.st_rdev),
+                                                      minor(st.st_rdev));
+    logger.Info("Tracker attached to [" + dev->name + "]");
+    return 0;
+}
+
+static int FilterDetach(SFakeDevice* dev)
+{
+    std::lock_guard<std::mutex> guard(dev->lock);
+
+    if (!dev->ptrTracker)
+        return -ENOENT;
+    if (dev->ptrTracker->DiffArea())
+        return -EBUSY;
+
+    dev->ptrTracker.reset();
+    logger.Info("Tracker detached from [" + dev->name + "]");
+    return 0;
+}
+
+static void CtlCbtInfo(CIoctlArgs& args, const std::shared_ptr<CModelTracker>& ptrTracker,
+                       const struct blkfilter_ctl* ctl)
+{
+    struct blksnap_cbtinfo result;
+    auto ptrCbtMap = ptrTracker->CbtMap();
+
+    if (ctl->optlen < sizeof(result))
+    {
+        args.Error(EINVAL);
+        return;
+    }
+    args.Out(ctl->opt, sizeof(result));
+    if (!args.Ready())
+        return;
+
+    memset(&result, 0, sizeof(result));
+    result.device_capacity = ptrCbtMap->Capacity() << SECTOR_SHIFT;
+    result.block_size = 1U << ptrCbtMap->BlockSizeShift();
+    result.block_count = static_cast<__u32>(ptrCbtMap->BlockCount());
+    uuid_copy(result.generation_id.b, ptrCbtMap->GenerationId());
+    result.changes_number = static_cast<__u8>(ptrCbtMap->SnapNumberPrevious());
+    args.Reply(0, {Iov(&result, sizeof(result))});
+}
+
+static void CtlCbtMap(CIoctlArgs& args, const std::shared_ptr<CModelTracker>& ptrTracker,
+                      const struct blkfilter_ctl* ctl)
+{
+    if (ctl->optlen < sizeof(struct blksnap_cbtmap))
+    {
+        args.Error(EINVAL);
+        return;
+    }
+    auto param = static_cast<const struct blksnap_cbtmap*>(args.In(ctl->opt, sizeof(struct blksnap_cbtmap)));
+    if (!args.Ready())
+        return;
+
+    auto ptrCbtMap = ptrTracker->CbtMap();
+    if (ptrCbtMap->IsCorrupted())
+    {
+        args.Error(EFAULT);
+        return;
+    }
+    if ((param->offset > ptrCbtMap->BlockCount()) || (param->length > (ptrCbtMap->BlockCount() - param->offset)))
+    {
+        args.Error(ENODATA);
+        return;
+    }
+    if (!param->length)
+    {
+        args.Reply(0);
+        return;
+    }
+
+    args.Out(param->buffer, param->length);
+    if (!args.Ready())
+        return;
+
+    std::vector<unsigned char> buf(param->length);
+    ptrCbtMap->Read(param->offset, param->length, buf.data());
+    args.Reply(0, {Iov(buf.data(), buf.size())});
+}
+
+static void CtlCbtDirty(CIoctlArgs& args, const std::shared_ptr<CModelTracker>& ptrTracker,
+                        const struct blkfilter_ctl* ctl)
+{
+    if (ctl->optlen < sizeof(struct blksnap_cbtdirty))
+    {
+        args.Error(EINVAL);
+        return;
+    }
+    auto param = static_cast<const struct blksnap_cbtdirty*>(args.In(ctl->opt, sizeof(struct blksnap_cbtdirty)));
+    if (!args.Ready())
+        return;
+
+    auto ranges = static_cast<const struct blksnap_sectors*>(
+        args.In(param->dirty_sectors, param->count * sizeof(struct blksnap_sectors)));
+    if (!args.Ready())
+        return;
+
+    for (unsigned int inx = 0; inx < param->count; inx++)
+    {
+        int ret = ptrTracker->MarkDirty(ranges[inx].offset, ranges[inx].count);
+
+        if (ret)
+        {
+            args.Error(ret);
+            return;
+        }
+    }
+    args.Reply(0);
+}
+
+static void CtlSnapshotAdd(CIoctlArgs& args, const std::shared_ptr<CModelTracker>& ptrTracker,
+                           const struct blkfilter_ctl* ctl)
+{
+    if (ctl->optlen < sizeof(struct blksnap_snapshotadd))
+    {
+        args.Error(EINVAL);
+        return;
+    }
+    auto param =
+        static_cast<const struct blksnap_snapshotadd*>(args.In(ctl->opt, sizeof(struct blksnap_snapshotadd)));
+    if (!args.Ready())
+        return;
+
+    auto ptrSnapshot = FindSnapshot(param->id);
+    if (!ptrSnapshot)
+    {
+        args.Error(ESRCH);
+        return;
+    }
+
+    int ret = ptrSnapshot->ptrSnapshot->AddDevice(ptrTracker);
+    if (ret)
+        args.Error(ret);
+    else
+        args.Reply(0);
+}
+
+static void CtlSnapshotInfo(CIoctlArgs& args, const std::shared_ptr<CModelTracker>& ptrTracker,
+                            const struct blkfilter_ctl* ctl)
+{
+    struct blksnap_snapshotinfo result;
+
+    if (ctl->optlen < sizeof(result))
+    {
+        args.Error(EINVAL);
+        return;
+    }
+    args.Out(ctl->opt, sizeof(result));
+    if (!args.Ready())
+        return;
+
+    memset(&result, 0, sizeof(result));
+    auto ptrDiffArea = ptrTracker->DiffArea();
+    if (ptrDiffArea)
+    {
+        if (ptrDiffArea->IsCorrupted())
+            result.error_code = ptrDiffArea->ErrorCode();
+        snprintf(reinterpret_cast<char*>(result.image), IMAGE_DISK_NAME_LEN, "%s-%u-%u", BLKSNAP_IMAGE_NAME,
+                 ptrTracker->DevIdMj(), ptrTracker->DevIdMn());
+    }
+    args.Reply(0, {Iov(&result, sizeof(result))});
+}
+
+static void FilterCtl(CIoctlArgs& args, SFakeDevice* dev, void* arg)
+{
+    auto ctl = args.In<struct blkfilter_ctl>(arg);
+    if (!args.Ready())
+        return;
+
+    if (strncmp(reinterpret_cast<const char*>(ctl->name), "blksnap", BLKFILTER_NAME_LENGTH))
+    {
+        args.Error(ENOENT);
+        return;
+    }
+    auto ptrTracker = Tracker(dev);
+    if (!ptrTracker)
+    {
+        args.Error(ENOENT);
+        return;
+    }
+
+    switch (ctl->cmd)
+    {
+    case BLKFILTER_CTL_BLKSNAP_CBTINFO:
+        CtlCbtInfo(args, ptrTracker, ctl);
+        break;
+    case BLKFILTER_CTL_BLKSNAP_CBTMAP:
+        CtlCbtMap(args, ptrTracker, ctl);
+        break;
+    case BLKFILTER_CTL_BLKSNAP_CBTDIRTY:
+        CtlCbtDirty(args, ptrTracker, ctl);
+        break;
+    case BLKFILTER_CTL_BLKSNAP_SNAPSHOTADD:
+        CtlSnapshotAdd(args, ptrTracker, ctl);
+        break;
+    case BLKFILTER_CTL_BLKSNAP_SNAPSHOTINFO:
+        CtlSnapshotInfo(args, ptrTracker, ctl);
+        break;
+    default:
+        args.Error(ENOTTY);
+    }
+}
+
+static void DeviceIoctl(fuse_req_t req, int cmd, void* arg, struct fuse_file_info* fi, unsigned int flags,
+                        const void* inBuf, size_t inSize, size_t outSize)
+{
+    SFakeDevice* dev = static_cast<SFakeDevice*>(fuse_req_userdata(req));
+    CIoctlArgs args(req, inBuf, inSize, outSize);
+
+    (void)fi;
+    if (flags & FUSE_IOCTL_COMPAT)
+    {
+        args.Error(ENOSYS);
+        return;
+    }
+
+    switch (static_cast<unsigned int>(cmd))
+    {
+    case BLKFILTER_ATTACH:
+    {
+        auto param = args.In<struct blkfilter_attach>(arg);
+        if (!args.Ready())
+            return;
+        if (strncmp(reinterpret_cast<const char*>(param->name), "blksnap", BLKFILTER_NAME_LENGTH))
+        {
+            args.Error(ENOENT);
+            return;
+        }
+
+        int ret = FilterAttach(dev);
+        if (ret)
+            args.Error(ret);
+        else
+            args.Reply(0);
+        break;
+    }
+    case BLKFILTER_DETACH:
+    {
+        auto param = args.In<struct blkfilter_detach>(arg);
+        if (!args.Ready())
+            return;
+        if (strncmp(reinterpret_cast<const char*>(param->name), "blksnap", BLKFILTER_NAME_LENGTH))
+        {
+            args.Error(ENOENT);
+            return;
+        }
+
+        int ret = FilterDetach(dev);
+        if (ret)
+            args.Error(ret);
+        else
+            args.Reply(0);
+        break;
+    }
+    case BLKFILTER_CTL:
+        FilterCtl(args, dev, arg);
+        break;
+    default:
+        args.Error(ENOTTY);
+    }
+}
+
+static void DeviceOpen(fuse_req_t req, struct fuse_file_info* fi)
+{
+    fi->direct_io = 1;
+    fuse_reply_open(req, fi);
+}
+
+/*
+ * The data is read and written by sectors. The writing is tracked if the
+ * filter is attached.
+ */
+static void DeviceRead(fuse_req_t req, size_t size, off_t off, struct fuse_file_info* fi)
+{
+    SFakeDevice* dev = static_cast<SFakeDevice*>(fuse_req_userdata(req));
+    auto ptrTracker = Tracker(dev);
+
+    (void)fi;
+    if ((size | static_cast<size_t>(off)) & (SECTOR_SIZE - 1))
+    {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+
+    CModelFile file(dev->path, false);
+    const sector_t capacity = file.Size();
+    const sector_t sector = static_cast<sector_t>(off) >> SECTOR_SHIFT;
+    if (sector >= capacity)
+    {
+        fuse_reply_buf(req, nullptr, 0);
+        return;
+    }
+
+    std::vector<char> buf(std::min(size, static_cast<size_t>((capacity - sector) << SECTOR_SHIFT)));
+    int ret = ptrTracker ? ptrTracker->Read(buf.data(), sector, buf.size() >> SECTOR_SHIFT)
+                         : file.Read(buf.data(), buf.size(), sector);
+    if (ret)
+        fuse_reply_err(req, std::abs(ret));
+    else
+        fuse_reply_buf(req, buf.data(), buf.size());
+}
+
+static void DeviceWrite(fuse_req_t req, const char* buf, size_t size, off_t off, struct fuse_file_info* fi)
+{
+    SFakeDevice* dev = static_cast<SFakeDevice*>(fuse_req_userdata(req));
+    auto ptrTracker = Tracker(dev);
+
+    (void)fi;
+    if ((size | static_cast<size_t>(off)) & (SECTOR_SIZE - 1))
+    {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+
+    CModelFile file(dev->path, false);
+    const sector_t sector = static_cast<sector_t>(off) >> SECTOR_SHIFT;
+    if ((sector + (size >> SECTOR_SHIFT)) > file.Size())
+    {
+        fuse_reply_err(req, ENOSPC);
+        return;
+    }
+
+    int ret = ptrTracker ? ptrTracker->Write(buf, sector, size >> SECTOR_SHIFT) : file.Write(buf, size, sector);
+    if (ret)
+        fuse_reply_err(req, std::abs(ret));
+    else
+        fuse_reply_write(req, size);
+}
+
+static struct fuse_session* Setup(const std::string& devName, const struct cuse_lowlevel_ops* ops, void* userdata,
+                                  const bool debug)
+{
+    std::string devInfo = "DEVNAME=" + devName;
+    const char* devInfoArgv[] = {devInfo.c_str()};
+    struct cuse_info ci;
+
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = devInfoArgv;
+    ci.flags = CUSE_UNRESTRICTED_IOCTL;
+
+    std::vector<std::string> args = {"fake_control", "-f"};
+    if (debug)
+        args.push_back("-d");
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    int multithreaded;
+    struct fuse_session* se =
+        cuse_lowlevel_setup(static_cast<int>(args.size()), argv.data(), &ci, ops, &multithreaded, userdata);
+    if (!se)
+        throw std::runtime_error("Failed to create CUSE device [" + devName + "]");
+    return se;
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string(
+        "The fake of the blksnap module. It creates the control device and the devices that stand in for the "
+        "original block devices by CUSE, and processes their ioctls by the userspace model of the module.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("control,c", po::value<std::string>()->default_value(BLKSNAP_CTL), "The name of the control device.")
+        ("device,d", po::value<std::vector<std::string>>()->multitoken(),
+            "The original devices in the form <name>=<file>. The device /dev/<name> is backed by the file.")
+        ("latency", po::value<unsigned int>()->default_value(0), "The delay of each ioctl in microseconds.")
+        ("events", po::value<unsigned int>()->default_value(0),
+            "The number of the low_space events that are generated when the snapshot is taken.")
+        ("diff_storage_minimum", po::value<unsigned long long>()->default_value(g_state.params.diffStorageMinimum),
+            "The portion by which the difference storage grows in sectors.")
+        ("debug", "Show the debug output of CUSE.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    std::string controlName = vm["control"].as<std::string>();
+    if (!::access(("/dev/" + controlName).c_str(), F_OK))
+        throw std::runtime_error("The device [/dev/" + controlName + "] already exists. Is the module loaded?");
+
+    g_state.latencyUs = vm["latency"].as<unsigned int>();
+    g_state.eventsOnTake = vm["events"].as<unsigned int>();
+    g_state.params.diffStorageMinimum = vm["diff_storage_minimum"].as<unsigned long long>();
+    const bool debug = !!vm.count("debug");
+
+    if (vm.count("device"))
+        for (const std::string& arg : vm["device"].as<std::vector<std::string>>())
+        {
+            size_t pos = arg.find('=');
+            if ((pos == std::string::npos) || !pos)
+                throw std::invalid_argument("Invalid device [" + arg + "], it should be <name>=<file>.");
+
+            char path[PATH_MAX];
+            if (!::realpath(arg.substr(pos + 1).c_str(), path))
+                throw std::system_error(errno, std::generic_category(), "Invalid file [" + arg.substr(pos + 1) + "]");
+
+            auto dev = std::make_shared<SFakeDevice>();
+            dev->name = arg.substr(0, pos);
+            dev->path = path;
+            g_state.devices.push_back(dev);
+        }
+
+    struct cuse_lowlevel_ops deviceOps;
+    memset(&deviceOps, 0, sizeof(deviceOps));
+    deviceOps.open = DeviceOpen;
+    deviceOps.read = DeviceRead;
+    deviceOps.write = DeviceWrite;
+    deviceOps.ioctl = DeviceIoctl;
+
+    /*
+     * Each device has its own session. The control device is created last,
+     * so the signal handlers are set for its session.
+     */
+    for (const auto& dev : g_state.devices)
+    {
+        struct fuse_session* se = Setup(dev->name, &deviceOps, dev.get(), debug);
+
+        std::thread([se]() { fuse_session_loop_mt(se, 0); }).detach();
+        logger.Info("Device [/dev/" + dev->name + "] is backed by [" + dev->path + "]");
+    }
+
+    struct cuse_lowlevel_ops controlOps;
+    memset(&controlOps, 0, sizeof(controlOps));
+    controlOps.open = ControlOpen;
+    controlOps.write = ControlWrite;
+    controlOps.ioctl = ControlIoctl;
+
+    struct fuse_session* se = Setup(controlName, &controlOps, nullptr, debug);
+    logger.Info("Control device [/dev/" + controlName + "] is ready");
+    int ret = fuse_session_loop_mt(se, 0);
+    cuse_lowlevel_teardown(se);
+
+    /*
+     * The snapshots hold the trackers, so they are released first.
+     */
+    g_state.snapshots.clear();
+    if (ret)
+        throw std::runtime_error("CUSE session failed with error " + std::to_string(ret));
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/bash -e
+#
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Runs the libblksnap tests that do not read the snapshot images against
+# the fake of the blksnap module.
+# Exit code 77 means that the test was skipped.
+
+FAKE_CONTROL=$1
+TEST_API=$2
+TEST_IOCTL_OVERHEAD=$3
+
+if [ $(id -u) -ne 0 ] || [ ! -c /dev/cuse ]
+then
+	echo "CUSE is not available, skip"
+	exit 77
+fi
+if [ -e /dev/blksnap-control ]
+then
+	echo "The blksnap module is loaded, skip"
+	exit 77
+fi
+
+WORKDIR=$(mktemp -d)
+FAKE_PID=""
+
+cleanup()
+{
+	if [ -n "${FAKE_PID}" ]
+	then
+		kill ${FAKE_PID} 2>/dev/null || true
+		wait ${FAKE_PID} 2>/dev/null || true
+	fi
+	rm -rf ${WORKDIR}
+}
+trap cleanup EXIT
+
+dd if=/dev/zero of=${WORKDIR}/original count=64 bs=1M status=none
+mkdir -p ${WORKDIR}/diff_storage
+
+${FAKE_CONTROL} --device blksnap-fake0=${WORKDIR}/original --events 1 &
+FAKE_PID=$!
+
+for ((ITER = 0 ; ITER < 50 ; ITER++))
+do
+	if [ -c /dev/blksnap-control ] && [ -c /dev/blksnap-fake0 ]
+	then
+		break
+	fi
+	sleep 0.1
+done
+
+${TEST_API} --device /dev/blksnap-fake0 --diff_storage ${WORKDIR}/diff_storage --events 1 --no_direct
+${TEST_IOCTL_OVERHEAD} --device /dev/blksnap-fake0 --iterations 1000 --no_direct
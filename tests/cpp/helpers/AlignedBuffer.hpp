@@ -12,7 +12,7 @@ public:
         Allocate();
     };
     AlignedBuffer(size_t alignment, size_t size)
-        : m_alignment(size)
+        : m_alignment(alignment)
         , m_size(size)
     {
         Allocate();
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "Crc32c.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t crc32cPoly = 0x82F63B78;
+
+    /*
+     * The buffer is divided into three streams with a maximum size of the
+     * stream. For each possible size of the stream, the constant for shifting
+     * the checksum is calculated in advance.
+     */
+    const size_t maxStreamSize = 4096;
+    const size_t minParallelSize = 3 * 64;
+
+    class CCrc32cTables
+    {
+    public:
+        CCrc32cTables()
+        {
+            for (uint32_t inx = 0; inx < 256; inx++)
+            {
+                uint32_t crc = inx;
+
+                for (int bit = 0; bit < 8; bit++)
+                    crc = (crc & 1) ? ((crc >> 1) ^ crc32cPoly) : (crc >> 1);
+                slice[0][inx] = crc;
+            }
+            for (uint32_t inx = 0; inx < 256; inx++)
+                for (int s = 1; s < 8; s++)
+                    slice[s][inx] = (slice[s - 1][inx] >> 8) ^ slice[0][slice[s - 1][inx] & 0xFF];
+
+            /*
+             * The checksum of the stream is shifted over the following n
+             * bytes by the multiplication by x^(8n-33) modulo the polynomial.
+             * The remaining x^33 are given by the carry-less multiplication
+             * of reflected values and by the crc32 instruction.
+             */
+            uint32_t xpow = 0x80000000; // x^0
+            size_t power = 0;
+            for (size_t n = 8; n <= maxStreamSize; n += 8)
+            {
+                for (; power < (8 * n - 33); power++)
+                    xpow = (xpow & 1) ? ((xpow >> 1) ^ crc32cPoly) : (xpow >> 1);
+                shift[n / 8] = xpow;
+            }
+        };
+
+        uint32_t slice[8][256];
+        uint32_t shift[maxStreamSize / 8 + 1];
+    };
+
+    const CCrc32cTables& Tables()
+    {
+        static const CCrc32cTables tables;
+
+        return tables;
+    }
+
+    uint32_t UpdateScalar(uint32_t crc, const unsigned char* p, size_t size)
+    {
+        const CCrc32cTables& t = Tables();
+
+        for (; size && (reinterpret_cast<uintptr_t>(p) & 7); size--)
+            crc = (crc >> 8) ^ t.slice[0][(crc ^ *p++) & 0xFF];
+
+        for (; size >= 8; size -= 8, p += 8)
+        {
+            uint32_t lo;
+            uint32_t hi;
+
+            memcpy(&lo, p, sizeof(lo));
+            memcpy(&hi, p + 4, sizeof(hi));
+            lo ^= crc;
+            crc = t.slice[7][lo & 0xFF] ^ t.slice[6][(lo >> 8) & 0xFF] ^ t.slice[5][(lo >> 16) & 0xFF]
+                  ^ t.slice[4][lo >> 24] ^ t.slice[3][hi & 0xFF] ^ t.slice[2][(hi >> 8) & 0xFF]
+                  ^ t.slice[1][(hi >> 16) & 0xFF] ^ t.slice[0][hi >> 24];
+        }
+
+        for (; size; size--)
+            crc = (crc >> 8) ^ t.slice[0][(crc ^ *p++) & 0xFF];
+
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2"))) uint32_t UpdateSse42(uint32_t crc, const unsigned char* p, size_t size)
+    {
+        uint64_t crc64 = crc;
+
+        for (; size >= 8; size -= 8, p += 8)
+        {
+            uint64_t value;
+
+            memcpy(&value, p, sizeof(value));
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+        crc = static_cast<uint32_t>(crc64);
+
+        for (; size; size--)
+            crc = _mm_crc32_u8(crc, *p++);
+
+        return crc;
+    }
+
+    __attribute__((target("sse4.2,pclmul"))) uint32_t Shift(uint32_t crc, uint32_t k)
+    {
+        __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), _mm_cvtsi32_si128(k), 0);
+
+        return static_cast<uint32_t>(_mm_crc32_u64(0, _mm_cvtsi128_si64(product)));
+    }
+
+    __attribute__((target("sse4.2,pclmul"))) uint32_t UpdatePclmul(uint32_t crc, const unsigned char* p, size_t size)
+    {
+        const CCrc32cTables& t = Tables();
+
+        while (size >= minParallelSize)
+        {
+            const size_t streamSize = std::min(size / 3 / 8 * 8, maxStreamSize);
+            const unsigned char* pB = p + streamSize;
+            const unsigned char* pC = pB + streamSize;
+            uint64_t crcA = crc;
+            uint64_t crcB = 0;
+            uint64_t crcC = 0;
+
+            for (size_t offset = 0; offset < streamSize; offset += 8)
+            {
+                uint64_t valueA;
+                uint64_t valueB;
+                uint64_t valueC;
+
+                memcpy(&valueA, p + offset, sizeof(valueA));
+                memcpy(&valueB, pB + offset, sizeof(valueB));
+                memcpy(&valueC, pC + offset, sizeof(valueC));
+                crcA = _mm_crc32_u64(crcA, valueA);
+                crcB = _mm_crc32_u64(crcB, valueB);
+                crcC = _mm_crc32_u64(crcC, valueC);
+            }
+
+            const uint32_t k = t.shift[streamSize / 8];
+            crc = Shift(static_cast<uint32_t>(crcA), k) ^ static_cast<uint32_t>(crcB);
+            crc = Shift(crc, k) ^ static_cast<uint32_t>(crcC);
+
+            p += 3 * streamSize;
+            size -= 3 * streamSize;
+        }
+
+        return UpdateSse42(crc, p, size);
+    }
+#endif
+}
+
+uint32_t CCrc32c::Calculate(EImplementation impl, const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint32_t crc = 0xFFFFFFFF;
+
+    switch (impl)
+    {
+#if defined(__x86_64__)
+    case ePclmul:
+        crc = UpdatePclmul(crc, p, size);
+        break;
+    case eSse42:
+        crc = UpdateSse42(crc, p, size);
+        break;
+#endif
+    default:
+        crc = UpdateScalar(crc, p, size);
+    }
+
+    return ~crc;
+}
+
+uint32_t CCrc32c::Calculate(const void* data, size_t size)
+{
+    static const EImplementation best = Best();
+
+    return Calculate(best, data, size);
+}
+
+CCrc32c::EImplementation CCrc32c::Best()
+{
+    if (IsSupported(ePclmul))
+        return ePclmul;
+    if (IsSupported(eSse42))
+        return eSse42;
+    return eScalar;
+}
+
+bool CCrc32c::IsSupported(EImplementation impl)
+{
+    switch (impl)
+    {
+    case eScalar:
+        return true;
+#if defined(__x86_64__)
+    case eSse42:
+        return __builtin_cpu_supports("sse4.2");
+    case ePclmul:
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* CCrc32c::Name(EImplementation impl)
+{
+    switch (impl)
+    {
+    case eScalar:
+        return "scalar";
+    case eSse42:
+        return "sse4.2";
+    case ePclmul:
+        return "pclmul";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC32C (Castagnoli) calculation.
+ * On x86_64, the SSE4.2 crc32 instruction is used if the processor supports
+ * it. If PCLMULQDQ is also available, the buffer is divided into three streams
+ * that are processed in parallel, and their checksums are combined by the
+ * carry-less multiplication. Otherwise the table-driven algorithm is used.
+ */
+class CCrc32c
+{
+public:
+    enum EImplementation
+    {
+        eScalar = 0,
+        eSse42,
+        ePclmul,
+        eImplementationCount
+    };
+
+    static uint32_t Calculate(const void* data, size_t size);
+    static uint32_t Calculate(EImplementation impl, const void* data, size_t size);
+
+    static EImplementation Best();
+    static bool IsSupported(EImplementation impl);
+    static const char* Name(EImplementation impl);
+};
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * The latency histogram has 64 ranges of powers of two. Each range is
+ * divided into 32 equal subranges. This keeps the relative error of the
+ * percentile within 3%, which is enough for the comparison of the results.
+ */
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram()
+        : m_counters(64 * SubBuckets, 0)
+        , m_count(0)
+        , m_max(0)
+        , m_sum(0)
+    {};
+
+    void Add(uint64_t ns)
+    {
+        m_counters[Index(ns)]++;
+        m_count++;
+        m_max = std::max(m_max, ns);
+        m_sum += ns;
+    };
+
+    void Merge(const CLatencyHistogram& other)
+    {
+        for (size_t inx = 0; inx < m_counters.size(); inx++)
+            m_counters[inx] += other.m_counters[inx];
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+        m_sum += other.m_sum;
+    };
+
+    /*
+     * Returns the upper bound of the subrange that contains the percentile.
+     */
+    uint64_t Percentile(double percent) const
+    {
+        if (!m_count)
+            return 0;
+
+        uint64_t threshold = static_cast<uint64_t>(m_count * percent / 100.0);
+        uint64_t total = 0;
+
+        for (size_t inx = 0; inx < m_counters.size(); inx++)
+        {
+            total += m_counters[inx];
+            if (total > threshold)
+                return std::min(UpperBound(inx), m_max);
+        }
+        return m_max;
+    };
+
+    uint64_t Count() const
+    {
+        return m_count;
+    };
+    uint64_t Max() const
+    {
+        return m_max;
+    };
+    uint64_t Mean() const
+    {
+        return m_count ? (m_sum / m_count) : 0;
+    };
+
+private:
+    static const unsigned int SubBucketsShift = 5;
+    static const unsigned int SubBuckets = 1 << SubBucketsShift;
+
+    static size_t Index(uint64_t value)
+    {
+        if (value < SubBuckets)
+            return value;
+
+        unsigned int order = 63 - __builtin_clzll(value);
+        unsigned int shift = order - SubBucketsShift;
+
+        return ((shift + 1) << SubBucketsShift) + ((value >> shift) & (SubBuckets - 1));
+    };
+
+    static uint64_t UpperBound(size_t inx)
+    {
+        if (inx < SubBuckets)
+            return inx;
+
+        unsigned int shift = (inx >> SubBucketsShift) - 1;
+        uint64_t base = (SubBuckets + (inx & (SubBuckets - 1))) << shift;
+
+        return base + (1ull << shift) - 1;
+    };
+
+    std::vector<uint64_t> m_counters;
+    uint64_t m_count;
+    uint64_t m_max;
+    uint64_t m_sum;
+};
@@ -1,15 +1,124 @@
 // SPDX-License-Identifier: GPL-2.0+
 #include "RandomHelper.h"
 
-#include <stdlib.h>
-#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+
+static inline uint64_t rotl(const uint64_t x, const int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+CRandom::CRandom(const uint64_t seed, const uint64_t stream)
+{
+    uint64_t x = seed ^ (stream * 0xD1342543DE82EF95ULL);
+
+    for (int inx = 0; inx < 4; inx++)
+        m_state[inx] = splitmix64(x);
+}
+
+uint64_t CRandom::Next()
+{
+    const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+    const uint64_t t = m_state[1] << 17;
+
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 45);
+
+    return result;
+}
+
+uint64_t CRandom::Uniform(const uint64_t upper)
+{
+    if (upper == 0)
+        return 0;
+
+    /*
+     * The numbers above the largest multiple of the upper limit are
+     * rejected, so that the modulo does not make the distribution uneven.
+     */
+    const uint64_t threshold = -upper % upper;
+    uint64_t value;
+
+    do
+        value = Next();
+    while (value < threshold);
+
+    return value % upper;
+}
+
+double CRandom::Real()
+{
+    return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static std::atomic<uint64_t> g_seed(0);
+static std::atomic<uint64_t> g_streamCounter(0);
+static std::atomic<unsigned int> g_generation(0);
+
+struct SThreadGenerator
+{
+    unsigned int generation;
+    std::unique_ptr<CRandom> ptrRandom;
+};
+
+static thread_local SThreadGenerator g_thread = {0, nullptr};
+
+uint64_t CRandomHelper::MakeSeed()
+{
+    std::random_device rd;
+    uint64_t seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+
+    return seed ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+void CRandomHelper::SetSeed(const uint64_t seed)
+{
+    g_seed = seed;
+    g_streamCounter = 0;
+    g_generation++;
+}
+
+uint64_t CRandomHelper::Seed()
+{
+    return g_seed;
+}
+
+void CRandomHelper::SetStream(const uint64_t stream)
+{
+    g_thread.generation = g_generation;
+    g_thread.ptrRandom.reset(new CRandom(g_seed, stream));
+}
+
+CRandom& CRandomHelper::Generator()
+{
+    if (!g_thread.ptrRandom || (g_thread.generation != g_generation))
+        SetStream(g_streamCounter++);
+
+    return *g_thread.ptrRandom;
+}
 
 void CRandomHelper::GenerateBuffer(void* buffer, size_t size)
 {
     size_t icount = size / sizeof(int);
     int* ibuf = static_cast<int*>(buffer);
     char* chbuf = static_cast<char*>(buffer);
-    int rnd = ::random();
+    int rnd = GenerateInt();
 
     for (size_t offset = 0; offset < icount; offset++)
         ibuf[offset] = static_cast<int>(offset * rnd);
@@ -20,5 +129,11 @@ void CRandomHelper::GenerateBuffer(void* buffer, size_t size)
 
 int CRandomHelper::GenerateInt()
 {
-    return ::random();
+    /* The range is the same as the range of ::random(). */
+    return static_cast<int>(Generator().Next() >> 33);
+}
+
+uint64_t CRandomHelper::Uniform(const uint64_t upper)
+{
+    return Generator().Uniform(upper);
 }
@@ -1,9 +1,65 @@
 // SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <stdint.h>
 #include <sys/types.h>
 
+/*
+ * The xoshiro256** generator. It is small, fast and produces the same
+ * sequence for the same seed and stream on any platform, unlike std::rand().
+ * The stream allows to get independent sequences from one seed, for example
+ * one sequence for each thread.
+ */
+class CRandom
+{
+public:
+    CRandom(const uint64_t seed, const uint64_t stream = 0);
+
+    /* The interface of the uniform random bit generator, for std::shuffle. */
+    typedef uint64_t result_type;
+    static constexpr result_type min()
+    {
+        return 0;
+    };
+    static constexpr result_type max()
+    {
+        return UINT64_MAX;
+    };
+    result_type operator()()
+    {
+        return Next();
+    };
+
+    uint64_t Next();
+    /* A uniformly distributed number in the range [0, upper). */
+    uint64_t Uniform(const uint64_t upper);
+    /* A uniformly distributed number in the range [0, 1). */
+    double Real();
+
+private:
+    uint64_t m_state[4];
+};
+
+/*
+ * The random numbers of the tests.
+ * The seed is common for the process. Each thread has its own generator, so
+ * the threads are not contended. The generator of a thread is initialized
+ * by the seed and the number of the stream. The streams are numbered in the
+ * order the threads first use them, so a thread that should repeat its
+ * sequence in a replay sets its stream number explicitly.
+ * The seed of the run is logged by the tests and can be set by the --seed
+ * option to replay a failed run.
+ */
 class CRandomHelper
 {
 public:
+    static uint64_t MakeSeed();
+    static void SetSeed(const uint64_t seed);
+    static uint64_t Seed();
+    static void SetStream(const uint64_t stream);
+    static CRandom& Generator();
+
     static void GenerateBuffer(void* buffer, size_t size);
     static int GenerateInt();
+    static uint64_t Uniform(const uint64_t upper);
 };
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "Workload.h"
+
+#include <cmath>
+#include <stdexcept>
+
+CWorkload::EDistribution CWorkload::ParseDistribution(const std::string& name)
+{
+    if (name == "uniform")
+        return eUniform;
+    if (name == "zipf")
+        return eZipf;
+    if (name == "sequential")
+        return eSequential;
+
+    throw std::invalid_argument("Unknown distribution [" + name + "]. Expected 'uniform', 'zipf' or 'sequential'.");
+}
+
+const char* CWorkload::Name(const EDistribution distribution)
+{
+    switch (distribution)
+    {
+    case eUniform:
+        return "uniform";
+    case eZipf:
+        return "zipf";
+    case eSequential:
+        return "sequential";
+    }
+    return "unknown";
+}
+
+CWorkload::CWorkload(const uint64_t blockCount, const SParams& params)
+    : m_blockCount(blockCount)
+    , m_params(params)
+    , m_zetan(0)
+    , m_alpha(0)
+    , m_eta(0)
+    , m_halfPowTheta(0)
+    , m_sequentialBlock(0)
+    , m_sequentialLeft(0)
+{
+    if (blockCount == 0)
+        throw std::invalid_argument("The workload requires at least one block.");
+
+    if (m_params.distribution != eZipf)
+        return;
+
+    if ((m_params.theta <= 0) || (m_params.theta >= 1))
+        throw std::invalid_argument("The zipf theta should be in the range (0, 1).");
+
+    /*
+     * The algorithm from "Quickly Generating Billion-Record Synthetic
+     * Databases" by J. Gray et al. The zeta constant is calculated once.
+     */
+    const double theta = m_params.theta;
+    double zeta2 = 1.0 + std::pow(0.5, theta);
+
+    for (uint64_t inx = 1; inx <= m_blockCount; inx++)
+        m_zetan += 1.0 / std::pow(static_cast<double>(inx), theta);
+
+    m_alpha = 1.0 / (1.0 - theta);
+    m_eta = (1.0 - std::pow(2.0 / static_cast<double>(m_blockCount), 1.0 - theta)) / (1.0 - zeta2 / m_zetan);
+    m_halfPowTheta = std::pow(0.5, theta);
+}
+
+uint64_t CWorkload::NextZipf(CRandom& rnd)
+{
+    const double u = rnd.Real();
+    const double uz = u * m_zetan;
+
+    if (uz < 1.0)
+        return 0;
+    if ((uz < 1.0 + m_halfPowTheta) && (m_blockCount > 1))
+        return 1;
+
+    uint64_t block = static_cast<uint64_t>(static_cast<double>(m_blockCount)
+                                           * std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+    return (block < m_blockCount) ? block : (m_blockCount - 1);
+}
+
+uint64_t CWorkload::Next(CRandom& rnd)
+{
+    switch (m_params.distribution)
+    {
+    case eZipf:
+        return NextZipf(rnd);
+    case eSequential:
+        if ((m_sequentialLeft == 0) || (++m_sequentialBlock >= m_blockCount))
+        {
+            m_sequentialBlock = rnd.Uniform(m_blockCount);
+            m_sequentialLeft = m_params.burst;
+        }
+        m_sequentialLeft--;
+        return m_sequentialBlock;
+    default:
+        return rnd.Uniform(m_blockCount);
+    }
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include "RandomHelper.h"
+
+/*
+ * The generator of the numbers of the blocks to write.
+ * - uniform. All blocks are equally likely.
+ * - zipf. A few blocks at the beginning of the device are written much more
+ *   often than the others, as the metadata of a filesystem.
+ *   The skew is set by theta in the range (0, 1).
+ * - sequential. The series of consecutive blocks start at random blocks.
+ * The random numbers are taken from the generator of the calling thread, so
+ * the sequence is repeated with the same seed. An object of the class should
+ * be used by one thread.
+ */
+class CWorkload
+{
+public:
+    enum EDistribution
+    {
+        eUniform = 0,
+        eZipf,
+        eSequential
+    };
+
+    struct SParams
+    {
+        SParams()
+            : distribution(eUniform)
+            , theta(0.99)
+            , burst(64)
+        {};
+
+        EDistribution distribution;
+        double theta;
+        uint64_t burst;
+    };
+
+    static EDistribution ParseDistribution(const std::string& name);
+    static const char* Name(const EDistribution distribution);
+
+public:
+    CWorkload(const uint64_t blockCount, const SParams& params = SParams());
+
+    uint64_t Next(CRandom& rnd);
+    uint64_t Next()
+    {
+        return Next(CRandomHelper::Generator());
+    };
+
+    uint64_t BlockCount() const
+    {
+        return m_blockCount;
+    };
+
+private:
+    uint64_t NextZipf(CRandom& rnd);
+
+private:
+    const uint64_t m_blockCount;
+    const SParams m_params;
+
+    double m_zetan;
+    double m_alpha;
+    double m_eta;
+    double m_halfPowTheta;
+
+    uint64_t m_sequentialBlock;
+    uint64_t m_sequentialLeft;
+};
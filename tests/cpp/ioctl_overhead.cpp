@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <chrono>
+#include <blksnap/Snapshot.h>
+#include <blksnap/Tracker.h>
+#include <boost/program_options.hpp>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <uuid/uuid.h>
+
+#include "helpers/Log.h"
+
+namespace po = boost::program_options;
+
+/*
+ * The test compares the cost of a call of the ioctl wrapper that throws an
+ * exception with the cost of the variant that returns std::error_code.
+ * The error path is the expected result of polling a device without a
+ * snapshot or a snapshot that has already been destroyed.
+ */
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct SCaseResult
+{
+    std::string name;
+    unsigned long long failures;
+    double nsPerCall;
+};
+
+static SCaseResult RunCase(const std::string& name, const unsigned long long iterations,
+                           const std::function<bool()>& call)
+{
+    SCaseResult result;
+
+    result.name = name;
+    result.failures = 0;
+
+    const uint64_t startNs = NowNs();
+    for (unsigned long long inx = 0; inx < iterations; inx++)
+        if (!call())
+            result.failures++;
+    result.nsPerCall = static_cast<double>(NowNs() - startNs) / iterations;
+
+    logger.Info(name + ": " + std::to_string(result.nsPerCall) + " ns/call, "
+                + std::to_string(result.failures) + " failures");
+    return result;
+}
+
+/*
+ * The change tracker is detached when the test is completed or failed, but
+ * only if it was attached by the test.
+ */
+class CAttachGuard
+{
+public:
+    CAttachGuard(blksnap::CTracker& tracker)
+        : m_tracker(tracker)
+        , m_isAttached(tracker.Attach())
+    {};
+    ~CAttachGuard()
+    {
+        std::error_code ec;
+
+        if (!m_isAttached)
+            return;
+        m_tracker.Detach(ec);
+        if (ec)
+            logger.Err("Failed to detach the change tracker: " + ec.message());
+    };
+
+private:
+    blksnap::CTracker& m_tracker;
+    bool m_isAttached;
+};
+
+void CheckIoctlOverhead(const std::string& device, const unsigned long long iterations)
+{
+    std::vector<SCaseResult> results;
+
+    logger.Info("--- Test: ioctl wrappers overhead ---");
+    logger.Info("device: " + device);
+    logger.Info("iterations: " + std::to_string(iterations));
+
+    blksnap::CTracker tracker(device);
+    CAttachGuard attachGuard(tracker);
+
+    /*
+     * Success path. The change tracker is attached to the device, so the
+     * information about it is always available.
+     */
+    results.push_back(RunCase("cbt_info throw", iterations, [&tracker]() {
+        struct blksnap_cbtinfo cbtInfo;
+
+        tracker.CbtInfo(cbtInfo);
+        return true;
+    }));
+    results.push_back(RunCase("cbt_info error_code", iterations, [&tracker]() {
+        struct blksnap_cbtinfo cbtInfo;
+        std::error_code ec;
+
+        tracker.CbtInfo(cbtInfo, ec);
+        return !ec;
+    }));
+
+    /*
+     * Error path. The device is not a part of any snapshot.
+     */
+    results.push_back(RunCase("snapshot_info throw", iterations, [&tracker]() {
+        struct blksnap_snapshotinfo snapshotInfo;
+
+        try
+        {
+            tracker.SnapshotInfo(snapshotInfo);
+        }
+        catch (std::system_error&)
+        {
+            return false;
+        }
+        return true;
+    }));
+    results.push_back(RunCase("snapshot_info error_code", iterations, [&tracker]() {
+        struct blksnap_snapshotinfo snapshotInfo;
+        std::error_code ec;
+
+        tracker.SnapshotInfo(snapshotInfo, ec);
+        return !ec;
+    }));
+
+    /*
+     * Error path. The snapshot with a random identifier does not exist.
+     */
+    uuid_t id;
+    uuid_generate(id);
+    auto ptrSnapshot = blksnap::CSnapshot::Open(blksnap::CSnapshotId(id));
+
+    results.push_back(RunCase("wait_event throw", iterations, [&ptrSnapshot]() {
+        blksnap::SBlksnapEvent ev;
+
+        try
+        {
+            ptrSnapshot->WaitEvent(0, ev);
+        }
+        catch (std::system_error&)
+        {
+            return false;
+        }
+        return true;
+    }));
+    results.push_back(RunCase("wait_event error_code", iterations, [&ptrSnapshot]() {
+        blksnap::SBlksnapEvent ev;
+        std::error_code ec;
+
+        ptrSnapshot->WaitEvent(0, ev, ec);
+        return !ec;
+    }));
+
+    std::cout << std::left << std::setw(28) << "case" << std::right << std::setw(14) << "ns/call"
+              << std::setw(14) << "failures" << std::endl;
+    for (const SCaseResult& result : results)
+        std::cout << std::left << std::setw(28) << result.name << std::right << std::setw(14) << std::fixed
+                  << std::setprecision(1) << result.nsPerCall << std::setw(14) << result.failures << std::endl;
+
+    logger.Info("--- Success: ioctl wrappers overhead ---");
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string(
+        "Comparing the overhead of the throwing and non-throwing ioctl wrappers of the blksnap library.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("device,d", po::value<std::string>(), "Device name. The change tracker is attached to it.")
+        ("iterations,n", po::value<unsigned long long>()->default_value(100000),
+            "The number of calls in each case.")
+        ("no_direct", "Open the devices without O_DIRECT. The devices of the fake module do not support it.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    if (!vm.count("device"))
+        throw std::invalid_argument("Argument 'device' is missed.");
+    std::string origDevName = vm["device"].as<std::string>();
+
+    unsigned long long iterations = vm["iterations"].as<unsigned long long>();
+    if (!iterations)
+        throw std::invalid_argument("Argument 'iterations' should be greater than zero.");
+    if (vm.count("no_direct"))
+        blksnap::CHandleCache::Instance().SetDeviceFlags(O_RDONLY);
+
+    CheckIoctlOverhead(origDevName, iterations);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,602 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <errno.h>
+#include <functional>
+#include <iostream>
+#include <linux/blksnap.h>
+#include <map>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "helpers/AlignedBuffer.hpp"
+#include "helpers/Log.h"
+#include "helpers/RandomHelper.h"
+#include "helpers/Workload.h"
+#include "model/Snapshot.h"
+#include "TestSector.h"
+
+namespace po = boost::program_options;
+using blksnap::sector_t;
+using blksnap::SRange;
+
+/*
+ * The scenarios of the corrupt, boundary and diff_storage tests are repeated
+ * for the userspace model of the blksnap module. The model does not require
+ * the module, the loop devices or the root privileges. It allows to check a
+ * change of the algorithms, for example of the chunk size or of the
+ * difference storage allocation, and to compare their parameters quickly.
+ */
+
+static SModelParams g_params;
+static std::string g_dir;
+static sector_t g_limit;
+static int g_cycles;
+static int g_blocks;
+static const size_t g_blksz = 4096;
+static CWorkload::SParams g_workloadParams;
+
+static uint64_t ParseSize(std::string str)
+{
+    uint64_t multiple = 1;
+
+    switch (str.back())
+    {
+    case 'G':
+        multiple *= 1024;
+    case 'M':
+        multiple *= 1024;
+    case 'K':
+        multiple *= 1024;
+        str.pop_back();
+    default:
+        return std::stoull(str) * multiple;
+    }
+}
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void CheckError(const int err, const std::string& message)
+{
+    if (err)
+        throw std::system_error(std::abs(err), std::generic_category(), message);
+}
+
+/*
+ * The file is created in the directory and removed when the test is
+ * completed. It replaces a block device.
+ */
+class CTempFile
+{
+public:
+    CTempFile(const std::string& dir, const sector_t sectors)
+    {
+        std::string templ = dir + "/blksnap_model_XXXXXX";
+        int fd = ::mkstemp(&templ[0]);
+
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "Failed to create file in '" + dir + "'");
+        m_path = templ;
+        if (::ftruncate(fd, static_cast<off_t>(sectors << SECTOR_SHIFT)))
+        {
+            int err = errno;
+
+            ::close(fd);
+            ::unlink(m_path.c_str());
+            throw std::system_error(err, std::generic_category(), "Failed to resize file '" + m_path + "'");
+        }
+        ::close(fd);
+    };
+    ~CTempFile()
+    {
+        ::unlink(m_path.c_str());
+    };
+    const std::string& Path() const
+    {
+        return m_path;
+    };
+
+private:
+    std::string m_path;
+};
+
+static void Fill(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CModelTracker>& ptrTracker,
+                 const sector_t sector, const sector_t count)
+{
+    AlignedBuffer<unsigned char> portion(g_blksz, count << SECTOR_SHIFT);
+
+    ptrGen->Generate(portion.Data(), portion.Size(), sector);
+    CheckError(ptrTracker->Write(portion.Data(), sector, count), "Failed to write to original");
+}
+
+static void FillAll(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::shared_ptr<CModelTracker>& ptrTracker)
+{
+    const sector_t capacity = ptrTracker->Original()->Size();
+    const sector_t portion = (1024 * 1024) >> SECTOR_SHIFT;
+
+    for (sector_t sector = 0; sector < capacity; sector += portion)
+        Fill(ptrGen, ptrTracker, sector, std::min(portion, capacity - sector));
+}
+
+static void FillRandomBlocks(const std::shared_ptr<CTestSectorGenetor>& ptrGen,
+                             const std::shared_ptr<CModelTracker>& ptrTracker, const int count)
+{
+    const sector_t capacity = ptrTracker->Original()->Size();
+    const sector_t blkszSectors = g_blksz >> SECTOR_SHIFT;
+    /*
+     * The workload selects the first block of a write of up to 32 blocks.
+     * It is created once for each size of the device, since the constants
+     * of the zipf distribution are calculated for all the blocks.
+     */
+    static std::map<sector_t, std::shared_ptr<CWorkload>> workloads;
+    auto& ptrWorkload = workloads[capacity];
+
+    if (!ptrWorkload)
+        ptrWorkload = std::make_shared<CWorkload>((capacity - 32 * blkszSectors) / blkszSectors + 1,
+                                                  g_workloadParams);
+
+    for (int inx = 0; inx < count; inx++)
+    {
+        sector_t sectors = static_cast<sector_t>(CRandomHelper::Uniform(0x20) + 1) * blkszSectors;
+        sector_t sector = static_cast<sector_t>(ptrWorkload->Next()) * blkszSectors;
+
+        Fill(ptrGen, ptrTracker, sector, sectors);
+    }
+}
+
+static void CheckImage(const std::shared_ptr<CTestSectorGenetor>& ptrGen,
+                       const std::shared_ptr<CModelTracker>& ptrTracker, const int seqNumber, const clock_t seqTime)
+{
+    const sector_t capacity = ptrTracker->Original()->Size();
+    const sector_t portionSectors = (1024 * 1024) >> SECTOR_SHIFT;
+    AlignedBuffer<unsigned char> portion(g_blksz, portionSectors << SECTOR_SHIFT);
+
+    for (sector_t sector = 0; sector < capacity; sector += portionSectors)
+    {
+        const sector_t count = std::min(portionSectors, capacity - sector);
+
+        CheckError(ptrTracker->ImageRead(portion.Data(), sector, count), "Failed to read image");
+        ptrGen->Check(portion.Data(), count << SECTOR_SHIFT, sector, seqNumber, seqTime);
+    }
+}
+
+static void LogStatistic(const std::shared_ptr<CModelSnapshot>& ptrSnapshot,
+                         const std::shared_ptr<CModelTracker>& ptrTracker)
+{
+    auto ptrDiffArea = ptrTracker->DiffArea();
+    std::stringstream ss;
+
+    if (ptrDiffArea)
+    {
+        const CModelDiffArea::SStatistic stat = ptrDiffArea->GetStatistic();
+
+        ss << "chunk size " << (1ULL << ptrDiffArea->ChunkShift()) << " bytes, chunks " << ptrDiffArea->ChunkCount()
+           << ", copied " << stat.chunksCopied << ", stored " << stat.chunksStored << ", in memory "
+           << stat.chunksInMemory << ", failed " << stat.chunksFailed << std::endl;
+        ss << "image sectors read: untouched " << stat.imageUntouchedSectors << ", in memory "
+           << stat.imageInMemorySectors << ", stored " << stat.imageStoredSectors << std::endl;
+    }
+
+    const CModelDiffStorage::SStatistic stat = ptrSnapshot->DiffStorage()->GetStatistic();
+    ss << "difference storage: filled " << stat.filled << ", requested " << stat.requested << ", capacity "
+       << stat.capacity << ", limit " << stat.limit << " sectors, allocations " << stat.allocations
+       << ", reallocations " << stat.reallocations << ", switches " << stat.switches;
+    logger.Info(ss);
+}
+
+/*
+ * Returns the number of the events with the code. All events are logged.
+ */
+static std::map<unsigned int, int> ProcessEvents(const std::shared_ptr<CModelSnapshot>& ptrSnapshot)
+{
+    std::map<unsigned int, int> counters;
+    SModelEvent ev;
+
+    while (!ptrSnapshot->WaitEvent(ev))
+    {
+        std::stringstream ss;
+
+        counters[ev.code]++;
+        switch (ev.code)
+        {
+        case blksnap_event_code_low_space:
+        {
+            const auto* p = reinterpret_cast<const struct blksnap_event_low_space*>(ev.data.data());
+
+            ss << "event low_space: free " << p->free_nr_sect << ", requested " << p->requested_nr_sect;
+            break;
+        }
+        case blksnap_event_code_no_space:
+        {
+            const auto* p = reinterpret_cast<const struct blksnap_event_no_space*>(ev.data.data());
+
+            ss << "event no_space: requested " << p->requested_nr_sect;
+            break;
+        }
+        case blksnap_event_code_corrupted:
+        {
+            const auto* p = reinterpret_cast<const struct blksnap_event_corrupted*>(ev.data.data());
+
+            ss << "event corrupted: device " << p->dev_id_mj << ":" << p->dev_id_mn << ", error " << p->err_code;
+            break;
+        }
+        default:
+            ss << "event " << ev.code;
+        }
+        logger.Detail(ss);
+    }
+    return counters;
+}
+
+static void CheckFails(const std::shared_ptr<CTestSectorGenetor>& ptrGen, const std::string& name)
+{
+    if (!ptrGen->Fails())
+        return;
+
+    std::stringstream ss;
+    ss << "Corrupted ranges:";
+    for (const SRange& range : ptrGen->GetFails())
+        ss << " " << range.sector << ":" << range.count;
+    logger.Err(ss);
+    throw std::runtime_error("--- Failed: " + name + " ---");
+}
+
+/*
+ * The original device is filled with test data. On each cycle the snapshot
+ * is taken, random blocks are overwritten and the image is checked. The image
+ * is checked twice: when the copied chunks are in memory and when they are
+ * stored in the difference storage.
+ */
+static void ScenarioCorrupt(const sector_t capacity)
+{
+    CTempFile orig(g_dir, capacity);
+    auto ptrGen = std::make_shared<CTestSectorGenetor>(true);
+    auto ptrTracker = std::make_shared<CModelTracker>(g_params, orig.Path(), 1, 0);
+
+    FillAll(ptrGen, ptrTracker);
+    for (int cycle = 0; cycle < g_cycles; cycle++)
+    {
+        auto ptrSnapshot = std::make_shared<CModelSnapshot>(g_params);
+
+        CheckError(ptrSnapshot->SetDiffStorage(g_dir, g_limit), "Failed to set difference storage");
+        CheckError(ptrSnapshot->AddDevice(ptrTracker), "Failed to add device");
+        CheckError(ptrSnapshot->Take(), "Failed to take snapshot");
+
+        const int testSeqNumber = ptrGen->GetSequenceNumber();
+        const clock_t testSeqTime = std::clock();
+
+        ptrGen->IncSequence();
+        FillRandomBlocks(ptrGen, ptrTracker, g_blocks);
+        CheckImage(ptrGen, ptrTracker, testSeqNumber, testSeqTime);
+
+        ptrSnapshot->Flush();
+        FillRandomBlocks(ptrGen, ptrTracker, g_blocks);
+        CheckImage(ptrGen, ptrTracker, testSeqNumber, testSeqTime);
+
+        LogStatistic(ptrSnapshot, ptrTracker);
+        auto counters = ProcessEvents(ptrSnapshot);
+        if (counters[blksnap_event_code_corrupted])
+            throw std::runtime_error("The snapshot is corrupted");
+        CheckFails(ptrGen, "corrupt");
+    }
+}
+
+/*
+ * The original device and the image are written at the boundaries of the
+ * chunks. The neighboring sectors should not be changed.
+ */
+static void ScenarioBoundary(const sector_t capacity)
+{
+    CTempFile orig(g_dir, capacity);
+    auto ptrGen = std::make_shared<CTestSectorGenetor>(true);
+    auto ptrTracker = std::make_shared<CModelTracker>(g_params, orig.Path(), 1, 0);
+    const sector_t blkszSectors = g_blksz >> SECTOR_SHIFT;
+
+    FillAll(ptrGen, ptrTracker);
+    for (int cycle = 0; cycle < g_cycles; cycle++)
+    {
+        auto ptrSnapshot = std::make_shared<CModelSnapshot>(g_params);
+
+        CheckError(ptrSnapshot->SetDiffStorage(g_dir, g_limit), "Failed to set difference storage");
+        CheckError(ptrSnapshot->AddDevice(ptrTracker), "Failed to add device");
+        CheckError(ptrSnapshot->Take(), "Failed to take snapshot");
+
+        const int testSeqNumber = ptrGen->GetSequenceNumber();
+        const clock_t testSeqTime = std::clock();
+        const unsigned int chunkSectorShift = ptrTracker->DiffArea()->ChunkShift() - SECTOR_SHIFT;
+        const unsigned long chunkCount = ptrTracker->DiffArea()->ChunkCount();
+        if (chunkCount < 2)
+            throw std::runtime_error("The original device should contain at least two chunks");
+
+        ptrGen->IncSequence();
+        for (int inx = 0; inx < g_blocks; inx++)
+        {
+            const unsigned long nr = 1 + CRandomHelper::Uniform(chunkCount - 1);
+            const sector_t boundary = static_cast<sector_t>(nr) << chunkSectorShift;
+
+            Fill(ptrGen, ptrTracker, boundary - blkszSectors, 2 * blkszSectors);
+        }
+        CheckImage(ptrGen, ptrTracker, testSeqNumber, testSeqTime);
+
+        /*
+         * The sectors written to the image at the boundary are checked
+         * strictly, the others should stay unchanged.
+         */
+        const unsigned long nr = 1 + CRandomHelper::Uniform(chunkCount - 1);
+        const sector_t boundary = static_cast<sector_t>(nr) << chunkSectorShift;
+        AlignedBuffer<unsigned char> buf(g_blksz, 2 * g_blksz);
+
+        ptrGen->IncSequence();
+        const clock_t imageSeqTime = std::clock();
+        ptrGen->Generate(buf.Data(), buf.Size(), boundary - blkszSectors, imageSeqTime);
+        CheckError(ptrTracker->ImageWrite(buf.Data(), boundary - blkszSectors, 2 * blkszSectors),
+                   "Failed to write image");
+        ptrSnapshot->Flush();
+
+        memset(buf.Data(), 0, buf.Size());
+        CheckError(ptrTracker->ImageRead(buf.Data(), boundary - blkszSectors, 2 * blkszSectors),
+                   "Failed to read image");
+        ptrGen->Check(buf.Data(), buf.Size(), boundary - blkszSectors, ptrGen->GetSequenceNumber(), imageSeqTime,
+                      true);
+
+        AlignedBuffer<unsigned char> neighbor(g_blksz, g_blksz);
+        const sector_t neighbors[] = {boundary - 2 * blkszSectors, boundary + blkszSectors};
+        for (sector_t sector : neighbors)
+        {
+            CheckError(ptrTracker->ImageRead(neighbor.Data(), sector, blkszSectors), "Failed to read image");
+            ptrGen->Check(neighbor.Data(), neighbor.Size(), sector, testSeqNumber, testSeqTime);
+        }
+
+        LogStatistic(ptrSnapshot, ptrTracker);
+        auto counters = ProcessEvents(ptrSnapshot);
+        if (counters[blksnap_event_code_corrupted])
+            throw std::runtime_error("The snapshot is corrupted");
+        CheckFails(ptrGen, "boundary");
+    }
+}
+
+/*
+ * The whole original device is overwritten while the snapshot is taken.
+ * The difference storage file grows until the limit is reached, then it
+ * overflows and the snapshot is corrupted. The difference storage on a block
+ * device is extended by spare devices on the low_space event.
+ */
+static void ScenarioDiffStorage(const sector_t capacity)
+{
+    CTempFile orig(g_dir, capacity);
+    auto ptrGen = std::make_shared<CTestSectorGenetor>(true);
+    auto ptrTracker = std::make_shared<CModelTracker>(g_params, orig.Path(), 1, 0);
+
+    FillAll(ptrGen, ptrTracker);
+    {
+        const sector_t limit = capacity / 2;
+        auto ptrSnapshot = std::make_shared<CModelSnapshot>(g_params);
+
+        logger.Info("- Difference storage in a file with limit " + std::to_string(limit) + " sectors");
+        CheckError(ptrSnapshot->SetDiffStorage(g_dir, limit), "Failed to set difference storage");
+        CheckError(ptrSnapshot->AddDevice(ptrTracker), "Failed to add device");
+        CheckError(ptrSnapshot->Take(), "Failed to take snapshot");
+
+        ptrGen->IncSequence();
+        FillAll(ptrGen, ptrTracker);
+        ptrSnapshot->Flush();
+
+        LogStatistic(ptrSnapshot, ptrTracker);
+        auto counters = ProcessEvents(ptrSnapshot);
+        if (!counters[blksnap_event_code_no_space])
+            throw std::runtime_error("The no_space event was not received");
+        if (!counters[blksnap_event_code_corrupted] || !ptrTracker->DiffArea()->IsCorrupted())
+            throw std::runtime_error("The snapshot was not corrupted on overflow");
+
+        AlignedBuffer<unsigned char> buf(g_blksz, g_blksz);
+        if (ptrTracker->ImageRead(buf.Data(), 0, g_blksz >> SECTOR_SHIFT) != -EIO)
+            throw std::runtime_error("The corrupted image can be read");
+    }
+    {
+        const sector_t portion = g_params.diffStorageMinimum + 4096;
+        CTempFile storage(g_dir, portion);
+        std::vector<std::shared_ptr<CTempFile>> spares;
+        auto ptrSnapshot = std::make_shared<CModelSnapshot>(g_params);
+
+        logger.Info("- Difference storage on block devices of " + std::to_string(portion) + " sectors");
+        CheckError(ptrSnapshot->SetDiffStorage(storage.Path(), 0, true), "Failed to set difference storage");
+        CheckError(ptrSnapshot->AddDevice(ptrTracker), "Failed to add device");
+        CheckError(ptrSnapshot->Take(), "Failed to take snapshot");
+
+        const int testSeqNumber = ptrGen->GetSequenceNumber();
+        const clock_t testSeqTime = std::clock();
+        const sector_t step = (1024 * 1024) >> SECTOR_SHIFT;
+
+        ptrGen->IncSequence();
+        for (sector_t sector = 0; sector < capacity; sector += step)
+        {
+            Fill(ptrGen, ptrTracker, sector, std::min(step, capacity - sector));
+            ptrSnapshot->Flush();
+
+            auto counters = ProcessEvents(ptrSnapshot);
+            if (counters[blksnap_event_code_corrupted])
+                throw std::runtime_error("The snapshot is corrupted");
+            if (counters[blksnap_event_code_low_space])
+            {
+                spares.push_back(std::make_shared<CTempFile>(g_dir, portion));
+                CheckError(ptrSnapshot->AppendStorage(spares.back()->Path()), "Failed to append storage");
+            }
+        }
+        CheckImage(ptrGen, ptrTracker, testSeqNumber, testSeqTime);
+
+        LogStatistic(ptrSnapshot, ptrTracker);
+        logger.Info("spare devices appended: " + std::to_string(spares.size()));
+        CheckFails(ptrGen, "diff_storage");
+    }
+}
+
+/*
+ * Each snapshot changes one block. The change tracking map should contain
+ * the number of the snapshot in which the block was changed. After 255
+ * snapshots the map is reset and the generation is changed.
+ */
+static void ScenarioCbt(const sector_t capacity)
+{
+    CTempFile orig(g_dir, capacity);
+    auto ptrTracker = std::make_shared<CModelTracker>(g_params, orig.Path(), 1, 0);
+    AlignedBuffer<unsigned char> buf(g_blksz, g_blksz);
+    std::vector<unsigned char> map;
+    int generations = 0;
+    uuid_t generationId;
+
+    uuid_copy(generationId, ptrTracker->CbtMap()->GenerationId());
+    for (int inx = 0; inx < 300; inx++)
+    {
+        auto ptrCbtMap = ptrTracker->CbtMap();
+        const unsigned int snapNumber = ptrCbtMap->SnapNumberActive();
+        const size_t block = CRandomHelper::Uniform(ptrCbtMap->BlockCount());
+        const sector_t sector = static_cast<sector_t>(block) << (ptrCbtMap->BlockSizeShift() - SECTOR_SHIFT);
+
+        CheckError(ptrTracker->Write(buf.Data(), sector, g_blksz >> SECTOR_SHIFT), "Failed to write to original");
+
+        auto ptrSnapshot = std::make_shared<CModelSnapshot>(g_params);
+        CheckError(ptrSnapshot->SetDiffStorage(g_dir, g_limit), "Failed to set difference storage");
+        CheckError(ptrSnapshot->AddDevice(ptrTracker), "Failed to add device");
+        CheckError(ptrSnapshot->Take(), "Failed to take snapshot");
+
+        if (uuid_compare(generationId, ptrCbtMap->GenerationId()))
+        {
+            uuid_copy(generationId, ptrCbtMap->GenerationId());
+            generations++;
+            if (snapNumber != 255)
+                throw std::runtime_error("The generation was changed after snapshot " + std::to_string(snapNumber));
+            continue;
+        }
+
+        map.resize(ptrCbtMap->BlockCount());
+        ptrCbtMap->Read(0, map.size(), map.data());
+        if (map[block] != snapNumber)
+            throw std::runtime_error("Invalid snapshot number " + std::to_string(map[block]) + " of block "
+                                     + std::to_string(block) + ", expected " + std::to_string(snapNumber));
+    }
+    if (generations != 1)
+        throw std::runtime_error("Invalid number of generations " + std::to_string(generations));
+}
+
+void CheckModel(const std::vector<std::string>& scenarios, const sector_t capacity)
+{
+    const std::map<std::string, std::function<void(const sector_t)>> all = {
+        {"corrupt", ScenarioCorrupt},
+        {"boundary", ScenarioBoundary},
+        {"diff_storage", ScenarioDiffStorage},
+        {"cbt", ScenarioCbt},
+    };
+
+    for (const std::string& name : scenarios)
+    {
+        auto it = all.find(name);
+        if (it == all.end())
+            throw std::invalid_argument("Unknown scenario '" + name + "'.");
+
+        logger.Info("--- Test: model " + name + " ---");
+        const uint64_t startNs = NowNs();
+        it->second(capacity);
+        logger.Info("elapsed " + std::to_string((NowNs() - startNs) / 1000000) + " ms");
+        logger.Info("--- Success: model " + name + " ---");
+    }
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string("Checking the userspace model of the blksnap module.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("scenario", po::value<std::vector<std::string>>()->multitoken()
+            ->default_value({"corrupt", "boundary", "diff_storage", "cbt"}, "corrupt boundary diff_storage cbt"),
+            "The scenarios: corrupt, boundary, diff_storage and cbt.")
+        ("size,s", po::value<std::string>()->default_value("256M"),
+            "The size of the original device. The suffixes G, M and K is allowed.")
+        ("dir,d", po::value<std::string>()->default_value("/tmp"),
+            "The directory for the original device and the difference storage files.")
+        ("diff_storage_limit", po::value<std::string>()->default_value("1G"),
+            "The maximum size of the difference storage. The suffixes G, M and K is allowed.")
+        ("diff_storage_minimum", po::value<std::string>()->default_value("64M"),
+            "The portion by which the difference storage grows. The suffixes G, M and K is allowed.")
+        ("chunk_minimum_shift", po::value<unsigned int>()->default_value(g_params.chunkMinimumShift),
+            "The minimum chunk size as a power of two.")
+        ("cycles,c", po::value<int>()->default_value(3), "The number of snapshots in a scenario.")
+        ("blocks,b", po::value<int>()->default_value(256), "The number of random writes in a cycle.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to replay a failed run.")
+        ("distribution", po::value<std::string>()->default_value("uniform"),
+            "The distribution of random writes: 'uniform', 'zipf' or 'sequential'.")
+        ("zipf_theta", po::value<double>()->default_value(0.99), "The skew of the zipf distribution.")
+        ("burst", po::value<unsigned long long>()->default_value(64),
+            "The number of consecutive blocks in the sequential distribution.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    sector_t capacity = ParseSize(vm["size"].as<std::string>()) >> SECTOR_SHIFT;
+    if (capacity < (16 * 1024 * 1024 >> SECTOR_SHIFT))
+        throw std::invalid_argument("Argument 'size' should be at least 16M.");
+    capacity &= ~static_cast<sector_t>((g_blksz >> SECTOR_SHIFT) - 1);
+
+    g_dir = vm["dir"].as<std::string>();
+    g_limit = ParseSize(vm["diff_storage_limit"].as<std::string>()) >> SECTOR_SHIFT;
+    g_params.diffStorageMinimum = ParseSize(vm["diff_storage_minimum"].as<std::string>()) >> SECTOR_SHIFT;
+    if (!g_params.diffStorageMinimum)
+        throw std::invalid_argument("Argument 'diff_storage_minimum' should be greater than zero.");
+    g_params.chunkMinimumShift = vm["chunk_minimum_shift"].as<unsigned int>();
+    if ((g_params.chunkMinimumShift < 12) || (g_params.chunkMinimumShift > g_params.chunkMaximumShift))
+        throw std::invalid_argument("Argument 'chunk_minimum_shift' should be from 12 to "
+                                    + std::to_string(g_params.chunkMaximumShift) + ".");
+    g_cycles = vm["cycles"].as<int>();
+    g_blocks = vm["blocks"].as<int>();
+
+    g_workloadParams.distribution = CWorkload::ParseDistribution(vm["distribution"].as<std::string>());
+    g_workloadParams.theta = vm["zipf_theta"].as<double>();
+    g_workloadParams.burst = vm["burst"].as<unsigned long long>();
+
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+    logger.Info(std::string("distribution: ") + CWorkload::Name(g_workloadParams.distribution));
+
+    CheckModel(vm["scenario"].as<std::vector<std::string>>(), capacity);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        std::cerr << "To replay the run, use --seed " << CRandomHelper::Seed() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
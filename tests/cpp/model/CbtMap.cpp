@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "CbtMap.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <string.h>
+
+using blksnap::sector_t;
+
+static inline unsigned long long CountByShift(const sector_t capacity, const unsigned int shift)
+{
+    const sector_t blkSize = 1ULL << (shift - SECTOR_SHIFT);
+
+    return (capacity + blkSize - 1) / blkSize;
+}
+
+CModelCbtMap::CModelCbtMap(const SModelParams& params, const sector_t capacity)
+    : m_capacity(capacity)
+    , m_snapNumberActive(1)
+    , m_snapNumberPrevious(0)
+    , m_isCorrupted(false)
+{
+    unsigned int shift = params.trackingBlockMinimumShift;
+    unsigned long long count = CountByShift(capacity, shift);
+
+    while (count > params.trackingBlockMaximumCount)
+    {
+        if (shift >= params.trackingBlockMaximumShift)
+            break;
+        shift++;
+        count = CountByShift(capacity, shift);
+    }
+
+    m_blkSizeShift = shift;
+    m_blkCount = static_cast<size_t>(count);
+    m_readMap.assign(m_blkCount, 0);
+    m_writeMap.assign(m_blkCount, 0);
+    uuid_generate(m_generationId);
+}
+
+int CModelCbtMap::SetMap(const sector_t sector, const sector_t count, const unsigned char snapNumber,
+                         std::vector<unsigned char>& map)
+{
+    const size_t first = static_cast<size_t>(sector >> (m_blkSizeShift - SECTOR_SHIFT));
+    const size_t last = static_cast<size_t>((sector + count - 1) >> (m_blkSizeShift - SECTOR_SHIFT));
+
+    for (size_t inx = first; inx <= last; inx++)
+    {
+        if (inx >= m_blkCount)
+            return -EINVAL;
+
+        if (map[inx] < snapNumber)
+            map[inx] = snapNumber;
+    }
+    return 0;
+}
+
+int CModelCbtMap::Set(const sector_t sector, const sector_t count)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    int ret;
+
+    if (m_isCorrupted)
+        return -EINVAL;
+
+    ret = SetMap(sector, count, static_cast<unsigned char>(m_snapNumberActive), m_writeMap);
+    if (ret)
+        m_isCorrupted = true;
+    return ret;
+}
+
+int CModelCbtMap::SetBoth(const sector_t sector, const sector_t count)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    int ret;
+
+    if (m_isCorrupted)
+        return -EINVAL;
+
+    ret = SetMap(sector, count, static_cast<unsigned char>(m_snapNumberActive), m_writeMap);
+    if (!ret)
+        ret = SetMap(sector, count, static_cast<unsigned char>(m_snapNumberPrevious), m_readMap);
+    return ret;
+}
+
+void CModelCbtMap::Switch()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_snapNumberPrevious = m_snapNumberActive;
+    ++m_snapNumberActive;
+    if (m_snapNumberActive == 256)
+    {
+        m_snapNumberActive = 1;
+        memset(m_writeMap.data(), 0, m_blkCount);
+        uuid_generate(m_generationId);
+    }
+    else
+        m_readMap = m_writeMap;
+}
+
+int CModelCbtMap::Read(const size_t offset, const size_t length, unsigned char* buff)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (offset >= m_blkCount)
+        return -EINVAL;
+
+    const size_t size = std::min(length, m_blkCount - offset);
+    memcpy(buff, m_readMap.data() + offset, size);
+    return static_cast<int>(size);
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <uuid/uuid.h>
+#include "Params.h"
+
+/*
+ * The change tracking map. As in the module, each byte of the map is the
+ * number of the snapshot in which the block was changed. The write map
+ * receives the changes, the read map is a copy of it taken at the time of
+ * the snapshot. After 255 snapshots the map is reset and a new generation
+ * of changes begins.
+ */
+class CModelCbtMap
+{
+public:
+    CModelCbtMap(const SModelParams& params, const blksnap::sector_t capacity);
+
+    int Set(const blksnap::sector_t sector, const blksnap::sector_t count);
+    int SetBoth(const blksnap::sector_t sector, const blksnap::sector_t count);
+    void Switch();
+
+    blksnap::sector_t Capacity() const
+    {
+        return m_capacity;
+    };
+    unsigned int BlockSizeShift() const
+    {
+        return m_blkSizeShift;
+    };
+    size_t BlockCount() const
+    {
+        return m_blkCount;
+    };
+    unsigned int SnapNumberActive() const
+    {
+        return m_snapNumberActive;
+    };
+    unsigned int SnapNumberPrevious() const
+    {
+        return m_snapNumberPrevious;
+    };
+    const uuid_t& GenerationId() const
+    {
+        return m_generationId;
+    };
+    bool IsCorrupted() const
+    {
+        return m_isCorrupted;
+    };
+    /*
+     * Copies a part of the read map, as the BLKFILTER_CTL_BLKSNAP_CBTMAP
+     * command does.
+     */
+    int Read(const size_t offset, const size_t length, unsigned char* buff);
+
+private:
+    std::mutex m_lock;
+    blksnap::sector_t m_capacity;
+    unsigned int m_blkSizeShift;
+    size_t m_blkCount;
+    std::vector<unsigned char> m_readMap;
+    std::vector<unsigned char> m_writeMap;
+    unsigned int m_snapNumberActive;
+    unsigned int m_snapNumberPrevious;
+    uuid_t m_generationId;
+    bool m_isCorrupted;
+
+    int SetMap(const blksnap::sector_t sector, const blksnap::sector_t count, const unsigned char snapNumber,
+               std::vector<unsigned char>& map);
+};
@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "DiffArea.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <linux/blksnap.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ChunkShift.h"
+
+using blksnap::sector_t;
+
+static inline unsigned long long CountByShift(const sector_t capacity, const unsigned int shift)
+{
+    const sector_t chunkSectors = 1ULL << (shift - SECTOR_SHIFT);
+
+    return (capacity + chunkSectors - 1) / chunkSectors;
+}
+
+CModelDiffArea::CModelDiffArea(const SModelParams& params, const std::shared_ptr<CModelFile>& ptrOrig,
+                               const std::shared_ptr<CModelDiffStorage>& ptrDiffStorage,
+                               const std::shared_ptr<CModelEventQueue>& ptrEvents, const unsigned int devIdMj,
+                               const unsigned int devIdMn)
+    : m_params(params)
+    , m_ptrOrig(ptrOrig)
+    , m_ptrDiffStorage(ptrDiffStorage)
+    , m_ptrEvents(ptrEvents)
+    , m_devIdMj(devIdMj)
+    , m_devIdMn(devIdMn)
+    , m_capacity(ptrOrig->Size())
+    , m_isCorrupted(false)
+    , m_errorCode(0)
+{
+    memset(&m_stat, 0, sizeof(m_stat));
+    CalculateChunkSize();
+}
+
+void CModelDiffArea::CalculateChunkSize()
+{
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    unsigned int pageShift = SECTOR_SHIFT;
+    SChunkParams chunkParams;
+
+    while ((1L << pageShift) < pageSize)
+        pageShift++;
+
+    chunkParams.minimumShift = m_params.chunkMinimumShift;
+    chunkParams.maximumShift = m_params.chunkMaximumShift;
+    chunkParams.maximumCountShift = m_params.chunkMaximumCountShift;
+
+    m_chunkShift = ::ChunkShift(m_capacity, m_params.ioMinimum, pageShift, chunkParams);
+    m_chunkCount = static_cast<unsigned long>(CountByShift(m_capacity, m_chunkShift));
+}
+
+void CModelDiffArea::SetCorrupted(const int errorCode)
+{
+    struct blksnap_event_corrupted data;
+
+    if (m_isCorrupted)
+        return;
+
+    m_isCorrupted = true;
+    m_errorCode = errorCode;
+
+    data.dev_id_mj = m_devIdMj;
+    data.dev_id_mn = m_devIdMn;
+    data.err_code = std::abs(errorCode);
+    m_ptrEvents->Push(blksnap_event_code_corrupted, &data, sizeof(data));
+}
+
+int CModelDiffArea::Load(const unsigned long nr, SModelChunk& chunk)
+{
+    const sector_t count = ChunkSectorCount(nr);
+    int ret;
+
+    chunk.buffer.resize(count << SECTOR_SHIFT);
+    if (chunk.state == eChunkStored)
+        ret = chunk.location.file->Read(chunk.buffer.data(), chunk.buffer.size(), chunk.location.sector);
+    else
+        ret = m_ptrOrig->Read(chunk.buffer.data(), chunk.buffer.size(),
+                              static_cast<sector_t>(nr) << (m_chunkShift - SECTOR_SHIFT));
+    if (ret)
+    {
+        chunk.buffer.clear();
+        return ret;
+    }
+
+    if (chunk.state == eChunkNew)
+        m_stat.chunksCopied++;
+    chunk.state = eChunkInMemory;
+    return 0;
+}
+
+void CModelDiffArea::Store(const unsigned long nr)
+{
+    SModelChunk& chunk = m_chunkMap[nr];
+    int ret;
+
+    if (chunk.state != eChunkInMemory)
+        return;
+
+    if (m_isCorrupted)
+    {
+        chunk.state = eChunkFailed;
+        chunk.buffer.clear();
+        m_stat.chunksFailed++;
+        return;
+    }
+
+    if (!chunk.location.file)
+    {
+        ret = m_ptrDiffStorage->Alloc(ChunkSectors(), chunk.location);
+        if (ret)
+        {
+            chunk.state = eChunkFailed;
+            chunk.buffer.clear();
+            m_stat.chunksFailed++;
+            SetCorrupted(ret);
+            return;
+        }
+    }
+
+    ret = chunk.location.file->Write(chunk.buffer.data(), chunk.buffer.size(), chunk.location.sector);
+    chunk.buffer.clear();
+    if (ret)
+    {
+        chunk.state = eChunkFailed;
+        m_stat.chunksFailed++;
+        SetCorrupted(ret);
+        return;
+    }
+    chunk.state = eChunkStored;
+    m_stat.chunksStored++;
+}
+
+/*
+ * The chunk is added to the store queue. If the queue is too long, the oldest
+ * chunk is stored.
+ */
+void CModelDiffArea::Schedule(const unsigned long nr)
+{
+    if (std::find(m_storeQueue.begin(), m_storeQueue.end(), nr) == m_storeQueue.end())
+        m_storeQueue.push_back(nr);
+
+    while (m_storeQueue.size() > m_params.chunkMaximumInQueue)
+    {
+        unsigned long oldest = m_storeQueue.front();
+
+        m_storeQueue.pop_front();
+        Store(oldest);
+    }
+}
+
+int CModelDiffArea::Cow(const sector_t sector, const sector_t count)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    const unsigned long first = static_cast<unsigned long>(sector >> (m_chunkShift - SECTOR_SHIFT));
+    const unsigned long last = static_cast<unsigned long>((sector + count - 1) >> (m_chunkShift - SECTOR_SHIFT));
+
+    for (unsigned long nr = first; nr <= last; nr++)
+    {
+        if (m_isCorrupted)
+            return 0;
+        if (nr >= m_chunkCount)
+            return -EINVAL;
+
+        SModelChunk& chunk = m_chunkMap[nr];
+        if (chunk.state != eChunkNew)
+            continue;
+
+        int ret = Load(nr, chunk);
+        if (ret)
+        {
+            SetCorrupted(ret);
+            return ret;
+        }
+        Schedule(nr);
+    }
+    return 0;
+}
+
+int CModelDiffArea::ImageRead(void* buf, const sector_t sector, const sector_t count)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    unsigned char* p = static_cast<unsigned char*>(buf);
+    sector_t ofs = sector;
+    sector_t left = count;
+
+    if (m_isCorrupted)
+        return -EIO;
+
+    while (left)
+    {
+        const unsigned long nr = static_cast<unsigned long>(ofs >> (m_chunkShift - SECTOR_SHIFT));
+        const sector_t chunkOfs = ofs - (static_cast<sector_t>(nr) << (m_chunkShift - SECTOR_SHIFT));
+        const sector_t portion = std::min(left, ChunkSectors() - chunkOfs);
+        const size_t size = portion << SECTOR_SHIFT;
+        int ret = 0;
+
+        auto it = m_chunkMap.find(nr);
+        EModelChunkState state = (it == m_chunkMap.end()) ? eChunkNew : it->second.state;
+        switch (state)
+        {
+        case eChunkNew:
+            ret = m_ptrOrig->Read(p, size, ofs);
+            m_stat.imageUntouchedSectors += portion;
+            break;
+        case eChunkInMemory:
+            memcpy(p, it->second.buffer.data() + (chunkOfs << SECTOR_SHIFT), size);
+            m_stat.imageInMemorySectors += portion;
+            break;
+        case eChunkStored:
+            ret = it->second.location.file->Read(p, size, it->second.location.sector + chunkOfs);
+            m_stat.imageStoredSectors += portion;
+            break;
+        default:
+            ret = -EIO;
+        }
+        if (ret)
+            return ret;
+
+        p += size;
+        ofs += portion;
+        left -= portion;
+    }
+    return 0;
+}
+
+int CModelDiffArea::ImageWrite(const void* buf, const sector_t sector, const sector_t count)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    const unsigned char* p = static_cast<const unsigned char*>(buf);
+    sector_t ofs = sector;
+    sector_t left = count;
+
+    if (m_isCorrupted)
+        return -EIO;
+
+    while (left)
+    {
+        const unsigned long nr = static_cast<unsigned long>(ofs >> (m_chunkShift - SECTOR_SHIFT));
+        const sector_t chunkOfs = ofs - (static_cast<sector_t>(nr) << (m_chunkShift - SECTOR_SHIFT));
+        const sector_t portion = std::min(left, ChunkSectors() - chunkOfs);
+        const size_t size = portion << SECTOR_SHIFT;
+        SModelChunk& chunk = m_chunkMap[nr];
+        int ret = 0;
+
+        switch (chunk.state)
+        {
+        case eChunkNew:
+            /*
+             * The chunk is loaded from the original device, changed and
+             * then stored.
+             */
+            ret = Load(nr, chunk);
+            if (ret)
+                break;
+            memcpy(chunk.buffer.data() + (chunkOfs << SECTOR_SHIFT), p, size);
+            Schedule(nr);
+            break;
+        case eChunkInMemory:
+            memcpy(chunk.buffer.data() + (chunkOfs << SECTOR_SHIFT), p, size);
+            break;
+        case eChunkStored:
+            ret = chunk.location.file->Write(p, size, chunk.location.sector + chunkOfs);
+            break;
+        default:
+            ret = -EIO;
+        }
+        if (ret)
+            return ret;
+
+        p += size;
+        ofs += portion;
+        left -= portion;
+    }
+    return 0;
+}
+
+void CModelDiffArea::Flush()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    while (!m_storeQueue.empty())
+    {
+        unsigned long nr = m_storeQueue.front();
+
+        m_storeQueue.pop_front();
+        Store(nr);
+    }
+}
+
+bool CModelDiffArea::IsCorrupted()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_isCorrupted;
+}
+
+int CModelDiffArea::ErrorCode()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_errorCode;
+}
+
+EModelChunkState CModelDiffArea::ChunkState(const unsigned long nr)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto it = m_chunkMap.find(nr);
+
+    return (it == m_chunkMap.end()) ? eChunkNew : it->second.state;
+}
+
+CModelDiffArea::SStatistic CModelDiffArea::GetStatistic()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    SStatistic stat = m_stat;
+
+    stat.chunksInMemory = m_storeQueue.size();
+    return stat;
+}
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "DiffStorage.h"
+#include "EventQueue.h"
+#include "Params.h"
+
+/*
+ * The states of a chunk are the same as in the module.
+ */
+enum EModelChunkState
+{
+    eChunkNew,
+    eChunkInMemory,
+    eChunkStored,
+    eChunkFailed,
+};
+
+struct SModelChunk
+{
+    SModelChunk()
+        : state(eChunkNew) {};
+
+    EModelChunkState state;
+    SModelStorageLocation location;
+    std::vector<unsigned char> buffer;
+};
+
+/*
+ * The difference area of one original device. It implements the copy-on-write
+ * algorithm and the reading and writing of the snapshot image.
+ * The chunk map contains only the chunks that have been accessed. The chunk
+ * is loaded from the original device into memory and then it is stored to the
+ * difference storage.
+ */
+class CModelDiffArea
+{
+public:
+    CModelDiffArea(const SModelParams& params, const std::shared_ptr<CModelFile>& ptrOrig,
+                   const std::shared_ptr<CModelDiffStorage>& ptrDiffStorage,
+                   const std::shared_ptr<CModelEventQueue>& ptrEvents, const unsigned int devIdMj,
+                   const unsigned int devIdMn);
+
+    /*
+     * Copies the chunks of the range before the original device is
+     * overwritten.
+     */
+    int Cow(const blksnap::sector_t sector, const blksnap::sector_t count);
+    int ImageRead(void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+    int ImageWrite(const void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+    /*
+     * Stores all chunks from the store queue to the difference storage.
+     */
+    void Flush();
+
+    bool IsCorrupted();
+    int ErrorCode();
+    unsigned int ChunkShift() const
+    {
+        return m_chunkShift;
+    };
+    unsigned long ChunkCount() const
+    {
+        return m_chunkCount;
+    };
+    EModelChunkState ChunkState(const unsigned long nr);
+
+    struct SStatistic
+    {
+        unsigned long long chunksCopied;
+        unsigned long long chunksStored;
+        unsigned long long chunksFailed;
+        unsigned long long chunksInMemory;
+        unsigned long long imageUntouchedSectors;
+        unsigned long long imageInMemorySectors;
+        unsigned long long imageStoredSectors;
+    };
+    SStatistic GetStatistic();
+
+private:
+    SModelParams m_params;
+    std::shared_ptr<CModelFile> m_ptrOrig;
+    std::shared_ptr<CModelDiffStorage> m_ptrDiffStorage;
+    std::shared_ptr<CModelEventQueue> m_ptrEvents;
+    unsigned int m_devIdMj;
+    unsigned int m_devIdMn;
+    blksnap::sector_t m_capacity;
+    unsigned int m_chunkShift;
+    unsigned long m_chunkCount;
+
+    std::mutex m_lock;
+    std::unordered_map<unsigned long, SModelChunk> m_chunkMap;
+    std::deque<unsigned long> m_storeQueue;
+    bool m_isCorrupted;
+    int m_errorCode;
+    SStatistic m_stat;
+
+    blksnap::sector_t ChunkSectors() const
+    {
+        return 1ULL << (m_chunkShift - SECTOR_SHIFT);
+    };
+    blksnap::sector_t ChunkSectorCount(const unsigned long nr) const
+    {
+        return std::min(ChunkSectors(), m_capacity - (static_cast<blksnap::sector_t>(nr) << (m_chunkShift - SECTOR_SHIFT)));
+    };
+    void CalculateChunkSize();
+    int Load(const unsigned long nr, SModelChunk& chunk);
+    void Schedule(const unsigned long nr);
+    void Store(const unsigned long nr);
+    void SetCorrupted(const int errorCode);
+};
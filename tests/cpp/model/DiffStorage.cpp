@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "DiffStorage.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/blksnap.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using blksnap::sector_t;
+
+/*
+ * The beginning of the storage is not used, as the module does.
+ */
+static const sector_t diffStorageOffset = 4096;
+
+CModelFile::CModelFile(const std::string& path, const bool isTemp)
+    : m_path(path)
+    , m_fd(-1)
+{
+    if (isTemp)
+    {
+        std::string templ = path + "/blksnap_model_XXXXXX";
+
+        m_fd = ::mkstemp(&templ[0]);
+        if (m_fd >= 0)
+        {
+            ::unlink(templ.c_str());
+            m_path = templ;
+        }
+    }
+    else
+        m_fd = ::open(path.c_str(), O_RDWR | O_LARGEFILE);
+}
+
+CModelFile::~CModelFile()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+int CModelFile::Read(void* buf, const size_t size, const sector_t sector)
+{
+    ssize_t ret = ::pread(m_fd, buf, size, static_cast<off_t>(sector << SECTOR_SHIFT));
+
+    if (ret < 0)
+        return -errno;
+    if (static_cast<size_t>(ret) < size)
+        return -EIO;
+    return 0;
+}
+
+int CModelFile::Write(const void* buf, const size_t size, const sector_t sector)
+{
+    ssize_t ret = ::pwrite(m_fd, buf, size, static_cast<off_t>(sector << SECTOR_SHIFT));
+
+    if (ret < 0)
+        return -errno;
+    if (static_cast<size_t>(ret) < size)
+        return -ENOSPC;
+    return 0;
+}
+
+int CModelFile::Resize(const sector_t sectors)
+{
+    if (m_fd < 0)
+        return -EBADF;
+    if (::ftruncate(m_fd, static_cast<off_t>(sectors << SECTOR_SHIFT)))
+        return -errno;
+    return 0;
+}
+
+sector_t CModelFile::Size()
+{
+    struct stat st;
+
+    if ((m_fd < 0) || ::fstat(m_fd, &st))
+        return 0;
+    return static_cast<sector_t>(st.st_size) >> SECTOR_SHIFT;
+}
+
+CModelDiffStorage::CModelDiffStorage(const SModelParams& params, const std::shared_ptr<CModelEventQueue>& ptrEvents)
+    : m_params(params)
+    , m_ptrEvents(ptrEvents)
+    , m_isBlockDevice(false)
+    , m_filled(0)
+    , m_requested(0)
+    , m_capacity(0)
+    , m_limit(0)
+    , m_spare(0)
+    , m_lowSpaceFlag(0)
+    , m_overflowFlag(0)
+    , m_allocations(0)
+    , m_reallocations(0)
+    , m_switches(0)
+{}
+
+int CModelDiffStorage::Set(const std::string& path, const sector_t limit, const bool isBlockDevice)
+{
+    struct stat st;
+
+    if (::stat(path.c_str(), &st))
+        return -errno;
+
+    if (!S_ISREG(st.st_mode) && (isBlockDevice || !S_ISDIR(st.st_mode)))
+        return -EINVAL;
+
+    m_file = std::make_shared<CModelFile>(path, S_ISDIR(st.st_mode));
+    if (!m_file->IsOpen())
+        return -EIO;
+
+    m_isBlockDevice = isBlockDevice;
+    m_filled = diffStorageOffset;
+    m_capacity = m_file->Size();
+    m_requested = m_capacity;
+    m_limit = limit;
+
+    if (!IsHalffull(m_requested))
+        return 0;
+    if (m_capacity == m_limit)
+        return 0;
+    if (m_capacity > m_limit)
+        return -ENOSPC;
+
+    m_requested += std::min(m_params.diffStorageMinimum, m_limit - m_capacity);
+    if (m_isBlockDevice)
+        return 0;
+
+    int ret = m_file->Resize(m_requested);
+    if (ret)
+        return ret;
+    m_capacity = m_requested;
+    return 0;
+}
+
+int CModelDiffStorage::Append(const std::string& path)
+{
+    if (!m_isBlockDevice)
+        return -EINVAL;
+
+    SSpareDevice spare;
+    spare.file = std::make_shared<CModelFile>(path, false);
+    if (!spare.file->IsOpen())
+        return -EIO;
+    spare.capacity = spare.file->Size();
+    if (spare.capacity <= diffStorageOffset)
+        return -ENOSPC;
+
+    sector_t sectorsLeft;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_spareList.push_back(spare);
+        m_spare += spare.capacity - diffStorageOffset;
+        sectorsLeft = m_requested - m_filled + m_spare;
+    }
+    if (!IsHalffull(sectorsLeft))
+        m_lowSpaceFlag = 0;
+    return 0;
+}
+
+bool CModelDiffStorage::NextBlockDevice(const sector_t count)
+{
+    while (!m_spareList.empty())
+    {
+        SSpareDevice entry = m_spareList.front();
+
+        m_spareList.pop_front();
+        m_spare -= entry.capacity - diffStorageOffset;
+        m_usedList.push_back({m_file, m_capacity});
+
+        m_file = entry.file;
+        m_capacity = entry.capacity;
+        m_requested = entry.capacity;
+        m_filled = diffStorageOffset;
+        m_switches++;
+
+        if ((m_filled + count) <= m_requested)
+            return true;
+    }
+    return false;
+}
+
+bool CModelDiffStorage::CalculateRequested()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_capacity >= m_limit)
+        return false;
+
+    m_requested += std::min(m_params.diffStorageMinimum, m_limit - m_capacity);
+    return true;
+}
+
+/*
+ * The module increases the file in the worker thread. The model does it
+ * immediately, since the allocation is checked against the requested size
+ * and not against the capacity of the file.
+ */
+void CModelDiffStorage::Reallocate()
+{
+    sector_t requested;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        requested = m_requested;
+    }
+    if (m_file->Resize(requested))
+        return;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_capacity = requested;
+    m_reallocations++;
+    if (m_capacity >= m_requested)
+        m_lowSpaceFlag = 0;
+}
+
+void CModelDiffStorage::CheckHalffull(const sector_t sectorsLeft)
+{
+    if (!IsHalffull(sectorsLeft) || (++m_lowSpaceFlag != 1))
+        return;
+
+    if (m_isBlockDevice)
+    {
+        struct blksnap_event_low_space data;
+
+        data.free_nr_sect = sectorsLeft;
+        data.requested_nr_sect = m_params.diffStorageMinimum;
+        m_ptrEvents->Push(blksnap_event_code_low_space, &data, sizeof(data));
+        return;
+    }
+    if (!CalculateRequested())
+    {
+        struct blksnap_event_no_space data;
+
+        data.requested_nr_sect = m_requested;
+        m_ptrEvents->Push(blksnap_event_code_no_space, &data, sizeof(data));
+        return;
+    }
+    Reallocate();
+}
+
+int CModelDiffStorage::Alloc(const sector_t count, SModelStorageLocation& location)
+{
+    sector_t sectorsLeft;
+
+    if (m_overflowFlag)
+        return -ENOSPC;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        if (((m_filled + count) > m_requested) && !(m_isBlockDevice && NextBlockDevice(count)))
+        {
+            m_overflowFlag++;
+            return -ENOSPC;
+        }
+
+        location.file = m_file;
+        location.sector = m_filled;
+
+        m_filled += count;
+        m_allocations++;
+        sectorsLeft = m_requested - m_filled + m_spare;
+    }
+
+    CheckHalffull(sectorsLeft);
+    return 0;
+}
+
+CModelDiffStorage::SStatistic CModelDiffStorage::GetStatistic()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    SStatistic stat;
+
+    stat.filled = m_filled;
+    stat.requested = m_requested;
+    stat.capacity = m_capacity;
+    stat.limit = m_limit;
+    stat.spare = m_spare;
+    stat.allocations = m_allocations;
+    stat.reallocations = m_reallocations;
+    stat.switches = m_switches;
+    return stat;
+}
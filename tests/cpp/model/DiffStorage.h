@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EventQueue.h"
+#include "Params.h"
+
+/*
+ * The file that replaces a block device or a difference storage file.
+ * For the difference storage on a block device, the file has a fixed size,
+ * as a block device has.
+ */
+class CModelFile
+{
+public:
+    CModelFile(const std::string& path, const bool isTemp);
+    ~CModelFile();
+
+    int Read(void* buf, const size_t size, const blksnap::sector_t sector);
+    int Write(const void* buf, const size_t size, const blksnap::sector_t sector);
+    int Resize(const blksnap::sector_t sectors);
+    blksnap::sector_t Size();
+
+    bool IsOpen() const
+    {
+        return m_fd >= 0;
+    };
+    const std::string& Path() const
+    {
+        return m_path;
+    };
+
+private:
+    std::string m_path;
+    int m_fd;
+};
+
+/*
+ * The location of the chunk in the difference storage.
+ */
+struct SModelStorageLocation
+{
+    SModelStorageLocation()
+        : file(nullptr)
+        , sector(0) {};
+
+    std::shared_ptr<CModelFile> file;
+    blksnap::sector_t sector;
+};
+
+/*
+ * The difference storage repeats the allocation algorithm of the module.
+ * The storage in a file grows by the portions of diffStorageMinimum when the
+ * free space becomes less than half of a portion, until the limit is reached.
+ * The storage on a block device does not grow, but it generates the low_space
+ * event and can be extended by spare block devices.
+ * If the chunk cannot be allocated, the storage overflows and all following
+ * allocations fail with ENOSPC.
+ */
+class CModelDiffStorage
+{
+public:
+    CModelDiffStorage(const SModelParams& params, const std::shared_ptr<CModelEventQueue>& ptrEvents);
+
+    /*
+     * The path can be a directory, in which a temporary file is created, or a
+     * regular file. If isBlockDevice is set, the file is used as a block
+     * device and its size is not changed.
+     */
+    int Set(const std::string& path, const blksnap::sector_t limit, const bool isBlockDevice = false);
+    int Append(const std::string& path);
+    int Alloc(const blksnap::sector_t count, SModelStorageLocation& location);
+    bool IsOverflow() const
+    {
+        return !!m_overflowFlag;
+    };
+
+    struct SStatistic
+    {
+        blksnap::sector_t filled;
+        blksnap::sector_t requested;
+        blksnap::sector_t capacity;
+        blksnap::sector_t limit;
+        blksnap::sector_t spare;
+        unsigned long long allocations;
+        unsigned long long reallocations;
+        unsigned long long switches;
+    };
+    SStatistic GetStatistic();
+
+private:
+    struct SSpareDevice
+    {
+        std::shared_ptr<CModelFile> file;
+        blksnap::sector_t capacity;
+    };
+
+    SModelParams m_params;
+    std::shared_ptr<CModelEventQueue> m_ptrEvents;
+    std::mutex m_lock;
+    std::shared_ptr<CModelFile> m_file;
+    bool m_isBlockDevice;
+    std::list<SSpareDevice> m_spareList;
+    std::list<SSpareDevice> m_usedList;
+    blksnap::sector_t m_filled;
+    blksnap::sector_t m_requested;
+    blksnap::sector_t m_capacity;
+    blksnap::sector_t m_limit;
+    blksnap::sector_t m_spare;
+    std::atomic<int> m_lowSpaceFlag;
+    std::atomic<int> m_overflowFlag;
+    unsigned long long m_allocations;
+    unsigned long long m_reallocations;
+    unsigned long long m_switches;
+
+    bool IsHalffull(const blksnap::sector_t sectorsLeft) const
+    {
+        return sectorsLeft <= (m_params.diffStorageMinimum / 2);
+    };
+    void CheckHalffull(const blksnap::sector_t sectorsLeft);
+    bool CalculateRequested();
+    void Reallocate();
+    bool NextBlockDevice(const blksnap::sector_t count);
+};
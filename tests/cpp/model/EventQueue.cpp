@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "EventQueue.h"
+
+#include <chrono>
+
+void CModelEventQueue::Push(unsigned int code, const void* data, size_t size)
+{
+    SModelEvent ev;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+
+    ev.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count();
+    ev.code = code;
+    ev.data.assign(p, p + size);
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_events.push_back(std::move(ev));
+    }
+    m_cv.notify_one();
+}
+
+bool CModelEventQueue::Pop(SModelEvent& ev)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_events.empty())
+        return false;
+
+    ev = std::move(m_events.front());
+    m_events.pop_front();
+    return true;
+}
+
+bool CModelEventQueue::Wait(SModelEvent& ev, const unsigned int timeoutMs)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    if (!m_cv.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return !m_events.empty(); }))
+        return false;
+
+    ev = std::move(m_events.front());
+    m_events.pop_front();
+    return true;
+}
+
+size_t CModelEventQueue::Count()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_events.size();
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct SModelEvent
+{
+    long long time;
+    unsigned int code;
+    std::vector<unsigned char> data;
+};
+
+/*
+ * The queue of the snapshot events. The event codes and the data are the same
+ * as the module provides by the BLKSNAP_IOCTL_SNAPSHOT_WAIT_EVENT.
+ */
+class CModelEventQueue
+{
+public:
+    void Push(unsigned int code, const void* data, size_t size);
+    bool Pop(SModelEvent& ev);
+    /*
+     * Waits for the event no longer than the timeout, as the module does.
+     */
+    bool Wait(SModelEvent& ev, const unsigned int timeoutMs);
+    size_t Count();
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::deque<SModelEvent> m_events;
+};
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <blksnap/Sector.h>
+
+/*
+ * The userspace model of the blksnap module.
+ * The model repeats the algorithms of the kernel module: the change tracker,
+ * the copy-on-write of chunks and the allocation of the difference storage.
+ * The original devices and the difference storage are regular files. All
+ * requests are processed synchronously in the calling thread, so the model
+ * is not suitable for checking the locks of the module, but it allows to
+ * check the algorithms and to compare their parameters quickly.
+ *
+ * The parameters have the same meaning and the same default values as the
+ * parameters of the kernel module.
+ */
+struct SModelParams
+{
+    SModelParams()
+        : trackingBlockMinimumShift(16)
+        , trackingBlockMaximumShift(26)
+        , trackingBlockMaximumCount(2097152)
+        , chunkMinimumShift(18)
+        , chunkMaximumShift(26)
+        , chunkMaximumCountShift(40)
+        , chunkMaximumInQueue(256)
+        , diffStorageMinimum(2097152)
+        , ioMinimum(4096)
+    {};
+
+    unsigned int trackingBlockMinimumShift;
+    unsigned int trackingBlockMaximumShift;
+    unsigned int trackingBlockMaximumCount;
+    unsigned int chunkMinimumShift;
+    unsigned int chunkMaximumShift;
+    unsigned int chunkMaximumCountShift;
+    /*
+     * The chunks copied from the original device stay in memory until the
+     * number of them exceeds this value or the store queue is flushed.
+     * It emulates the asynchronous storing of chunks by the module.
+     */
+    unsigned int chunkMaximumInQueue;
+    // In sectors
+    blksnap::sector_t diffStorageMinimum;
+    // The minimal I/O size of the original device in bytes
+    unsigned int ioMinimum;
+
+    unsigned long long ChunkMaximumCount() const
+    {
+        return (chunkMaximumCountShift < 64) ? (1ULL << chunkMaximumCountShift) : ~0ULL;
+    };
+};
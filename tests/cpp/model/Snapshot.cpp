@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "Snapshot.h"
+
+#include <errno.h>
+
+using blksnap::sector_t;
+
+CModelSnapshot::CModelSnapshot(const SModelParams& params)
+    : m_params(params)
+    , m_ptrEvents(std::make_shared<CModelEventQueue>())
+    , m_isTaken(false)
+{
+    uuid_generate(m_id);
+    m_ptrDiffStorage = std::make_shared<CModelDiffStorage>(m_params, m_ptrEvents);
+}
+
+CModelSnapshot::~CModelSnapshot()
+{
+    Destroy();
+}
+
+int CModelSnapshot::SetDiffStorage(const std::string& path, const sector_t limit, const bool isBlockDevice)
+{
+    if (m_isTaken)
+        return -EALREADY;
+    return m_ptrDiffStorage->Set(path, limit, isBlockDevice);
+}
+
+int CModelSnapshot::AppendStorage(const std::string& path)
+{
+    return m_ptrDiffStorage->Append(path);
+}
+
+int CModelSnapshot::AddDevice(const std::shared_ptr<CModelTracker>& ptrTracker)
+{
+    if (m_isTaken)
+        return -EALREADY;
+
+    for (const auto& ptr : m_trackers)
+        if (ptr == ptrTracker)
+            return -EALREADY;
+
+    if (!ptrTracker->AcquireSnapshot())
+        return -EBUSY;
+    m_trackers.push_back(ptrTracker);
+    return 0;
+}
+
+int CModelSnapshot::Take()
+{
+    if (m_isTaken)
+        return -EALREADY;
+    if (m_trackers.empty())
+        return -ENODEV;
+
+    for (const auto& ptrTracker : m_trackers)
+        ptrTracker->TakeSnapshot(std::make_shared<CModelDiffArea>(
+            m_params, ptrTracker->Original(), m_ptrDiffStorage, m_ptrEvents, ptrTracker->DevIdMj(),
+            ptrTracker->DevIdMn()));
+
+    m_isTaken = true;
+    return 0;
+}
+
+void CModelSnapshot::Destroy()
+{
+    for (const auto& ptrTracker : m_trackers)
+        ptrTracker->ReleaseSnapshot();
+    m_trackers.clear();
+    m_isTaken = false;
+}
+
+int CModelSnapshot::WaitEvent(SModelEvent& ev, const unsigned int timeoutMs)
+{
+    if (!(timeoutMs ? m_ptrEvents->Wait(ev, timeoutMs) : m_ptrEvents->Pop(ev)))
+        return -ENOENT;
+    return 0;
+}
+
+void CModelSnapshot::Flush()
+{
+    for (const auto& ptrTracker : m_trackers)
+    {
+        auto ptrDiffArea = ptrTracker->DiffArea();
+
+        if (ptrDiffArea)
+            ptrDiffArea->Flush();
+    }
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <uuid/uuid.h>
+#include "DiffStorage.h"
+#include "EventQueue.h"
+#include "Tracker.h"
+
+/*
+ * The snapshot of several original devices with the common difference
+ * storage. The methods return a negative error code, as the ioctls of the
+ * module do.
+ */
+class CModelSnapshot
+{
+public:
+    CModelSnapshot(const SModelParams& params);
+    ~CModelSnapshot();
+
+    const uuid_t& Id() const
+    {
+        return m_id;
+    };
+
+    int SetDiffStorage(const std::string& path, const blksnap::sector_t limit, const bool isBlockDevice = false);
+    int AppendStorage(const std::string& path);
+    /*
+     * The device cannot be added to the snapshot if it is already in another
+     * snapshot.
+     */
+    int AddDevice(const std::shared_ptr<CModelTracker>& ptrTracker);
+    int Take();
+    void Destroy();
+    /*
+     * By default, the model does not wait for an event. If the queue is
+     * still empty after the timeout, -ENOENT is returned.
+     */
+    int WaitEvent(SModelEvent& ev, const unsigned int timeoutMs = 0);
+    /*
+     * Stores all chunks from the store queues of the difference areas.
+     */
+    void Flush();
+
+    bool IsTaken() const
+    {
+        return m_isTaken;
+    };
+    const std::shared_ptr<CModelDiffStorage>& DiffStorage() const
+    {
+        return m_ptrDiffStorage;
+    };
+    const std::shared_ptr<CModelEventQueue>& Events() const
+    {
+        return m_ptrEvents;
+    };
+    const std::vector<std::shared_ptr<CModelTracker>>& Trackers() const
+    {
+        return m_trackers;
+    };
+
+private:
+    SModelParams m_params;
+    uuid_t m_id;
+    std::shared_ptr<CModelEventQueue> m_ptrEvents;
+    std::shared_ptr<CModelDiffStorage> m_ptrDiffStorage;
+    std::vector<std::shared_ptr<CModelTracker>> m_trackers;
+    bool m_isTaken;
+};
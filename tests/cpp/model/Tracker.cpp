@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include "Tracker.h"
+
+#include <errno.h>
+#include <stdexcept>
+
+using blksnap::sector_t;
+
+CModelTracker::CModelTracker(const SModelParams& params, const std::string& path, const unsigned int devIdMj,
+                             const unsigned int devIdMn)
+    : m_params(params)
+    , m_ptrOrig(std::make_shared<CModelFile>(path, false))
+    , m_devIdMj(devIdMj)
+    , m_devIdMn(devIdMn)
+    , m_isInSnapshot(false)
+{
+    if (!m_ptrOrig->IsOpen())
+        throw std::runtime_error("Failed to open file '" + path + "'");
+
+    m_ptrCbtMap = std::make_shared<CModelCbtMap>(m_params, m_ptrOrig->Size());
+}
+
+int CModelTracker::Write(const void* buf, const sector_t sector, const sector_t count)
+{
+    std::shared_ptr<CModelCbtMap> ptrCbtMap;
+    std::shared_ptr<CModelDiffArea> ptrDiffArea;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        ptrCbtMap = m_ptrCbtMap;
+        ptrDiffArea = m_ptrDiffArea;
+    }
+
+    /*
+     * A failure of the change tracking marks the map as corrupted, but the
+     * write request is not rejected.
+     */
+    ptrCbtMap->Set(sector, count);
+
+    if (ptrDiffArea && !ptrDiffArea->IsCorrupted())
+        ptrDiffArea->Cow(sector, count);
+
+    return m_ptrOrig->Write(buf, count << SECTOR_SHIFT, sector);
+}
+
+int CModelTracker::Read(void* buf, const sector_t sector, const sector_t count)
+{
+    return m_ptrOrig->Read(buf, count << SECTOR_SHIFT, sector);
+}
+
+int CModelTracker::MarkDirty(const sector_t sector, const sector_t count)
+{
+    return CbtMap()->SetBoth(sector, count);
+}
+
+int CModelTracker::ImageRead(void* buf, const sector_t sector, const sector_t count)
+{
+    std::shared_ptr<CModelDiffArea> ptrDiffArea = DiffArea();
+
+    if (!ptrDiffArea)
+        return -ENODEV;
+    return ptrDiffArea->ImageRead(buf, sector, count);
+}
+
+int CModelTracker::ImageWrite(const void* buf, const sector_t sector, const sector_t count)
+{
+    std::shared_ptr<CModelDiffArea> ptrDiffArea = DiffArea();
+
+    if (!ptrDiffArea)
+        return -ENODEV;
+
+    int ret = ptrDiffArea->ImageWrite(buf, sector, count);
+    if (ret)
+        return ret;
+
+    CbtMap()->SetBoth(sector, count);
+    return 0;
+}
+
+void CModelTracker::TakeSnapshot(const std::shared_ptr<CModelDiffArea>& ptrDiffArea)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    const sector_t capacity = m_ptrOrig->Size();
+
+    if (m_ptrCbtMap->IsCorrupted() || (m_ptrCbtMap->Capacity() != capacity))
+        m_ptrCbtMap = std::make_shared<CModelCbtMap>(m_params, capacity);
+
+    m_ptrCbtMap->Switch();
+    m_ptrDiffArea = ptrDiffArea;
+}
+
+bool CModelTracker::AcquireSnapshot()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_isInSnapshot)
+        return false;
+    m_isInSnapshot = true;
+    return true;
+}
+
+void CModelTracker::ReleaseSnapshot()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_ptrDiffArea.reset();
+    m_isInSnapshot = false;
+}
+
+std::shared_ptr<CModelCbtMap> CModelTracker::CbtMap()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_ptrCbtMap;
+}
+
+std::shared_ptr<CModelDiffArea> CModelTracker::DiffArea()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    return m_ptrDiffArea;
+}
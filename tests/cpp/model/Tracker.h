@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include "CbtMap.h"
+#include "DiffArea.h"
+
+/*
+ * The tracker of the original device. It marks the changed blocks in the
+ * change tracking map and, while the snapshot is taken, it copies the
+ * overwritten chunks to the difference area before writing to the device.
+ */
+class CModelTracker
+{
+public:
+    CModelTracker(const SModelParams& params, const std::string& path, const unsigned int devIdMj,
+                  const unsigned int devIdMn);
+
+    int Write(const void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+    int Read(void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+    /*
+     * Marks the blocks as changed in the current and in the previous
+     * snapshot, as the BLKFILTER_CTL_BLKSNAP_MARKDIRTY command does.
+     */
+    int MarkDirty(const blksnap::sector_t sector, const blksnap::sector_t count);
+
+    int ImageRead(void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+    int ImageWrite(const void* buf, const blksnap::sector_t sector, const blksnap::sector_t count);
+
+    /*
+     * The change tracking map is reset if it is corrupted or if the size of
+     * the original device has been changed.
+     */
+    void TakeSnapshot(const std::shared_ptr<CModelDiffArea>& ptrDiffArea);
+    void ReleaseSnapshot();
+    /*
+     * The device can be a part of only one snapshot, even if the snapshot
+     * has not been taken yet.
+     */
+    bool AcquireSnapshot();
+
+    const std::shared_ptr<CModelFile>& Original() const
+    {
+        return m_ptrOrig;
+    };
+    std::shared_ptr<CModelCbtMap> CbtMap();
+    std::shared_ptr<CModelDiffArea> DiffArea();
+    unsigned int DevIdMj() const
+    {
+        return m_devIdMj;
+    };
+    unsigned int DevIdMn() const
+    {
+        return m_devIdMn;
+    };
+
+private:
+    SModelParams m_params;
+    std::shared_ptr<CModelFile> m_ptrOrig;
+    unsigned int m_devIdMj;
+    unsigned int m_devIdMn;
+
+    std::mutex m_lock;
+    std::shared_ptr<CModelCbtMap> m_ptrCbtMap;
+    std::shared_ptr<CModelDiffArea> m_ptrDiffArea;
+    bool m_isInSnapshot;
+};
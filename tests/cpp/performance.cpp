@@ -1,16 +1,31 @@
 // SPDX-License-Identifier: GPL-2.0+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <blksnap/Service.h>
 #include <blksnap/Session.h>
+#include <blksnap/Tracker.h>
 #include <boost/program_options.hpp>
 #include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
 #include <unistd.h>
 
 #include "helpers/AlignedBuffer.hpp"
 #include "helpers/BlockDevice.h"
+#include "helpers/LatencyHistogram.hpp"
 #include "helpers/Log.h"
 #include "helpers/RandomHelper.h"
 #include "TestSector.h"
@@ -19,13 +34,455 @@ namespace po = boost::program_options;
 using blksnap::sector_t;
 using blksnap::SRange;
 
-void CheckPerformance(const std::string& device, const std::string& diffStorage)
+struct SPerfParams
+{
+    size_t blockSize;
+    unsigned int queueDepth;
+    unsigned int threads;
+    bool isRandom;
+    unsigned int duration;
+};
+
+struct SPhaseResult
+{
+    SPhaseResult(const std::string& inName)
+        : name(inName)
+        , seconds(0)
+        , bytes(0)
+        , diffStorageBytes(0)
+    {};
+
+    std::string name;
+    double seconds;
+    uint64_t bytes;
+    CLatencyHistogram latency;
+    /*
+     * The size of the difference storage file that was allocated while
+     * the test was being executed.
+     */
+    uint64_t diffStorageBytes;
+};
+
+static inline int AioSetup(unsigned int nr, aio_context_t* ctx)
+{
+    return ::syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline int AioDestroy(aio_context_t ctx)
+{
+    return ::syscall(__NR_io_destroy, ctx);
+}
+
+static inline int AioSubmit(aio_context_t ctx, long nr, struct iocb** iocbpp)
+{
+    return ::syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int AioGetEvents(aio_context_t ctx, long min_nr, long max_nr, struct io_event* events)
+{
+    return ::syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, nullptr);
+}
+
+static uint64_t ParseSize(std::string str)
+{
+    uint64_t multiple = 1;
+
+    switch (str.back())
+    {
+    case 'G':
+        multiple *= 1024;
+    case 'M':
+        multiple *= 1024;
+    case 'K':
+        multiple *= 1024;
+        str.pop_back();
+    default:
+        return std::stoull(str) * multiple;
+    }
+}
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Each writer thread has its own AIO context and keeps the queueDepth
+ * requests in flight. The latency of the request is the time from its
+ * submission to its completion.
+ */
+static void Writer(int fd, off_t deviceSize, const SPerfParams& params, unsigned int inx,
+                   const std::atomic<bool>& stop, CLatencyHistogram& latency, uint64_t& bytes,
+                   std::exception_ptr& error)
+{
+    aio_context_t ctx = 0;
+    // The counter is kept on the stack of the thread to avoid false sharing
+    // of the cache line with the counters of other threads.
+    uint64_t writtenBytes = 0;
+
+    try
+    {
+        const off_t blockCount = deviceSize / params.blockSize;
+        const off_t areaSize = blockCount / params.threads;
+        const off_t areaBegin = areaSize * inx;
+        off_t nextBlock = 0;
+        CRandom rnd(CRandomHelper::Seed(), inx + 1);
+
+        AlignedBuffer<unsigned char> buf(SECTOR_SIZE, params.blockSize * params.queueDepth);
+        CRandomHelper::GenerateBuffer(buf.Data(), buf.Size());
+
+        std::vector<struct iocb> iocbs(params.queueDepth);
+        std::vector<uint64_t> started(params.queueDepth);
+        std::vector<struct io_event> events(params.queueDepth);
+        unsigned int inflight = 0;
+
+        if (AioSetup(params.queueDepth, &ctx) < 0)
+            throw std::system_error(errno, std::generic_category(), "Failed to setup AIO context.");
+
+        auto submit = [&](unsigned int slot) {
+            off_t block;
+            struct iocb* cb = &iocbs[slot];
+
+            if (params.isRandom)
+                block = static_cast<off_t>(rnd.Uniform(blockCount));
+            else
+            {
+                block = areaBegin + nextBlock;
+                nextBlock = (nextBlock + 1) % areaSize;
+            }
+
+            memset(cb, 0, sizeof(struct iocb));
+            cb->aio_data = slot;
+            cb->aio_lio_opcode = IOCB_CMD_PWRITE;
+            cb->aio_fildes = fd;
+            cb->aio_buf = reinterpret_cast<uint64_t>(buf.Data() + slot * params.blockSize);
+            cb->aio_nbytes = params.blockSize;
+            cb->aio_offset = block * params.blockSize;
+
+            started[slot] = NowNs();
+            if (AioSubmit(ctx, 1, &cb) != 1)
+                throw std::system_error(errno, std::generic_category(), "Failed to submit AIO request.");
+            inflight++;
+        };
+
+        for (unsigned int slot = 0; slot < params.queueDepth; slot++)
+            submit(slot);
+
+        while (inflight)
+        {
+            int ret = AioGetEvents(ctx, 1, params.queueDepth, events.data());
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Failed to get AIO events.");
+            }
+
+            const uint64_t completed = NowNs();
+            for (int eventInx = 0; eventInx < ret; eventInx++)
+            {
+                const unsigned int slot = static_cast<unsigned int>(events[eventInx].data);
+
+                inflight--;
+                if (events[eventInx].res < 0)
+                    throw std::system_error(static_cast<int>(-events[eventInx].res), std::generic_category(),
+                                            "Failed to write to the device.");
+
+                latency.Add(completed - started[slot]);
+                writtenBytes += events[eventInx].res;
+
+                if (!stop)
+                    submit(slot);
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        logger.Err(ex.what());
+        error = std::current_exception();
+    }
+
+    if (ctx)
+        AioDestroy(ctx);
+    bytes = writtenBytes;
+}
+
+static void RunPhase(const std::string& device, const SPerfParams& params, SPhaseResult& result,
+                     const std::string& diffStorageFile = std::string())
+{
+    int fd = ::open(device.c_str(), O_RDWR | O_DIRECT);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "Failed to open device [" + device + "].");
+
+    off_t deviceSize = 0;
+    if (::ioctl(fd, BLKGETSIZE64, &deviceSize) < 0)
+    {
+        int err = errno;
+
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "Failed to get size of the device [" + device + "].");
+    }
+    // Each thread writes to its own area of the device with at least one block
+    if (!params.threads || (static_cast<uint64_t>(deviceSize / params.blockSize) < params.threads))
+    {
+        ::close(fd);
+        throw std::invalid_argument("The device [" + device + "] is too small for "
+                                    + std::to_string(params.threads) + " threads with the block size "
+                                    + std::to_string(params.blockSize) + " bytes.");
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<CLatencyHistogram> latencies(params.threads);
+    std::vector<uint64_t> bytes(params.threads, 0);
+    std::vector<std::exception_ptr> errors(params.threads);
+    std::vector<std::thread> threads;
+    struct stat st;
+    uint64_t diffStorageStart = 0;
+
+    if (!diffStorageFile.empty() && !::stat(diffStorageFile.c_str(), &st))
+        diffStorageStart = st.st_blocks * 512ull;
+
+    logger.Info("Phase [" + result.name + "] started");
+    const uint64_t startNs = NowNs();
+    for (unsigned int inx = 0; inx < params.threads; inx++)
+        threads.emplace_back(Writer, fd, deviceSize, std::cref(params), inx, std::cref(stop),
+                             std::ref(latencies[inx]), std::ref(bytes[inx]), std::ref(errors[inx]));
+
+    ::sleep(params.duration);
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    result.seconds = (NowNs() - startNs) / 1000000000.0;
+    ::close(fd);
+
+    for (unsigned int inx = 0; inx < params.threads; inx++)
+    {
+        if (errors[inx])
+            std::rethrow_exception(errors[inx]);
+
+        result.latency.Merge(latencies[inx]);
+        result.bytes += bytes[inx];
+    }
+
+    if (!diffStorageFile.empty() && !::stat(diffStorageFile.c_str(), &st))
+        result.diffStorageBytes = st.st_blocks * 512ull - diffStorageStart;
+}
+
+static void LogResult(const SPhaseResult& result)
+{
+    std::stringstream ss;
+
+    ss << "Phase [" << result.name << "]: "
+       << static_cast<uint64_t>(result.latency.Count() / result.seconds) << " IOPS, "
+       << (result.bytes / result.seconds / (1024 * 1024)) << " MiB/s, latency us: "
+       << "mean=" << result.latency.Mean() / 1000 << " "
+       << "p50=" << result.latency.Percentile(50) / 1000 << " "
+       << "p99=" << result.latency.Percentile(99) / 1000 << " "
+       << "p999=" << result.latency.Percentile(99.9) / 1000 << " "
+       << "max=" << result.latency.Max() / 1000;
+    if (result.diffStorageBytes)
+        ss << ", diff storage " << (result.diffStorageBytes / result.seconds / (1024 * 1024)) << " MiB/s";
+    logger.Info(ss);
+}
+
+static void JsonResult(std::ostream& out, const SPhaseResult& result)
+{
+    out << "        {" << std::endl
+        << "          \"phase\": \"" << result.name << "\"," << std::endl
+        << "          \"seconds\": " << result.seconds << "," << std::endl
+        << "          \"ios\": " << result.latency.Count() << "," << std::endl
+        << "          \"bytes\": " << result.bytes << "," << std::endl
+        << "          \"iops\": " << (result.latency.Count() / result.seconds) << "," << std::endl
+        << "          \"mbps\": " << (result.bytes / result.seconds / (1024 * 1024)) << "," << std::endl
+        << "          \"lat_ns\": {" << std::endl
+        << "            \"mean\": " << result.latency.Mean() << "," << std::endl
+        << "            \"p50\": " << result.latency.Percentile(50) << "," << std::endl
+        << "            \"p99\": " << result.latency.Percentile(99) << "," << std::endl
+        << "            \"p999\": " << result.latency.Percentile(99.9) << "," << std::endl
+        << "            \"max\": " << result.latency.Max() << std::endl
+        << "          }," << std::endl
+        << "          \"diff_storage_bytes\": " << result.diffStorageBytes << "," << std::endl
+        << "          \"diff_storage_mbps\": " << (result.diffStorageBytes / result.seconds / (1024 * 1024)) << std::endl
+        << "        }";
+}
+
+/*
+ * The results of the three phases for one block size and number of threads.
+ */
+struct SRunResult
+{
+    SRunResult(const size_t inBlockSize, const unsigned int inThreads)
+        : blockSize(inBlockSize)
+        , threads(inThreads)
+    {};
+
+    size_t blockSize;
+    unsigned int threads;
+    std::vector<SPhaseResult> phases;
+};
+
+/*
+ * The same workload is performed in three phases:
+ * - original. The filter is detached, the writes go directly to the device.
+ * - tracked. The filter is attached. Each write only marks the blocks in the
+ *   change tracking map.
+ * - snapshot. The snapshot is taken. The first write to a chunk copies it to
+ *   the difference storage.
+ * The snapshot is created for each run, so that the chunks copied by the
+ * previous run do not reduce the cost of the COW.
+ */
+static bool RunPhases(const std::string& device, const std::string& diffStorage,
+                      const unsigned long long diffStorageLimit, const SPerfParams& params, SRunResult& run)
 {
     bool isErrorFound = false;
+    std::error_code ec;
+
+    logger.Info("-- Block size " + std::to_string(params.blockSize) + " bytes, threads "
+                + std::to_string(params.threads));
+
+    /*
+     * The filter may have been attached by the previous run or before the
+     * test, so the error of detaching is not checked.
+     */
+    blksnap::CTracker(device).Detach(ec);
+    run.phases.emplace_back("original");
+    RunPhase(device, params, run.phases.back());
+    LogResult(run.phases.back());
+
+    blksnap::CTracker(device).Attach();
+    run.phases.emplace_back("tracked");
+    RunPhase(device, params, run.phases.back());
+    LogResult(run.phases.back());
+
+    /*
+     * A regular file is used for the difference storage, so that its
+     * allocated size can be checked. The kernel module allocates the file
+     * space in portions as the storage is filled.
+     */
+    const std::string diffStorageFile = diffStorage + "/diff_storage_performance";
+    {
+        ::unlink(diffStorageFile.c_str());
+        int fd = ::open(diffStorageFile.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to create file [" + diffStorageFile + "].");
+        ::close(fd);
+    }
+
+    {
+        std::vector<std::string> devices;
+        devices.push_back(device);
+
+        logger.Info("Create snapshot");
+        auto ptrSession = blksnap::ISession::Create(devices, diffStorageFile, diffStorageLimit);
+
+        run.phases.emplace_back("snapshot");
+        RunPhase(device, params, run.phases.back(), diffStorageFile);
+        LogResult(run.phases.back());
+
+        std::string errorMessage;
+        while (ptrSession->GetError(errorMessage))
+        {
+            isErrorFound = true;
+            logger.Err(errorMessage);
+        }
+
+        logger.Info("Destroy snapshot");
+        ptrSession.reset();
+    }
+    ::unlink(diffStorageFile.c_str());
+
+    return isErrorFound;
+}
+
+static void LogSummary(const std::vector<SRunResult>& runs)
+{
+    logger.Info("Summary: IOPS and p99 latency relative to the original phase");
+    logger.Info("block_size threads phase        IOPS      p99_us  IOPS_%  p99_x");
+    for (const SRunResult& run : runs)
+    {
+        const SPhaseResult& original = run.phases.front();
+
+        for (const SPhaseResult& phase : run.phases)
+        {
+            std::stringstream ss;
+            const double iops = phase.latency.Count() / phase.seconds;
+            const double originalIops = original.latency.Count() / original.seconds;
+
+            ss << std::setw(10) << run.blockSize << " " << std::setw(7) << run.threads << " " << std::left
+               << std::setw(8) << phase.name << std::right << " " << std::setw(11) << static_cast<uint64_t>(iops)
+               << " " << std::setw(11) << phase.latency.Percentile(99) / 1000 << " " << std::setw(7)
+               << std::fixed << std::setprecision(1) << (originalIops ? 100.0 * iops / originalIops : 0) << " "
+               << std::setw(6) << std::setprecision(2)
+               << static_cast<double>(phase.latency.Percentile(99))
+                    / std::max(original.latency.Percentile(99), static_cast<uint64_t>(1));
+            logger.Info(ss);
+        }
+    }
+}
+
+void CheckPerformance(const std::string& device, const std::string& diffStorage,
+                      const unsigned long long diffStorageLimit, const SPerfParams& commonParams,
+                      const std::vector<size_t>& blockSizes, const std::vector<unsigned int>& threads,
+                      const std::string& jsonFile)
+{
+    bool isErrorFound = false;
+    std::vector<SRunResult> runs;
 
     logger.Info("--- Test: check performance ---");
+    logger.Info("device: " + device);
+    logger.Info("queue depth: " + std::to_string(commonParams.queueDepth));
+    logger.Info(std::string("pattern: ") + (commonParams.isRandom ? "random" : "sequential"));
+
+    for (size_t blockSize : blockSizes)
+    {
+        for (unsigned int threadCount : threads)
+        {
+            SPerfParams params = commonParams;
+
+            params.blockSize = blockSize;
+            params.threads = threadCount;
+            runs.emplace_back(blockSize, threadCount);
+            if (RunPhases(device, diffStorage, diffStorageLimit, params, runs.back()))
+                isErrorFound = true;
+        }
+    }
 
-    throw std::runtime_error("Is not implemented yet.");
+    LogSummary(runs);
+
+    if (!jsonFile.empty())
+    {
+        std::ofstream file;
+        if (jsonFile != "-")
+            file.open(jsonFile);
+        std::ostream& out = (jsonFile == "-") ? std::cout : file;
+
+        out << "{" << std::endl
+            << "  \"device\": \"" << device << "\"," << std::endl
+            << "  \"queue_depth\": " << commonParams.queueDepth << "," << std::endl
+            << "  \"pattern\": \"" << (commonParams.isRandom ? "random" : "sequential") << "\"," << std::endl
+            << "  \"duration\": " << commonParams.duration << "," << std::endl
+            << "  \"runs\": [" << std::endl;
+        for (size_t runInx = 0; runInx < runs.size(); runInx++)
+        {
+            const SRunResult& run = runs[runInx];
+
+            out << "    {" << std::endl
+                << "      \"block_size\": " << run.blockSize << "," << std::endl
+                << "      \"threads\": " << run.threads << "," << std::endl
+                << "      \"phases\": [" << std::endl;
+            for (size_t inx = 0; inx < run.phases.size(); inx++)
+            {
+                JsonResult(out, run.phases[inx]);
+                out << ((inx + 1 < run.phases.size()) ? "," : "") << std::endl;
+            }
+            out << "      ]" << std::endl
+                << "    }" << ((runInx + 1 < runs.size()) ? "," : "") << std::endl;
+        }
+        out << "  ]" << std::endl
+            << "}" << std::endl;
+    }
 
     if (isErrorFound)
         throw std::runtime_error("--- Failed: check performance ---");
@@ -43,7 +500,19 @@ void Main(int argc, char* argv[])
         ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
         ("device,d", po::value<std::string>(), "Device name. ")
         ("diff_storage,s", po::value<std::string>(),
-            "Directory name for allocating diff storage files.");
+            "Directory name for allocating diff storage files.")
+        ("diff_storage_limit,L", po::value<std::string>()->default_value("1G"),
+            "The available limit for the size of the difference storage file. The suffixes M, K and G is allowed.")
+        ("block_size,b", po::value<std::vector<std::string>>()->multitoken()->default_value({"4K"}, "4K"),
+            "The sizes of the write request. The suffixes M and K is allowed. It's multitoken argument.")
+        ("queue_depth,q", po::value<unsigned int>()->default_value(1), "The number of requests in flight for each thread.")
+        ("threads,t", po::value<std::vector<unsigned int>>()->multitoken()->default_value({1}, "1"),
+            "The numbers of writing threads. It's multitoken argument.")
+        ("sweep", "Run all combinations of the block sizes 4K, 16K, 64K, 256K, 1M and of 1, 4, 16, 64 threads.")
+        ("pattern,p", po::value<std::string>()->default_value("random"), "The writing pattern: 'random' or 'sequential'.")
+        ("duration,u", po::value<unsigned int>()->default_value(30), "The duration of each phase in seconds.")
+        ("json,j", po::value<std::string>(), "The file name for the results in JSON format. '-' means standard output.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to repeat a run.");
     po::variables_map vm;
     po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
     po::store(parsed, vm);
@@ -70,8 +539,48 @@ void Main(int argc, char* argv[])
         throw std::invalid_argument("Argument 'diff_storage' is missed.");
     std::string diffStorage = vm["diff_storage"].as<std::string>();
 
-    std::srand(std::time(0));
-    CheckPerformance(origDevName, diffStorage);
+    unsigned long long diffStorageLimit = ParseSize(vm["diff_storage_limit"].as<std::string>());
+
+    std::vector<size_t> blockSizes;
+    std::vector<unsigned int> threads;
+    if (vm.count("sweep"))
+    {
+        blockSizes = {4096, 16384, 65536, 262144, 1048576};
+        threads = {1, 4, 16, 64};
+    }
+    else
+    {
+        for (const std::string& blockSize : vm["block_size"].as<std::vector<std::string>>())
+            blockSizes.push_back(ParseSize(blockSize));
+        for (unsigned int threadCount : vm["threads"].as<std::vector<unsigned int>>())
+            threads.push_back(std::max(threadCount, 1u));
+    }
+    for (size_t blockSize : blockSizes)
+        if (!blockSize || (blockSize % SECTOR_SIZE))
+            throw std::invalid_argument("Argument 'block_size' should be a multiple of the sector size.");
+
+    SPerfParams params;
+    params.blockSize = 0;
+    params.threads = 0;
+    params.queueDepth = std::max(vm["queue_depth"].as<unsigned int>(), 1u);
+    params.duration = std::max(vm["duration"].as<unsigned int>(), 1u);
+
+    std::string pattern = vm["pattern"].as<std::string>();
+    if (pattern == "random")
+        params.isRandom = true;
+    else if (pattern == "sequential")
+        params.isRandom = false;
+    else
+        throw std::invalid_argument("Value '" + pattern + "' for argument 'pattern' is not supported.");
+
+    std::string jsonFile;
+    if (vm.count("json"))
+        jsonFile = vm["json"].as<std::string>();
+
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+
+    CheckPerformance(origDevName, diffStorage, diffStorageLimit, params, blockSizes, threads, jsonFile);
 }
 
 int main(int argc, char* argv[])
@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <blksnap/Cbt.h>
+#include <blksnap/Service.h>
+#include <blksnap/Session.h>
+#include <boost/program_options.hpp>
+#include <errno.h>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helpers/AlignedBuffer.hpp"
+#include "helpers/BlockDevice.h"
+#include "helpers/LatencyHistogram.hpp"
+#include "helpers/Log.h"
+#include "helpers/RandomHelper.h"
+#include "TestSector.h"
+
+namespace po = boost::program_options;
+using blksnap::sector_t;
+using blksnap::SRange;
+
+/*
+ * The snapshot image reads are divided into classes by the state of the chunk
+ * that is being read.
+ * The chunks that have not been changed since the snapshot was taken are read
+ * from the original device. The chunks that have just been copied by the COW
+ * algorithm are still in memory. The others are read from the difference
+ * storage.
+ */
+enum EChunkClass
+{
+    eChunkUntouched = 0,
+    eChunkInMemory,
+    eChunkStored,
+    eChunkClassCount
+};
+
+static const char* chunkClassName[eChunkClassCount] = {"untouched", "in_memory", "stored"};
+
+struct SReadParams
+{
+    size_t blockSize;
+    off_t chunkSize;
+    off_t area;
+    unsigned int storedPercent;
+    unsigned int count;
+    unsigned int settle;
+    int cbtBase;
+    std::vector<std::string> modes;
+};
+
+struct SModeResult
+{
+    SModeResult(const std::string& inName)
+        : name(inName)
+        , seconds(0)
+        , bytes(0)
+    {};
+
+    std::string name;
+    double seconds;
+    uint64_t bytes;
+    CLatencyHistogram latency[eChunkClassCount];
+};
+
+class CChunkClassMap
+{
+public:
+    CChunkClassMap(const off_t chunkSize, const off_t area)
+        : m_chunkSize(chunkSize)
+        , m_classes(area / chunkSize, eChunkUntouched)
+    {};
+
+    EChunkClass Get(off_t offset) const
+    {
+        return m_classes[offset / m_chunkSize];
+    };
+    void Set(size_t chunk, EChunkClass chunkClass)
+    {
+        m_classes[chunk] = chunkClass;
+    };
+    size_t Count() const
+    {
+        return m_classes.size();
+    };
+    std::vector<size_t> Collect(EChunkClass chunkClass) const
+    {
+        std::vector<size_t> chunks;
+
+        for (size_t chunk = 0; chunk < m_classes.size(); chunk++)
+            if (m_classes[chunk] == chunkClass)
+                chunks.push_back(chunk);
+        return chunks;
+    };
+
+private:
+    off_t m_chunkSize;
+    std::vector<EChunkClass> m_classes;
+};
+
+static inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t ParseSize(std::string str)
+{
+    uint64_t multiple = 1;
+
+    switch (str.back())
+    {
+    case 'G':
+        multiple *= 1024;
+    case 'M':
+        multiple *= 1024;
+    case 'K':
+        multiple *= 1024;
+        str.pop_back();
+    default:
+        return std::stoull(str) * multiple;
+    }
+}
+
+static inline void TimedRead(const std::shared_ptr<CBlockDevice>& ptrImage, AlignedBuffer<unsigned char>& buf,
+                             off_t offset, EChunkClass chunkClass, SModeResult& result)
+{
+    const uint64_t started = NowNs();
+
+    ptrImage->Read(buf.Data(), buf.Size(), offset);
+    result.latency[chunkClass].Add(NowNs() - started);
+    result.bytes += buf.Size();
+}
+
+static void ReadSequential(const std::shared_ptr<CBlockDevice>& ptrImage, const SReadParams& params,
+                           const CChunkClassMap& classMap, SModeResult& result)
+{
+    AlignedBuffer<unsigned char> buf(SECTOR_SIZE, params.blockSize);
+
+    for (off_t offset = 0; offset < params.area; offset += params.blockSize)
+        TimedRead(ptrImage, buf, offset, classMap.Get(offset), result);
+}
+
+/*
+ * The classes are read in turn, so that each class gets the same number of
+ * samples. To read the in-memory chunk, the chunk is overwritten on the
+ * original device right before the reading from the image. After that, the
+ * chunk is considered to be stored.
+ */
+static void ReadRandom(const std::shared_ptr<CBlockDevice>& ptrOriginal,
+                       const std::shared_ptr<CBlockDevice>& ptrImage, const SReadParams& params,
+                       CChunkClassMap& classMap, std::vector<size_t>& candidates, SModeResult& result)
+{
+    AlignedBuffer<unsigned char> buf(SECTOR_SIZE, params.blockSize);
+    AlignedBuffer<unsigned char> writeBuf(SECTOR_SIZE, params.blockSize);
+    CRandom& gen = CRandomHelper::Generator();
+    const off_t blocksInChunk = params.chunkSize / params.blockSize;
+    std::vector<size_t> untouched = classMap.Collect(eChunkUntouched);
+    std::vector<size_t> stored = classMap.Collect(eChunkStored);
+
+    CRandomHelper::GenerateBuffer(writeBuf.Data(), writeBuf.Size());
+    for (unsigned int inx = 0; inx < params.count; inx++)
+    {
+        const EChunkClass chunkClass = static_cast<EChunkClass>(inx % eChunkClassCount);
+        const off_t block = static_cast<off_t>(gen() % blocksInChunk);
+        size_t chunk;
+
+        switch (chunkClass)
+        {
+        case eChunkUntouched:
+            if (untouched.empty())
+                continue;
+            chunk = untouched[gen() % untouched.size()];
+            break;
+        case eChunkStored:
+            if (stored.empty())
+                continue;
+            chunk = stored[gen() % stored.size()];
+            break;
+        default:
+            if (candidates.empty())
+                continue;
+            chunk = candidates.back();
+            candidates.pop_back();
+            ptrOriginal->Write(writeBuf.Data(), writeBuf.Size(), chunk * params.chunkSize);
+            break;
+        }
+
+        TimedRead(ptrImage, buf, chunk * params.chunkSize + block * params.blockSize, chunkClass, result);
+
+        if (chunkClass == eChunkInMemory)
+            classMap.Set(chunk, eChunkStored);
+    }
+}
+
+static void ReadCbt(const std::string& device, const std::shared_ptr<CBlockDevice>& ptrImage,
+                    const SReadParams& params, const CChunkClassMap& classMap, SModeResult& result)
+{
+    auto ptrCbt = blksnap::ICbt::Create(device);
+    auto ptrCbtInfo = ptrCbt->GetCbtInfo();
+    auto ptrCbtData = ptrCbt->GetCbtData();
+    AlignedBuffer<unsigned char> buf(SECTOR_SIZE, params.blockSize);
+    int base = params.cbtBase;
+
+    /*
+     * By default, the blocks that have been changed since the previous
+     * snapshot are read.
+     */
+    if (base < 0)
+        base = std::max(static_cast<int>(ptrCbtInfo->snapNumber) - 1, 0);
+    logger.Info("CBT block size " + std::to_string(ptrCbtInfo->blockSize) + " bytes, base changes number "
+                + std::to_string(base));
+
+    const off_t cbtBlockSize = ptrCbtInfo->blockSize;
+    for (size_t inx = 0; inx < ptrCbtData->vec.size(); inx++)
+    {
+        if (ptrCbtData->vec[inx] <= base)
+            continue;
+
+        const off_t begin = inx * cbtBlockSize;
+        const off_t end = std::min(begin + cbtBlockSize, static_cast<off_t>(params.area));
+        for (off_t offset = begin; offset + static_cast<off_t>(params.blockSize) <= end; offset += params.blockSize)
+            TimedRead(ptrImage, buf, offset, classMap.Get(offset), result);
+    }
+}
+
+static void LogResult(const SModeResult& result)
+{
+    logger.Info("Mode [" + result.name + "]: " + std::to_string(result.bytes / (1024 * 1024)) + " MiB in "
+                + std::to_string(result.seconds) + " seconds");
+    for (int chunkClass = 0; chunkClass < eChunkClassCount; chunkClass++)
+    {
+        const CLatencyHistogram& latency = result.latency[chunkClass];
+        std::stringstream ss;
+
+        if (!latency.Count())
+            continue;
+
+        ss << "    " << chunkClassName[chunkClass] << ": " << latency.Count() << " reads, latency us: "
+           << "mean=" << latency.Mean() / 1000 << " "
+           << "p50=" << latency.Percentile(50) / 1000 << " "
+           << "p99=" << latency.Percentile(99) / 1000 << " "
+           << "p999=" << latency.Percentile(99.9) / 1000 << " "
+           << "max=" << latency.Max() / 1000;
+        logger.Info(ss);
+    }
+}
+
+static void JsonResult(std::ostream& out, const SModeResult& result)
+{
+    out << "    {" << std::endl
+        << "      \"mode\": \"" << result.name << "\"," << std::endl
+        << "      \"seconds\": " << result.seconds << "," << std::endl
+        << "      \"bytes\": " << result.bytes << "," << std::endl
+        << "      \"mbps\": " << (result.bytes / result.seconds / (1024 * 1024)) << "," << std::endl
+        << "      \"classes\": {";
+    for (int chunkClass = 0; chunkClass < eChunkClassCount; chunkClass++)
+    {
+        const CLatencyHistogram& latency = result.latency[chunkClass];
+
+        out << (chunkClass ? "," : "") << std::endl
+            << "        \"" << chunkClassName[chunkClass] << "\": {"
+            << "\"reads\": " << latency.Count() << ", "
+            << "\"mean\": " << latency.Mean() << ", "
+            << "\"p50\": " << latency.Percentile(50) << ", "
+            << "\"p99\": " << latency.Percentile(99) << ", "
+            << "\"p999\": " << latency.Percentile(99.9) << ", "
+            << "\"max\": " << latency.Max() << "}";
+    }
+    out << std::endl
+        << "      }" << std::endl
+        << "    }";
+}
+
+void CheckSnapshotRead(const std::string& device, const std::string& diffStorage,
+                       const unsigned long long diffStorageLimit, SReadParams& params,
+                       const std::string& jsonFile)
+{
+    bool isErrorFound = false;
+    std::vector<SModeResult> results;
+
+    logger.Info("--- Test: snapshot image read ---");
+    logger.Info("device: " + device);
+    logger.Info("chunk size: " + std::to_string(params.chunkSize) + " bytes");
+    logger.Info("block size: " + std::to_string(params.blockSize) + " bytes");
+
+    auto ptrOriginal = std::make_shared<CBlockDevice>(device);
+    params.area = std::min(params.area, ptrOriginal->Size()) / params.chunkSize * params.chunkSize;
+    logger.Info("area: " + std::to_string(params.area) + " bytes");
+
+    CChunkClassMap classMap(params.chunkSize, params.area);
+    std::vector<size_t> chunks(classMap.Count());
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+        chunks[chunk] = chunk;
+    std::shuffle(chunks.begin(), chunks.end(), CRandomHelper::Generator());
+
+    const size_t storedCount = chunks.size() * params.storedPercent / 100;
+    const size_t candidatesCount = std::min(static_cast<size_t>(params.count / eChunkClassCount + 1),
+                                            chunks.size() - storedCount);
+    std::vector<size_t> candidates(chunks.begin() + storedCount, chunks.begin() + storedCount + candidatesCount);
+
+    {
+        std::vector<std::string> devices;
+        devices.push_back(device);
+
+        logger.Info("Create snapshot");
+        auto ptrSession = blksnap::ISession::Create(devices, diffStorage, diffStorageLimit);
+        auto ptrImage = std::make_shared<CBlockDevice>(blksnap::ICbt::Create(device)->GetImage());
+
+        /*
+         * The chunks are copied to the difference storage by writing to
+         * the original device. The time is given to store them.
+         */
+        logger.Info("Preconditioning: overwrite " + std::to_string(storedCount) + " chunks");
+        {
+            AlignedBuffer<unsigned char> writeBuf(SECTOR_SIZE, params.blockSize);
+
+            CRandomHelper::GenerateBuffer(writeBuf.Data(), writeBuf.Size());
+            for (size_t inx = 0; inx < storedCount; inx++)
+            {
+                ptrOriginal->Write(writeBuf.Data(), writeBuf.Size(), chunks[inx] * params.chunkSize);
+                classMap.Set(chunks[inx], eChunkStored);
+            }
+        }
+        ::sleep(params.settle);
+
+        for (const std::string& mode : params.modes)
+        {
+            results.emplace_back(mode);
+            SModeResult& result = results.back();
+
+            const uint64_t startNs = NowNs();
+            if (mode == "sequential")
+                ReadSequential(ptrImage, params, classMap, result);
+            else if (mode == "random")
+                ReadRandom(ptrOriginal, ptrImage, params, classMap, candidates, result);
+            else
+                ReadCbt(device, ptrImage, params, classMap, result);
+            result.seconds = std::max((NowNs() - startNs) / 1000000000.0, 0.000001);
+
+            LogResult(result);
+        }
+
+        std::string errorMessage;
+        while (ptrSession->GetError(errorMessage))
+        {
+            isErrorFound = true;
+            logger.Err(errorMessage);
+        }
+
+        logger.Info("Destroy snapshot");
+        ptrImage.reset();
+        ptrSession.reset();
+    }
+
+    if (!jsonFile.empty())
+    {
+        std::ofstream file;
+        if (jsonFile != "-")
+            file.open(jsonFile);
+        std::ostream& out = (jsonFile == "-") ? std::cout : file;
+
+        out << "{" << std::endl
+            << "  \"device\": \"" << device << "\"," << std::endl
+            << "  \"chunk_size\": " << params.chunkSize << "," << std::endl
+            << "  \"block_size\": " << params.blockSize << "," << std::endl
+            << "  \"area\": " << params.area << "," << std::endl
+            << "  \"stored_percent\": " << params.storedPercent << "," << std::endl
+            << "  \"modes\": [" << std::endl;
+        for (size_t inx = 0; inx < results.size(); inx++)
+        {
+            JsonResult(out, results[inx]);
+            out << ((inx + 1 < results.size()) ? "," : "") << std::endl;
+        }
+        out << "  ]" << std::endl
+            << "}" << std::endl;
+    }
+
+    if (isErrorFound)
+        throw std::runtime_error("--- Failed: snapshot image read ---");
+
+    logger.Info("--- Success: snapshot image read ---");
+}
+
+void Main(int argc, char* argv[])
+{
+    po::options_description desc;
+    std::string usage = std::string("Checking the performance of reading the snapshot image of the blksnap module.");
+
+    desc.add_options()
+        ("help,h", "Show usage information.")
+        ("log,l", po::value<std::string>(),"Detailed log of all transactions.")
+        ("device,d", po::value<std::string>(), "Device name. ")
+        ("diff_storage,s", po::value<std::string>(),
+            "Directory name for allocating diff storage files.")
+        ("diff_storage_limit,L", po::value<std::string>()->default_value("1G"),
+            "The available limit for the size of the difference storage file. The suffixes M, K and G is allowed.")
+        ("chunksize,c", po::value<std::string>()->default_value("256K"),
+            "The size of the chunk that the COW algorithm operates on. It should match the module parameters.")
+        ("block_size,b", po::value<std::string>()->default_value("4K"),
+            "The size of the read request. The suffixes M and K is allowed.")
+        ("area,a", po::value<std::string>()->default_value("1G"),
+            "The size of the area at the beginning of the device that is used for the test.")
+        ("stored_percent,p", po::value<unsigned int>()->default_value(25),
+            "The percentage of chunks in the area that are copied to the difference storage.")
+        ("count,n", po::value<unsigned int>()->default_value(30000), "The number of reads in random mode.")
+        ("settle,t", po::value<unsigned int>()->default_value(5),
+            "The time in seconds given to store the chunks after preconditioning.")
+        ("cbt_base", po::value<int>()->default_value(-1),
+            "The changes number for reading in CBT mode. By default, the changes since the previous snapshot.")
+        ("mode,m", po::value<std::vector<std::string>>()->multitoken(),
+            "Reading modes: 'sequential', 'random' and 'cbt'. It's multitoken argument. All modes by default.")
+        ("json,j", po::value<std::string>(), "The file name for the results in JSON format. '-' means standard output.")
+        ("seed", po::value<unsigned long long>(), "The seed of the random numbers. Allows to repeat a run.");
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv).options(desc).run();
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << usage << std::endl;
+        std::cout << desc << std::endl;
+        return;
+    }
+
+    if (vm.count("log"))
+    {
+        std::string filename = vm["log"].as<std::string>();
+        logger.Open(filename);
+    }
+
+    if (!vm.count("device"))
+        throw std::invalid_argument("Argument 'device' is missed.");
+    std::string origDevName = vm["device"].as<std::string>();
+
+    if (!vm.count("diff_storage"))
+        throw std::invalid_argument("Argument 'diff_storage' is missed.");
+    std::string diffStorage = vm["diff_storage"].as<std::string>();
+
+    unsigned long long diffStorageLimit = ParseSize(vm["diff_storage_limit"].as<std::string>());
+
+    SReadParams params;
+    params.chunkSize = ParseSize(vm["chunksize"].as<std::string>());
+    params.blockSize = ParseSize(vm["block_size"].as<std::string>());
+    if (!params.blockSize || (params.blockSize % SECTOR_SIZE) || (params.chunkSize % params.blockSize))
+        throw std::invalid_argument("Argument 'block_size' should be a multiple of the sector size and "
+                                    "the chunk size should be a multiple of it.");
+    params.area = ParseSize(vm["area"].as<std::string>());
+    params.storedPercent = std::min(vm["stored_percent"].as<unsigned int>(), 100u);
+    params.count = vm["count"].as<unsigned int>();
+    params.settle = vm["settle"].as<unsigned int>();
+    params.cbtBase = vm["cbt_base"].as<int>();
+
+    if (vm.count("mode"))
+        params.modes = vm["mode"].as<std::vector<std::string>>();
+    else
+        params.modes = {"sequential", "random", "cbt"};
+    for (const std::string& mode : params.modes)
+        if ((mode != "sequential") && (mode != "random") && (mode != "cbt"))
+            throw std::invalid_argument("Value '" + mode + "' for argument 'mode' is not supported.");
+
+    std::string jsonFile;
+    if (vm.count("json"))
+        jsonFile = vm["json"].as<std::string>();
+
+    CRandomHelper::SetSeed(vm.count("seed") ? vm["seed"].as<unsigned long long>() : CRandomHelper::MakeSeed());
+    logger.Info("seed: " + std::to_string(CRandomHelper::Seed()));
+    CheckSnapshotRead(origDevName, diffStorage, diffStorageLimit, params, jsonFile);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        Main(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
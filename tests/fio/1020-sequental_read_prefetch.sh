@@ -0,0 +1,53 @@
+#!/bin/bash -e
+#
+# SPDX-License-Identifier: GPL-2.0+
+
+. ../functions.sh
+. ../blksnap.sh
+
+echo "---"
+echo "FIO sequental read of the snapshot image with prefetch test"
+
+fio --version
+blksnap_load
+blksnap_version
+
+if [ -z $1 ]
+then
+	echo "You must specify the path to the block device for testing."
+	exit -1
+else
+	DEVICE="$1"
+fi
+
+PARAMS=/sys/module/blksnap/parameters
+PREFETCH_CHUNKS=$(cat ${PARAMS}/image_prefetch_chunks)
+
+blksnap_snapshot_create "${DEVICE}" "/dev/shm" "1G"
+blksnap_snapshot_watcher
+blksnap_snapshot_take
+
+DEVICE_IMAGE=$(blksnap_get_image ${DEVICE})
+
+echo "Overwrite the original device to fill the difference storage"
+fio --filename "${DEVICE}" --section sequental_write ./blksnap.fio
+
+echo "Read the snapshot image without prefetch"
+echo 0 > ${PARAMS}/image_prefetch_chunks
+fio --filename "${DEVICE_IMAGE}" --readonly --section sequental_read ./blksnap.fio
+fio --filename "${DEVICE_IMAGE}" --readonly --section sequental_read_4k ./blksnap.fio
+
+echo "Read the snapshot image with prefetch of ${PREFETCH_CHUNKS} chunks"
+echo ${PREFETCH_CHUNKS} > ${PARAMS}/image_prefetch_chunks
+fio --filename "${DEVICE_IMAGE}" --readonly --section sequental_read ./blksnap.fio
+fio --filename "${DEVICE_IMAGE}" --readonly --section sequental_read_4k ./blksnap.fio
+
+echo "Destroy snapshot"
+blksnap_snapshot_destroy
+blksnap_watcher_wait
+blksnap_detach "${DEVICE}"
+
+blksnap_unload
+
+echo "FIO sequental read of the snapshot image with prefetch test finish"
+echo "---"
@@ -0,0 +1,867 @@
+// SPDX-License-Identifier: GPL-2.0+
+#include <algorithm>
+#include <atomic>
+#include <blksnap/Session.h>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/blksnap.h>
+#include <linux/blktrace_api.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ChunkShift.h"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+/*
+ * The trace of writes to a block device.
+ * The file begins with the header, followed by the records sorted by time.
+ * The time of a record is counted from the first write of the trace.
+ * The values are stored in the byte order of the machine that captured the
+ * trace.
+ */
+namespace
+{
+    const char traceMagic[8] = {'B', 'L', 'K', 'S', 'T', 'R', 'C', '\0'};
+    const uint32_t traceVersion = 1;
+
+    enum ETraceFlags
+    {
+        eTraceSync = 1,
+        eTraceFua = 2,
+    };
+
+    struct STraceHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        /* The capacity of the traced device in sectors, zero if unknown. */
+        uint64_t capacity;
+        uint64_t count;
+    };
+    static_assert(sizeof(STraceHeader) == 32, "Invalid size of the trace header");
+
+    struct STraceRecord
+    {
+        uint64_t timeNs;
+        uint64_t sector;
+        uint32_t count;
+        uint32_t flags;
+    };
+    static_assert(sizeof(STraceRecord) == 24, "Invalid size of the trace record");
+
+    struct STrace
+    {
+        uint64_t capacity;
+        std::vector<STraceRecord> records;
+    };
+
+    void WriteTrace(const std::string& path, const STrace& trace)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::system_error(errno, std::generic_category(), "Failed to create file [" + path + "]");
+
+        STraceHeader header;
+        memcpy(header.magic, traceMagic, sizeof(header.magic));
+        header.version = traceVersion;
+        header.recordSize = sizeof(STraceRecord);
+        header.capacity = trace.capacity;
+        header.count = trace.records.size();
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(trace.records.data()), trace.records.size() * sizeof(STraceRecord));
+        if (!out)
+            throw std::system_error(errno, std::generic_category(), "Failed to write file [" + path + "]");
+    }
+
+    void ReadTrace(const std::string& path, STrace& trace)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            throw std::system_error(errno, std::generic_category(), "Failed to open file [" + path + "]");
+
+        STraceHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || memcmp(header.magic, traceMagic, sizeof(header.magic)))
+            throw std::runtime_error("The file [" + path + "] is not a write trace.");
+        if ((header.version != traceVersion) || (header.recordSize != sizeof(STraceRecord)))
+            throw std::runtime_error("The version " + std::to_string(header.version) + " of the trace is not supported.");
+
+        trace.capacity = header.capacity;
+        trace.records.resize(header.count);
+        if (!in.read(reinterpret_cast<char*>(trace.records.data()), header.count * sizeof(STraceRecord)))
+            throw std::runtime_error("The trace [" + path + "] is truncated.");
+    }
+
+    class CFd
+    {
+    public:
+        CFd(const std::string& path, int flags)
+            : m_fd(::open(path.c_str(), flags))
+        {
+            if (m_fd < 0)
+                throw std::system_error(errno, std::generic_category(), "Failed to open [" + path + "]");
+        };
+        ~CFd()
+        {
+            ::close(m_fd);
+        };
+        int Get() const
+        {
+            return m_fd;
+        };
+
+    private:
+        int m_fd;
+    };
+
+    void DeviceGeometry(const std::string& path, uint64_t& capacity, unsigned int& blockSize)
+    {
+        CFd fd(path, O_RDONLY);
+        uint64_t size;
+        int ssz;
+
+        if (::ioctl(fd.Get(), BLKGETSIZE64, &size))
+            throw std::system_error(errno, std::generic_category(), "Failed to get size of [" + path + "]");
+        if (::ioctl(fd.Get(), BLKSSZGET, &ssz))
+            throw std::system_error(errno, std::generic_category(), "Failed to get block size of [" + path + "]");
+
+        capacity = size >> SECTOR_SHIFT;
+        blockSize = static_cast<unsigned int>(ssz);
+    }
+
+    unsigned int DeviceIoMin(const std::string& path)
+    {
+        CFd fd(path, O_RDONLY);
+        unsigned int ioMin = 0;
+
+        if (::ioctl(fd.Get(), BLKIOMIN, &ioMin))
+            throw std::system_error(errno, std::generic_category(), "Failed to get minimal I/O size of [" + path + "]");
+        return ioMin;
+    }
+
+    unsigned long long ParseSize(std::string str)
+    {
+        unsigned long long multiple = 1;
+
+        switch (str.back())
+        {
+        case 'G':
+            multiple *= 1024;
+        case 'M':
+            multiple *= 1024;
+        case 'K':
+            multiple *= 1024;
+            str.pop_back();
+        default:
+            return std::stoull(str) * multiple;
+        }
+    }
+
+    inline uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string MiB(const uint64_t bytes)
+    {
+        std::stringstream ss;
+
+        ss << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1024 * 1024);
+        return ss.str();
+    }
+
+    std::string Ratio(const double value)
+    {
+        std::stringstream ss;
+
+        ss << std::fixed << std::setprecision(2) << value;
+        return ss.str();
+    }
+
+    unsigned int ModuleParam(const std::string& name, const unsigned int defaultValue)
+    {
+        std::ifstream in("/sys/module/blksnap/parameters/" + name);
+        unsigned int value;
+
+        if (in >> value)
+            return value;
+        return defaultValue;
+    }
+
+    /*
+     * The module copies the whole chunk to the difference storage on the
+     * first write to it. The parameters of the chunk size are taken from the
+     * loaded module.
+     */
+    SChunkParams ModuleChunkParams()
+    {
+        SChunkParams params;
+
+        params.minimumShift = ModuleParam("chunk_minimum_shift", params.minimumShift);
+        params.maximumShift = ModuleParam("chunk_maximum_shift", params.maximumShift);
+        params.maximumCountShift = ModuleParam("chunk_maximum_count_shift", params.maximumCountShift);
+        return params;
+    }
+
+    unsigned int PageShift()
+    {
+        const long pageSize = ::sysconf(_SC_PAGESIZE);
+        unsigned int shift = SECTOR_SHIFT;
+
+        while ((1L << shift) < pageSize)
+            shift++;
+        return shift;
+    }
+
+    struct SIo
+    {
+        off_t offset;
+        size_t size;
+    };
+
+    struct SLatency
+    {
+        SLatency()
+            : avgNs(0)
+            , p50Ns(0)
+            , p99Ns(0)
+            , maxNs(0)
+        {};
+
+        uint64_t avgNs;
+        uint64_t p50Ns;
+        uint64_t p99Ns;
+        uint64_t maxNs;
+    };
+
+    SLatency CalculateLatency(std::vector<uint64_t> latencies)
+    {
+        SLatency result;
+
+        if (latencies.empty())
+            return result;
+
+        std::sort(latencies.begin(), latencies.end());
+        uint64_t sum = 0;
+        for (uint64_t ns : latencies)
+            sum += ns;
+
+        result.avgNs = sum / latencies.size();
+        result.p50Ns = latencies[latencies.size() / 2];
+        result.p99Ns = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        result.maxNs = latencies.back();
+        return result;
+    }
+
+    struct SGrowthPoint
+    {
+        uint64_t elapsedNs;
+        uint64_t writtenBytes;
+        uint64_t cowBytes;
+        uint64_t diffStorageBytes;
+    };
+
+    struct SReplayParams
+    {
+        double speed;
+        unsigned int threads;
+        unsigned int intervalMs;
+    };
+
+    struct SReplayResult
+    {
+        uint64_t elapsedNs;
+        uint64_t writtenBytes;
+        uint64_t lateCount;
+        std::vector<uint64_t> latencies;
+        std::vector<SGrowthPoint> curve;
+    };
+
+    /*
+     * The writes are issued by several threads, which allows to keep
+     * several requests in flight as the traced application did. The time
+     * of issuing a write is the time of the record divided by the speed.
+     * If the speed is zero, the writes are issued as fast as possible.
+     * The sample callback is called at each interval and at the end.
+     */
+    SReplayResult Replay(const std::string& device, const std::vector<SIo>& ios, const SReplayParams& params,
+                         const std::vector<STraceRecord>& records,
+                         const std::function<void(SGrowthPoint&, size_t issued)>& sample)
+    {
+        SReplayResult result;
+        CFd fd(device, O_RDWR | O_DIRECT);
+        size_t maxSize = 0;
+        for (const SIo& io : ios)
+            maxSize = std::max(maxSize, io.size);
+
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> written(0);
+        std::atomic<uint64_t> late(0);
+        std::mutex errorLock;
+        std::string errorMessage;
+        result.latencies.resize(ios.size());
+
+        const uint64_t startNs = NowNs();
+        auto worker = [&]() {
+            void* buf = nullptr;
+            if (posix_memalign(&buf, 4096, maxSize))
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+                errorMessage = "Failed to allocate the buffer";
+                next = ios.size();
+                return;
+            }
+            memset(buf, 0x5A, maxSize);
+
+            size_t inx;
+            while ((inx = next++) < ios.size())
+            {
+                if (params.speed > 0)
+                {
+                    const uint64_t dueNs = startNs + static_cast<uint64_t>(records[inx].timeNs / params.speed);
+                    const uint64_t nowNs = NowNs();
+
+                    if (dueNs > nowNs)
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(dueNs - nowNs));
+                    else if ((nowNs - dueNs) > 1000000)
+                        late++;
+                }
+
+                const uint64_t issueNs = NowNs();
+                ssize_t ret = ::pwrite(fd.Get(), buf, ios[inx].size, ios[inx].offset);
+                if (ret != static_cast<ssize_t>(ios[inx].size))
+                {
+                    std::lock_guard<std::mutex> guard(errorLock);
+                    errorMessage = "Failed to write " + std::to_string(ios[inx].size) + " bytes at offset "
+                                   + std::to_string(ios[inx].offset) + ": " + strerror(errno);
+                    next = ios.size();
+                    break;
+                }
+                result.latencies[inx] = NowNs() - issueNs;
+                written += ios[inx].size;
+            }
+            free(buf);
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int inx = 0; inx < params.threads; inx++)
+            threads.emplace_back(worker);
+
+        std::mutex sampleLock;
+        std::condition_variable sampleCv;
+        bool isComplete = false;
+        std::thread sampler([&]() {
+            std::unique_lock<std::mutex> lock(sampleLock);
+
+            do
+            {
+                SGrowthPoint point;
+
+                point.elapsedNs = NowNs() - startNs;
+                point.writtenBytes = written;
+                sample(point, std::min(static_cast<size_t>(next), ios.size()));
+                result.curve.push_back(point);
+            } while (!sampleCv.wait_for(lock, std::chrono::milliseconds(params.intervalMs),
+                                        [&isComplete] { return isComplete; }));
+        });
+
+        for (auto& thread : threads)
+            thread.join();
+        result.elapsedNs = NowNs() - startNs;
+        {
+            std::lock_guard<std::mutex> guard(sampleLock);
+            isComplete = true;
+        }
+        sampleCv.notify_all();
+        sampler.join();
+
+        SGrowthPoint point;
+        point.elapsedNs = result.elapsedNs;
+        point.writtenBytes = written;
+        sample(point, ios.size());
+        result.curve.push_back(point);
+
+        if (!errorMessage.empty())
+            throw std::runtime_error(errorMessage);
+
+        result.writtenBytes = written;
+        result.lateCount = late;
+        return result;
+    }
+
+    void PrintLatency(const std::string& name, const SReplayResult& result)
+    {
+        SLatency latency = CalculateLatency(result.latencies);
+        const double seconds = static_cast<double>(result.elapsedNs) / 1000000000;
+
+        std::cout << name << ":" << std::endl;
+        std::cout << "\telapsed: " << Ratio(seconds) << " s" << std::endl;
+        std::cout << "\tthroughput: " << Ratio(static_cast<double>(result.latencies.size()) / seconds) << " IOPS, "
+                  << MiB(static_cast<uint64_t>(result.writtenBytes / seconds)) << " MiB/s" << std::endl;
+        std::cout << "\tlatency: avg " << latency.avgNs / 1000 << " us, p50 " << latency.p50Ns / 1000 << " us, p99 "
+                  << latency.p99Ns / 1000 << " us, max " << latency.maxNs / 1000 << " us" << std::endl;
+        if (result.lateCount)
+            std::cout << "\tlate writes: " << result.lateCount << std::endl;
+    }
+} // namespace
+
+class IArgsProc
+{
+public:
+    IArgsProc()
+    {
+        m_desc.add_options()
+            ("help,h", "Print usage for command.");
+    };
+    virtual ~IArgsProc(){};
+    virtual void PrintUsage() const
+    {
+        std::cout << m_usage << std::endl;
+        std::cout << m_desc << std::endl;
+    };
+    virtual void Process(int argc, char** argv)
+    {
+        po::variables_map vm;
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(m_desc).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+            PrintUsage();
+            return;
+        }
+
+        Execute(vm);
+    };
+    virtual void Execute(po::variables_map& vm) = 0;
+
+protected:
+    po::options_description m_desc;
+    std::string m_usage;
+};
+
+class CaptureArgsProc : public IArgsProc
+{
+public:
+    CaptureArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Convert the binary output of blktrace to the write trace.\n"
+                              "For example: blktrace -d /dev/sda -o - | blksnap-trace capture -o sda.trace");
+        m_desc.add_options()
+            ("input,i", po::value<std::string>()->default_value("-"),
+                "The output of blktrace. '-' means standard input.")
+            ("output,o", po::value<std::string>(), "The file of the write trace.")
+            ("device,d", po::value<std::string>(),
+                "The traced device. Only its writes are taken, and its capacity is stored in the trace.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        if (!vm.count("output"))
+            throw std::invalid_argument("Argument 'output' is missed.");
+
+        STrace trace = {0, {}};
+        bool isDeviceFilter = false;
+        uint32_t deviceId = 0;
+        if (vm.count("device"))
+        {
+            const std::string device = vm["device"].as<std::string>();
+            struct stat st;
+            unsigned int blockSize;
+
+            if (::stat(device.c_str(), &st))
+                throw std::system_error(errno, std::generic_category(), "Failed to get status for [" + device + "]");
+            /* The kernel encodes the device number as MKDEV(major, minor). */
+            deviceId = (major(st.st_rdev) << 20) | minor(st.st_rdev);
+            isDeviceFilter = true;
+            DeviceGeometry(device, trace.capacity, blockSize);
+        }
+
+        const std::string input = vm["input"].as<std::string>();
+        FILE* file = (input == "-") ? stdin : fopen(input.c_str(), "rb");
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), "Failed to open [" + input + "]");
+
+        struct blk_io_trace t;
+        std::vector<char> pdu;
+        uint64_t events = 0;
+        while (fread(&t, sizeof(t), 1, file) == 1)
+        {
+            if ((t.magic & 0xFFFFFF00) != BLK_IO_TRACE_MAGIC)
+            {
+                if (file != stdin)
+                    fclose(file);
+                throw std::runtime_error("Invalid magic of the blktrace record. The output of blktrace is expected.");
+            }
+            if (t.pdu_len)
+            {
+                pdu.resize(t.pdu_len);
+                if (fread(pdu.data(), t.pdu_len, 1, file) != 1)
+                    break;
+            }
+            events++;
+
+            /*
+             * The bio is taken when it is queued to the device. The discard
+             * requests and the flushes without data are not taken.
+             */
+            const uint32_t category = t.action >> BLK_TC_SHIFT;
+            if (((t.action & 0xFFFF) != __BLK_TA_QUEUE) || !(category & BLK_TC_WRITE)
+                || (category & (BLK_TC_DISCARD | BLK_TC_NOTIFY)) || !t.bytes)
+                continue;
+            if (isDeviceFilter && (t.device != deviceId))
+                continue;
+
+            STraceRecord record;
+            record.timeNs = t.time;
+            record.sector = t.sector;
+            record.count = t.bytes >> SECTOR_SHIFT;
+            record.flags = ((category & BLK_TC_SYNC) ? eTraceSync : 0) | ((category & BLK_TC_FUA) ? eTraceFua : 0);
+            trace.records.push_back(record);
+        }
+        if (file != stdin)
+            fclose(file);
+
+        /* The records of different CPUs are interleaved. */
+        std::stable_sort(trace.records.begin(), trace.records.end(),
+                         [](const STraceRecord& a, const STraceRecord& b) { return a.timeNs < b.timeNs; });
+        if (!trace.records.empty())
+        {
+            const uint64_t startNs = trace.records.front().timeNs;
+            for (STraceRecord& record : trace.records)
+                record.timeNs -= startNs;
+        }
+
+        WriteTrace(vm["output"].as<std::string>(), trace);
+        std::cout << "Processed " << events << " events, captured " << trace.records.size() << " writes" << std::endl;
+    };
+};
+
+class InfoArgsProc : public IArgsProc
+{
+public:
+    InfoArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Print the statistics of the write trace.");
+        m_desc.add_options()
+            ("trace,t", po::value<std::string>(), "The file of the write trace.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        if (!vm.count("trace"))
+            throw std::invalid_argument("Argument 'trace' is missed.");
+
+        STrace trace;
+        ReadTrace(vm["trace"].as<std::string>(), trace);
+
+        uint64_t bytes = 0;
+        uint64_t sequential = 0;
+        uint64_t sync = 0;
+        uint64_t lastSector = UINT64_MAX;
+        std::map<unsigned int, uint64_t> sizes;
+        for (const STraceRecord& record : trace.records)
+        {
+            bytes += static_cast<uint64_t>(record.count) << SECTOR_SHIFT;
+            if (record.sector == lastSector)
+                sequential++;
+            if (record.flags & (eTraceSync | eTraceFua))
+                sync++;
+            lastSector = record.sector + record.count;
+
+            unsigned int order = 0;
+            while ((static_cast<uint64_t>(record.count) << SECTOR_SHIFT) > (1ULL << order))
+                order++;
+            sizes[order]++;
+        }
+
+        const uint64_t durationNs = trace.records.empty() ? 0 : trace.records.back().timeNs;
+        std::cout << "capacity=" << trace.capacity << std::endl;
+        std::cout << "writes=" << trace.records.size() << std::endl;
+        std::cout << "bytes=" << bytes << std::endl;
+        std::cout << "duration_ms=" << durationNs / 1000000 << std::endl;
+        std::cout << "sequential=" << sequential << std::endl;
+        std::cout << "sync=" << sync << std::endl;
+        for (const auto& it : sizes)
+            std::cout << "size<=" << (1ULL << it.first) << "=" << it.second << std::endl;
+    };
+};
+
+class ReplayArgsProc : public IArgsProc
+{
+public:
+    ReplayArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Replay the write trace on the device under the snapshot.\n"
+                              "The data on the device is overwritten.");
+        m_desc.add_options()
+            ("trace,t", po::value<std::string>(), "The file of the write trace.")
+            ("device,d", po::value<std::string>(), "The device to write to.")
+            ("diff_storage,s", po::value<std::string>(),
+                "The difference storage: a directory, a regular file or a block device. A temporary file is "
+                "created in the directory.")
+            ("limit,l", po::value<std::string>()->default_value("1G"),
+                "The maximum size of the difference storage. The suffixes G, M and K is allowed.")
+            ("speed", po::value<double>()->default_value(1.0),
+                "The acceleration of the trace time. Zero means writing as fast as possible.")
+            ("threads", po::value<unsigned int>()->default_value(16), "The number of writes in flight.")
+            ("interval", po::value<unsigned int>()->default_value(1000),
+                "The interval of the diff storage growth samples in milliseconds.")
+            ("baseline", "Replay the trace without the snapshot first to measure the latency inflation.")
+            ("csv", po::value<std::string>(), "The file for the growth curve in CSV format.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        if (!vm.count("trace"))
+            throw std::invalid_argument("Argument 'trace' is missed.");
+        if (!vm.count("device"))
+            throw std::invalid_argument("Argument 'device' is missed.");
+        if (!vm.count("diff_storage"))
+            throw std::invalid_argument("Argument 'diff_storage' is missed.");
+
+        const std::string device = vm["device"].as<std::string>();
+        SReplayParams params;
+        params.speed = vm["speed"].as<double>();
+        params.threads = std::max(1U, vm["threads"].as<unsigned int>());
+        params.intervalMs = std::max(1U, vm["interval"].as<unsigned int>());
+
+        STrace trace;
+        ReadTrace(vm["trace"].as<std::string>(), trace);
+        if (trace.records.empty())
+            throw std::runtime_error("The trace is empty.");
+
+        uint64_t capacity;
+        unsigned int blockSize;
+        DeviceGeometry(device, capacity, blockSize);
+
+        /*
+         * The writes are aligned to the logical block of the device, since it
+         * is opened with O_DIRECT. The writes beyond the end of the device are
+         * wrapped around.
+         */
+        std::vector<SIo> ios(trace.records.size());
+        const uint64_t capacityBytes = capacity << SECTOR_SHIFT;
+        uint64_t wrapped = 0;
+        for (size_t inx = 0; inx < ios.size(); inx++)
+        {
+            const STraceRecord& record = trace.records[inx];
+            uint64_t offset = (record.sector << SECTOR_SHIFT) & ~static_cast<uint64_t>(blockSize - 1);
+            uint64_t size = ((record.sector + record.count) << SECTOR_SHIFT) - offset;
+
+            size = (size + blockSize - 1) & ~static_cast<uint64_t>(blockSize - 1);
+            size = std::min(size, capacityBytes);
+            if (offset + size > capacityBytes)
+            {
+                offset = (offset % (capacityBytes - size + blockSize)) & ~static_cast<uint64_t>(blockSize - 1);
+                wrapped++;
+            }
+            ios[inx].offset = static_cast<off_t>(offset);
+            ios[inx].size = static_cast<size_t>(size);
+        }
+
+        /*
+         * The amount of data that the module copies to the difference
+         * storage, if each chunk is copied on the first write to it.
+         */
+        const unsigned int chunkShift = ChunkShift(capacity, DeviceIoMin(device), PageShift(), ModuleChunkParams());
+        std::vector<bool> chunks((capacityBytes >> chunkShift) + 1, false);
+        std::vector<uint64_t> cowBytes(ios.size() + 1, 0);
+        for (size_t inx = 0; inx < ios.size(); inx++)
+        {
+            uint64_t copied = 0;
+
+            for (uint64_t chunk = ios[inx].offset >> chunkShift;
+                 chunk <= ((ios[inx].offset + ios[inx].size - 1) >> chunkShift); chunk++)
+            {
+                if (!chunks[chunk])
+                {
+                    chunks[chunk] = true;
+                    copied += 1ULL << chunkShift;
+                }
+            }
+            cowBytes[inx + 1] = cowBytes[inx] + copied;
+        }
+
+        std::cout << "trace: " << ios.size() << " writes, " << trace.records.back().timeNs / 1000000 << " ms"
+                  << std::endl;
+        if (wrapped)
+            std::cout << "wrapped around: " << wrapped << " writes" << std::endl;
+        std::cout << "chunk size: " << (1ULL << chunkShift) << " bytes" << std::endl;
+
+        SReplayResult baseline = SReplayResult();
+        if (vm.count("baseline"))
+        {
+            baseline = Replay(device, ios, params, trace.records, [](SGrowthPoint& point, size_t) {
+                point.cowBytes = 0;
+                point.diffStorageBytes = 0;
+            });
+            PrintLatency("baseline", baseline);
+        }
+
+        std::string diffStorage = vm["diff_storage"].as<std::string>();
+        bool isTempFile = false;
+        if (fs::is_directory(diffStorage))
+        {
+            diffStorage = (fs::path(diffStorage) / ("blksnap-trace-" + std::to_string(getpid()) + ".diff")).string();
+            isTempFile = true;
+        }
+        if (!fs::exists(diffStorage))
+            std::ofstream(diffStorage).close();
+        const bool isFile = fs::is_regular_file(diffStorage);
+
+        SReplayResult snapshot;
+        uint64_t lowSpace = 0;
+        uint64_t noSpace = 0;
+        std::string errorMessage;
+        try
+        {
+            auto ptrSession = blksnap::ISession::Create({device}, diffStorage,
+                                                        ParseSize(vm["limit"].as<std::string>()));
+
+            snapshot = Replay(device, ios, params, trace.records, [&](SGrowthPoint& point, size_t issued) {
+                struct stat st;
+
+                point.cowBytes = cowBytes[issued];
+                point.diffStorageBytes = (isFile && !::stat(diffStorage.c_str(), &st)) ? st.st_size : 0;
+            });
+
+            lowSpace = ptrSession->GetEventCounter(blksnap_event_code_low_space).count;
+            noSpace = ptrSession->GetEventCounter(blksnap_event_code_no_space).count;
+            std::string message;
+            while (ptrSession->GetError(message))
+                errorMessage += message + "\n";
+        }
+        catch (std::exception&)
+        {
+            if (isTempFile)
+                fs::remove(diffStorage);
+            throw;
+        }
+        if (isTempFile)
+            fs::remove(diffStorage);
+
+        PrintLatency("snapshot", snapshot);
+        if (vm.count("baseline"))
+        {
+            SLatency before = CalculateLatency(baseline.latencies);
+            SLatency after = CalculateLatency(snapshot.latencies);
+
+            std::cout << "latency inflation: avg x" << Ratio(static_cast<double>(after.avgNs) / before.avgNs)
+                      << ", p50 x" << Ratio(static_cast<double>(after.p50Ns) / before.p50Ns) << ", p99 x"
+                      << Ratio(static_cast<double>(after.p99Ns) / before.p99Ns) << std::endl;
+        }
+
+        const SGrowthPoint& last = snapshot.curve.back();
+        std::cout << "written: " << MiB(last.writtenBytes) << " MiB" << std::endl;
+        std::cout << "copy-on-write: " << MiB(last.cowBytes) << " MiB, amplification x"
+                  << Ratio(static_cast<double>(last.cowBytes) / last.writtenBytes) << std::endl;
+        if (isFile)
+            std::cout << "difference storage: " << MiB(last.diffStorageBytes) << " MiB, amplification x"
+                      << Ratio(static_cast<double>(last.diffStorageBytes) / last.writtenBytes) << std::endl;
+        std::cout << "events: low_space " << lowSpace << ", no_space " << noSpace << std::endl;
+        if (!errorMessage.empty())
+            std::cout << "errors:" << std::endl << errorMessage;
+
+        std::cout << "growth curve:" << std::endl;
+        std::cout << "\ttime_ms\twritten_mib\tcow_mib\tdiff_storage_mib" << std::endl;
+        for (const SGrowthPoint& point : snapshot.curve)
+            std::cout << "\t" << point.elapsedNs / 1000000 << "\t" << MiB(point.writtenBytes) << "\t"
+                      << MiB(point.cowBytes) << "\t" << MiB(point.diffStorageBytes) << std::endl;
+
+        if (vm.count("csv"))
+        {
+            std::ofstream csv(vm["csv"].as<std::string>(), std::ios::trunc);
+
+            csv << "time_ms,written_bytes,cow_bytes,diff_storage_bytes" << std::endl;
+            for (const SGrowthPoint& point : snapshot.curve)
+                csv << point.elapsedNs / 1000000 << "," << point.writtenBytes << "," << point.cowBytes << ","
+                    << point.diffStorageBytes << std::endl;
+        }
+    };
+};
+
+static std::map<std::string, std::shared_ptr<IArgsProc>> argsProcMap{
+  {"capture", std::make_shared<CaptureArgsProc>()},
+  {"info", std::make_shared<InfoArgsProc>()},
+  {"replay", std::make_shared<ReplayArgsProc>()},
+};
+
+static void printUsage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "--help, -h or help:" << std::endl;
+    std::cout << "\tPrint this usage." << std::endl;
+    std::cout << "<command> [arguments]:" << std::endl;
+    std::cout << "\tExecute the command." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Available commands with arguments:" << std::endl;
+    for (const auto& it : argsProcMap)
+    {
+        std::cout << it.first << ":" << std::endl;
+        it.second->PrintUsage();
+    }
+}
+
+static void process(int argc, char** argv)
+{
+    if (argc < 2)
+        throw std::runtime_error("Command not found.");
+
+    std::string commandName(argv[1]);
+
+    const auto& itArgsProc = argsProcMap.find(commandName);
+    if (itArgsProc != argsProcMap.end())
+        itArgsProc->second->Process(--argc, ++argv);
+    else
+        if ((commandName == "help") || (commandName == "--help") || (commandName == "-h"))
+            printUsage();
+        else
+            throw std::runtime_error("Command is not set.");
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+
+    try
+    {
+        process(argc, argv);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        ret = 1;
+    }
+
+    return ret;
+}
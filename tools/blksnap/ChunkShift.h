@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0+
+#pragma once
+
+#include <algorithm>
+#include <blksnap/Sector.h>
+
+/*
+ * The parameters of the blksnap module that define the size of the chunk.
+ * The default values are the same as in the module.
+ */
+struct SChunkParams
+{
+    SChunkParams()
+        : minimumShift(18)
+        , maximumShift(26)
+        , maximumCountShift(40)
+    {};
+
+    unsigned int minimumShift;
+    unsigned int maximumShift;
+    unsigned int maximumCountShift;
+};
+
+/*
+ * The size of the chunk is calculated in the same way as the module does.
+ * The chunk is not smaller than the page and than the minimal I/O size of
+ * the original device. The capacity is in sectors, the minimal I/O size is
+ * in bytes.
+ */
+inline unsigned int ChunkShift(const unsigned long long capacity, const unsigned int ioMin,
+                               const unsigned int pageShift, const SChunkParams& params = SChunkParams())
+{
+    const unsigned long long maximumCount =
+        (params.maximumCountShift < 64) ? (1ULL << params.maximumCountShift) : ~0ULL;
+    unsigned int shift = pageShift;
+
+    while ((1ULL << (shift - SECTOR_SHIFT)) < (ioMin >> SECTOR_SHIFT))
+        shift++;
+    if (shift >= params.maximumShift)
+        return shift;
+
+    shift = std::max(shift, params.minimumShift);
+    while (((capacity + (1ULL << (shift - SECTOR_SHIFT)) - 1) >> (shift - SECTOR_SHIFT)) > maximumCount)
+    {
+        if (shift >= params.maximumShift)
+            return params.maximumShift;
+        shift++;
+    }
+    return shift;
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <cstring>
@@ -20,6 +21,9 @@
 #include <uuid/uuid.h>
 #include <linux/blksnap.h>
 #include <time.h>
+#include <blksnap/IncrementalExport.h>
+#include <blksnap/Snapshot.h>
+#include "ChunkShift.h"
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
@@ -325,6 +329,57 @@ namespace
 
         return S_ISBLK(st.st_mode);
     }
+
+    unsigned int ModuleParam(const std::string& name, const unsigned int defaultValue)
+    {
+        std::ifstream in("/sys/module/blksnap/parameters/" + name);
+        unsigned int value;
+
+        if (in >> value)
+            return value;
+        return defaultValue;
+    }
+
+    SChunkParams ModuleChunkParams()
+    {
+        SChunkParams params;
+
+        params.minimumShift = ModuleParam("chunk_minimum_shift", params.minimumShift);
+        params.maximumShift = ModuleParam("chunk_maximum_shift", params.maximumShift);
+        params.maximumCountShift = ModuleParam("chunk_maximum_count_shift", params.maximumCountShift);
+        return params;
+    }
+
+    unsigned int PageShift()
+    {
+        const long pageSize = ::sysconf(_SC_PAGESIZE);
+        unsigned int shift = SECTOR_SHIFT;
+
+        while ((1L << shift) < pageSize)
+            shift++;
+        return shift;
+    }
+
+    static unsigned long long parseDuration(std::string str)
+    {
+        unsigned long long multiple = 1;
+
+        if (str.empty())
+            throw std::invalid_argument("The duration is empty.");
+
+        switch (str.back())
+        {
+        case 'd':
+            multiple *= 24;
+        case 'h':
+            multiple *= 60;
+        case 'm':
+            multiple *= 60;
+        case 's':
+            str.pop_back();
+        }
+        return std::stoull(str) * multiple;
+    }
 } // namespace
 
 class IArgsProc
@@ -752,7 +807,7 @@ public:
     SnapshotTakeArgsProc()
         : IArgsProc()
     {
-        m_usage = std::string("Take snapshot.");
+        m_usage = std::string("Take snapshot. Prints the time spent on it.");
         m_desc.add_options()
             ("id,i", po::value<std::string>(), "Snapshot uuid.");
     };
@@ -769,6 +824,70 @@ public:
 
         if (::ioctl(blksnapFd.get(), IOCTL_BLKSNAP_SNAPSHOT_TAKE, &param))
             throw std::system_error(errno, std::generic_category(), "Failed to take snapshot");
+
+        struct blksnap_snapshot_timing timing = {0};
+        uuid_copy(timing.id.b, param.b);
+        if (::ioctl(blksnapFd.get(), IOCTL_BLKSNAP_SNAPSHOT_TIMING, &timing))
+        {
+            // The module does not support the timing
+            if (errno == ENOTTY)
+                return;
+            throw std::system_error(errno, std::generic_category(), "Failed to get snapshot timing");
+        }
+
+        std::vector<struct blksnap_device_timing> devices(timing.count);
+        if (timing.count)
+        {
+            timing.devices = (__u64)devices.data();
+            if (::ioctl(blksnapFd.get(), IOCTL_BLKSNAP_SNAPSHOT_TIMING, &timing))
+                throw std::system_error(errno, std::generic_category(), "Failed to get snapshot timing");
+        }
+
+        std::cout << "take_us=" << timing.take_ns / 1000 << std::endl;
+        std::cout << "frozen_us=" << timing.frozen_ns / 1000 << std::endl;
+        for (unsigned int inx = 0; inx < timing.count; inx++)
+            std::cout << "device=" << devices[inx].dev_id_mj << ":" << devices[inx].dev_id_mn
+                      << " freeze_us=" << devices[inx].freeze_ns / 1000
+                      << " switch_us=" << devices[inx].switch_ns / 1000
+                      << " thaw_us=" << devices[inx].thaw_ns / 1000 << std::endl;
+    };
+};
+
+class SnapshotAppendStorageArgsProc : public IArgsProc
+{
+public:
+    SnapshotAppendStorageArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Append block device to the difference storage on a block device.");
+        m_desc.add_options()
+            ("id,i", po::value<std::string>(), "Snapshot uuid.")
+            ("device,d", po::value<std::string>(), "Block device name.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        CBlksnapFileWrap blksnapFd;
+        struct blksnap_snapshot_append_storage param = {0};
+
+        if (!vm.count("id"))
+            throw std::invalid_argument("Argument 'id' is missed.");
+        if (!vm.count("device"))
+            throw std::invalid_argument("Argument 'device' is missed.");
+
+        uuid_copy(param.id.b, Uuid(vm["id"].as<std::string>()).Get());
+        std::string devicePath = vm["device"].as<std::string>();
+        param.devpath = (__u64)devicePath.c_str();
+
+        if (::ioctl(blksnapFd.get(), IOCTL_BLKSNAP_SNAPSHOT_APPEND_STORAGE, &param))
+        {
+            if (errno != EALREADY)
+                throw std::system_error(errno, std::generic_category(), "Failed to append difference storage");
+
+            std::cout << "result=already" << std::endl;
+            return;
+        }
+        std::cout << "result=ok" << std::endl;
     };
 };
 
@@ -840,6 +959,9 @@ public:
             case blksnap_event_code_no_space:
                 std::cout << "event=no_space" << std::endl;
                 break;
+            case blksnap_event_code_low_space:
+                std::cout << "event=low_space" << std::endl;
+                break;
             default:
                 std::cout << "event=" << param.code << std::endl;
             }
@@ -848,6 +970,78 @@ public:
 };
 
 
+class SnapshotStatsArgsProc : public IArgsProc
+{
+private:
+    static void PrintStats(const blksnap::SSnapshotStats& stats)
+    {
+        std::cout << "capacity_sect=" << stats.capacitySectors << std::endl;
+        std::cout << "limit_sect=" << stats.limitSectors << std::endl;
+        std::cout << "filled_sect=" << stats.filledSectors << std::endl;
+        std::cout << "requested_sect=" << stats.requestedSectors << std::endl;
+        std::cout << "reallocate_count=" << stats.reallocateCount << std::endl;
+        std::cout << "reallocate_us=" << stats.reallocateNs / 1000 << std::endl;
+        for (const blksnap::SDeviceStats& device : stats.devices)
+            std::cout << "device=" << device.origDevIdMj << ":" << device.origDevIdMn
+                      << " chunk_size=" << device.chunkSize
+                      << " chunk_count=" << device.chunkCount
+                      << " new=" << device.chunkNew
+                      << " in_memory=" << device.chunkInMemory
+                      << " stored=" << device.chunkStored
+                      << " failed=" << device.chunkFailed
+                      << " copied_sect=" << device.copiedSectors
+                      << " image_redirected_sect=" << device.imageRedirectedSectors
+                      << " image_memory_sect=" << device.imageMemorySectors
+                      << " image_stored_sect=" << device.imageStoredSectors << std::endl;
+    };
+
+public:
+    SnapshotStatsArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Get statistics of the snapshot.");
+        m_desc.add_options()
+            ("id,i", po::value<std::string>(), "Snapshot uuid.")
+            ("watch,w", po::value<unsigned int>()->implicit_value(1),
+                "Print the statistics periodically until the snapshot is destroyed. The interval in seconds can be set.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        if (!vm.count("id"))
+            throw std::invalid_argument("Argument 'id' is missed.");
+
+        auto ptrSnapshot = blksnap::CSnapshot::Open(blksnap::CSnapshotId(vm["id"].as<std::string>()));
+        if (!vm.count("watch"))
+        {
+            PrintStats(ptrSnapshot->Stats());
+            return;
+        }
+
+        const unsigned int interval = vm["watch"].as<unsigned int>();
+        if (!interval)
+            throw std::invalid_argument("Argument 'watch' should be greater than zero.");
+        while (true)
+        {
+            std::error_code ec;
+            blksnap::SSnapshotStats stats = ptrSnapshot->Stats(ec);
+
+            if (ec.value() == ESRCH)
+            {
+                std::cout << "The snapshot no longer exists." << std::endl;
+                break;
+            }
+            if (ec)
+                throw std::system_error(ec, "Failed to get snapshot statistics");
+
+            std::cout << "time=" << ::time(NULL) << std::endl;
+            PrintStats(stats);
+            std::cout << std::endl;
+            ::sleep(interval);
+        }
+    };
+};
+
 class SnapshotCollectArgsProc : public IArgsProc
 {
 private:
@@ -912,6 +1106,12 @@ private:
         std::cout << time_label << " - The the difference storage already grow up to "
                   << (data->requested_nr_sect / 2048) << " MiB. Limit has been reached." << std::endl;
     }
+    void ProcessEventLowSpace(unsigned int time_label, struct blksnap_event_low_space* data)
+    {
+        std::cout << time_label << " - The free space in the difference storage is running out. "
+                  << (data->free_nr_sect / 2048) << " MiB left, it is recommended to append "
+                  << (data->requested_nr_sect / 2048) << " MiB." << std::endl;
+    }
 
 public:
     SnapshotWatcherArgsProc()
@@ -968,6 +1168,10 @@ public:
                     ProcessEventNoSpace(param.time_label,
                             (struct blksnap_event_no_space*)param.data);
                     break;
+                case blksnap_event_code_low_space:
+                    ProcessEventLowSpace(param.time_label,
+                            (struct blksnap_event_low_space*)param.data);
+                    break;
                 default:
                     std::cout << param.time_label << " - unsupported event #" << param.code << "." << std::endl;
                 }
@@ -990,6 +1194,431 @@ public:
     };
 };
 
+class ExportArgsProc : public IArgsProc
+{
+private:
+    /*
+     * The header of the record in the stream to the standard output.
+     * The offset and the length are in bytes. The stream is finished with
+     * a record with zero length and offset equal to the image size.
+     */
+    struct SExportRecord
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    static void WriteAll(int fd, const void* buf, size_t length)
+    {
+        const char* ptr = static_cast<const char*>(buf);
+
+        while (length)
+        {
+            ssize_t ret = ::write(fd, ptr, length);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Failed to write to output.");
+            }
+            ptr += ret;
+            length -= ret;
+        }
+    };
+
+    static void PWriteAll(int fd, const void* buf, size_t length, off_t offset)
+    {
+        const char* ptr = static_cast<const char*>(buf);
+
+        while (length)
+        {
+            ssize_t ret = ::pwrite(fd, ptr, length, offset);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Failed to write to output file.");
+            }
+            ptr += ret;
+            offset += ret;
+            length -= ret;
+        }
+    };
+
+    static bool IsZeroed(const void* buf, size_t length)
+    {
+        const char* ptr = static_cast<const char*>(buf);
+
+        return (length == 0) || ((ptr[0] == 0) && !memcmp(ptr, ptr + 1, length - 1));
+    };
+
+public:
+    ExportArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Export the snapshot image. Only changed blocks are exported in incremental mode.");
+        m_desc.add_options()
+            ("device,d", po::value<std::string>(), "Original device name.")
+            ("output,o", po::value<std::string>(), "Output file name. The image is written to the sparse file. "
+                                                   "If '-' is set, the records are written to the standard output.")
+            ("incremental", "Export only the blocks changed since the previous export.")
+            ("generation,g", po::value<std::string>(), "The generation id of the change tracker from the previous export.")
+            ("changes_number,n", po::value<int>(), "The changes number from the previous export.")
+            ("block_size,b", po::value<std::string>(), "The size of a single read request. The suffixes M and K is allowed.")
+            ("workers,w", po::value<unsigned int>(), "The number of reading threads.")
+            ("queue_depth,q", po::value<unsigned int>(), "The number of requests in flight for each thread.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        blksnap::SReaderConfig config;
+
+        if (!vm.count("device"))
+            throw std::invalid_argument("Argument 'device' is missed.");
+        if (!vm.count("output"))
+            throw std::invalid_argument("Argument 'output' is missed.");
+
+        if (vm.count("block_size"))
+        {
+            std::string str = vm["block_size"].as<std::string>();
+            size_t multiple = 1;
+
+            switch (str.back())
+            {
+                case 'M':
+                    multiple *= 1024;
+                case 'K':
+                    multiple *= 1024;
+                    str.pop_back();
+                default:
+                    config.blockSize = std::stoull(str) * multiple;
+            }
+        }
+        if (vm.count("workers"))
+            config.workers = vm["workers"].as<unsigned int>();
+        if (vm.count("queue_depth"))
+            config.queueDepth = vm["queue_depth"].as<unsigned int>();
+        /*
+         * The data is written in the order of the offset. This makes the
+         * stream to the standard output sequential.
+         */
+        config.ordered = true;
+
+        auto ptrExport = blksnap::IIncrementalExport::Create(vm["device"].as<std::string>(), config);
+
+        if (vm.count("incremental"))
+        {
+            if (!vm.count("generation"))
+                throw std::invalid_argument("Argument 'generation' is missed.");
+            if (!vm.count("changes_number"))
+                throw std::invalid_argument("Argument 'changes_number' is missed.");
+
+            int changesNumber = vm["changes_number"].as<int>();
+            if ((changesNumber < 0) || (changesNumber > 255))
+                throw std::invalid_argument("Argument 'changes_number' is out of range.");
+
+            if (!ptrExport->SetBase(Uuid(vm["generation"].as<std::string>()).Get(),
+                                    static_cast<uint8_t>(changesNumber)))
+                std::cerr << "The change tracker generation does not match. The whole image will be exported."
+                          << std::endl;
+        }
+
+        const std::string output = vm["output"].as<std::string>();
+        const bool toStdout = (output == "-");
+        const unsigned long long capacity = ptrExport->GetCapacity();
+        unsigned long long exported = 0;
+
+        if (toStdout)
+        {
+            ptrExport->Export([&](const blksnap::SRange& range, const void* buffer) {
+                SExportRecord record = {range.sector << SECTOR_SHIFT, range.count << SECTOR_SHIFT};
+
+                WriteAll(STDOUT_FILENO, &record, sizeof(record));
+                WriteAll(STDOUT_FILENO, buffer, record.length);
+                exported += record.length;
+            });
+
+            SExportRecord record = {capacity, 0};
+            WriteAll(STDOUT_FILENO, &record, sizeof(record));
+        }
+        else
+        {
+            OpenFileHolder file(output, O_WRONLY | O_CREAT | O_LARGEFILE, 0600);
+            /*
+             * The incremental export updates the previous copy of the image.
+             * The whole image is written to an empty file, so the zeroed
+             * blocks can be left as holes.
+             */
+            const bool skipZeroed = !ptrExport->IsIncremental();
+
+            if (skipZeroed && ::ftruncate(file.Get(), 0))
+                throw std::system_error(errno, std::generic_category(), "Failed to truncate output file.");
+            if (::ftruncate(file.Get(), capacity))
+                throw std::system_error(errno, std::generic_category(), "Failed to set size of output file.");
+
+            ptrExport->Export([&](const blksnap::SRange& range, const void* buffer) {
+                size_t length = range.count << SECTOR_SHIFT;
+
+                if (!(skipZeroed && IsZeroed(buffer, length)))
+                    PWriteAll(file.Get(), buffer, length, range.sector << SECTOR_SHIFT);
+                exported += length;
+            });
+
+            if (::fsync(file.Get()))
+                throw std::system_error(errno, std::generic_category(), "Failed to flush output file.");
+        }
+
+        /*
+         * The result is printed to the error output if the data is written
+         * to the standard output.
+         */
+        std::ostream& out = toStdout ? std::cerr : std::cout;
+        auto ptrCbtInfo = ptrExport->GetCbtInfo();
+
+        out << "mode=" << (ptrExport->IsIncremental() ? "incremental" : "full") << std::endl;
+        out << "exported=" << exported << std::endl;
+        out << "generation_id=" << Uuid(ptrCbtInfo->generationId).ToString() << std::endl;
+        out << "changes_number=" << static_cast<int>(ptrCbtInfo->snapNumber) << std::endl;
+    };
+};
+
+class EstimateArgsProc : public IArgsProc
+{
+private:
+    /*
+     * The state of the change tracker of the device at the time when the
+     * estimate was called. The number of chunks that have been changed
+     * since the previous sample and the time between the samples are
+     * stored with it.
+     */
+    struct SSample
+    {
+        std::string device;
+        std::string generationId;
+        unsigned int changesNumber;
+        unsigned long long time;
+        unsigned long long changedChunks;
+        unsigned long long seconds;
+    };
+
+    static std::vector<SSample> ReadHistory(const std::string& filename)
+    {
+        std::vector<SSample> history;
+        std::ifstream input(filename);
+        SSample sample;
+
+        while (input >> sample.device >> sample.generationId >> sample.changesNumber >> sample.time
+                     >> sample.changedChunks >> sample.seconds)
+            history.push_back(sample);
+        return history;
+    };
+
+    static std::vector<unsigned char> ReadCbtMap(CBlkFilterCtl& ctl, const unsigned int blockCount)
+    {
+        std::vector<unsigned char> map(blockCount);
+        struct blksnap_cbtmap arg = {
+            .offset = 0,
+        };
+
+        while (arg.offset < blockCount) {
+            arg.length = std::min(32*1024u, blockCount - arg.offset);
+            arg.buffer = (__u64)(map.data() + arg.offset);
+
+            ctl.Control(BLKFILTER_CTL_BLKSNAP_CBTMAP, &arg, sizeof(struct blksnap_cbtmap));
+
+            arg.offset += arg.length;
+        }
+        return map;
+    };
+
+    /*
+     * The block of the change tracker contains the change number of the last
+     * snapshot interval in which it was written. The blocks with the numbers
+     * in the range (from, to] have been changed between the snapshots with
+     * these change numbers.
+     * The chunk is counted once, even if several blocks fall into it. If the
+     * block is larger than the chunk, all chunks of the block are counted,
+     * so the result is the upper bound.
+     */
+    static unsigned long long ChangedChunks(const std::vector<unsigned char>& map,
+                                            const struct blksnap_cbtinfo& info, const unsigned int chunkShift,
+                                            const unsigned int from, const unsigned int to,
+                                            unsigned long long& changedBlocks)
+    {
+        unsigned long long changedChunks = 0;
+        unsigned long long nextChunk = 0;
+
+        changedBlocks = 0;
+        for (unsigned long long inx = 0; inx < map.size(); inx++)
+        {
+            if ((map[inx] <= from) || (map[inx] > to))
+                continue;
+
+            const unsigned long long offset = inx * info.block_size;
+            const unsigned long long end = std::min(offset + info.block_size,
+                                                    static_cast<unsigned long long>(info.device_capacity));
+            const unsigned long long first = std::max(offset >> chunkShift, nextChunk);
+            const unsigned long long last = (end - 1) >> chunkShift;
+
+            changedBlocks++;
+            if (last >= first)
+                changedChunks += last - first + 1;
+            nextChunk = last + 1;
+        }
+        return changedChunks;
+    };
+
+public:
+    EstimateArgsProc()
+        : IArgsProc()
+    {
+        m_usage = std::string("Estimate the size of the difference storage using the change tracker.");
+        m_desc.add_options()
+            ("device,d", po::value<std::vector<std::string>>()->multitoken(), "Device name. It's multitoken argument.")
+            ("history,f", po::value<std::string>(),
+                "The file with the samples of the change tracker. The current sample is appended to it.")
+            ("interval,i", po::value<std::string>(),
+                "The time between the snapshots if there is no previous sample. The suffixes s, m, h and d are allowed.")
+            ("duration,t", po::value<std::string>(),
+                "The time while the snapshot is held during the backup. The suffixes s, m, h and d are allowed.")
+            ("margin,m", po::value<unsigned int>()->default_value(50), "The margin of the recommended limit in percent.");
+    };
+
+    void Execute(po::variables_map& vm) override
+    {
+        if (!vm.count("device"))
+            throw std::invalid_argument("Argument 'device' is missed.");
+        if (!vm.count("duration"))
+            throw std::invalid_argument("Argument 'duration' is missed.");
+        if (!vm.count("history") && !vm.count("interval"))
+            throw std::invalid_argument("Argument 'history' or 'interval' is missed.");
+
+        const unsigned long long duration = parseDuration(vm["duration"].as<std::string>());
+        const unsigned long long interval = vm.count("interval") ? parseDuration(vm["interval"].as<std::string>()) : 0;
+        const unsigned long long now = static_cast<unsigned long long>(::time(NULL));
+        std::vector<SSample> history;
+        std::vector<SSample> samples;
+        unsigned long long projected = 0;
+
+        if (vm.count("history"))
+            history = ReadHistory(vm["history"].as<std::string>());
+
+        for (const std::string& device : vm["device"].as<std::vector<std::string>>())
+        {
+            CBlkFilterCtl ctl(device);
+            struct blksnap_cbtinfo info;
+            ctl.Control(BLKFILTER_CTL_BLKSNAP_CBTINFO, &info, sizeof(info));
+
+            unsigned int ioMin = 0;
+            CDeviceCtl(device).Ioctl(BLKIOMIN, &ioMin);
+
+            const unsigned int chunkShift =
+                ChunkShift(info.device_capacity >> SECTOR_SHIFT, ioMin, PageShift(), ModuleChunkParams());
+            const unsigned long long chunkSize = 1ULL << chunkShift;
+            const unsigned long long chunkCount = (info.device_capacity + chunkSize - 1) >> chunkShift;
+            const std::vector<unsigned char> map = ReadCbtMap(ctl, info.block_count);
+            SSample sample = {device, Uuid(info.generation_id.b).ToString(), info.changes_number, now, 0, 0};
+            unsigned long long changedBlocks = 0;
+
+            std::vector<SSample> intervals;
+            const SSample* previous = nullptr;
+            for (const SSample& item : history)
+            {
+                if (item.device != device)
+                    continue;
+                if (item.seconds)
+                    intervals.push_back(item);
+                previous = &item;
+            }
+
+            if (previous && (previous->generationId == sample.generationId)
+                && (previous->changesNumber == sample.changesNumber))
+            {
+                /*
+                 * The snapshot has not been taken since the previous sample,
+                 * and the change tracker has not been changed.
+                 */
+            }
+            else
+            {
+                if (previous && (previous->generationId == sample.generationId)
+                    && (previous->changesNumber < sample.changesNumber))
+                {
+                    sample.changedChunks = ChangedChunks(map, info, chunkShift, previous->changesNumber,
+                                                         sample.changesNumber, changedBlocks);
+                    sample.seconds = now - previous->time;
+                }
+                else if (interval && sample.changesNumber)
+                {
+                    sample.changedChunks = ChangedChunks(map, info, chunkShift, sample.changesNumber - 1,
+                                                         sample.changesNumber, changedBlocks);
+                    sample.seconds = interval;
+                }
+
+                if (sample.seconds)
+                    intervals.push_back(sample);
+                samples.push_back(sample);
+            }
+
+            std::cout << "device=" << device << std::endl;
+            std::cout << "block_size=" << info.block_size << std::endl;
+            std::cout << "chunk_size=" << chunkSize << std::endl;
+            if (changedBlocks)
+                std::cout << "amplification="
+                          << static_cast<double>(sample.changedChunks * chunkSize) / (changedBlocks * info.block_size)
+                          << std::endl;
+
+            /*
+             * The peak rate of the changes is used for the projection. The
+             * chunk is copied to the difference storage only once while the
+             * snapshot is held, so the projection does not exceed the size
+             * of the device.
+             */
+            double peakRate = 0;
+            for (const SSample& item : intervals)
+            {
+                const double rate = static_cast<double>(item.changedChunks) / item.seconds;
+
+                std::cout << "interval=" << item.time << " seconds=" << item.seconds
+                          << " changed=" << item.changedChunks * chunkSize
+                          << " rate=" << static_cast<unsigned long long>(rate * chunkSize) << std::endl;
+                peakRate = std::max(peakRate, rate);
+            }
+            if (intervals.empty())
+            {
+                std::cout << "There are no intervals between the snapshots yet." << std::endl;
+                continue;
+            }
+
+            const unsigned long long chunks =
+                std::min(static_cast<unsigned long long>(std::ceil(peakRate * duration)), chunkCount);
+            std::cout << "projected=" << chunks * chunkSize << std::endl;
+            projected += chunks * chunkSize;
+        }
+
+        if (vm.count("history"))
+        {
+            std::ofstream output(vm["history"].as<std::string>(), std::ofstream::out | std::ofstream::app);
+
+            for (const SSample& sample : samples)
+                output << sample.device << " " << sample.generationId << " " << sample.changesNumber << " "
+                       << sample.time << " " << sample.changedChunks << " " << sample.seconds << std::endl;
+        }
+
+        /*
+         * The difference storage is expanded by the portions of the
+         * diff_storage_minimum size, so the limit is aligned to it.
+         */
+        const unsigned long long portion =
+            static_cast<unsigned long long>(ModuleParam("diff_storage_minimum", 2097152)) << SECTOR_SHIFT;
+        unsigned long long limit = projected + projected * vm["margin"].as<unsigned int>() / 100;
+
+        limit = std::max((limit + portion - 1) / portion, 1ULL) * portion;
+        std::cout << "total_projected=" << projected << std::endl;
+        std::cout << "recommended_limit=" << limit << std::endl;
+    };
+};
+
 static std::map<std::string, std::shared_ptr<IArgsProc>> argsProcMap{
   {"version", std::make_shared<VersionArgsProc>()},
   {"attach", std::make_shared<AttachArgsProc>()},
@@ -999,12 +1628,16 @@ static std::map<std::string, std::shared_ptr<IArgsProc>> argsProcMap{
   {"markdirtyblock", std::make_shared<MarkDirtyBlockArgsProc>()},
   {"snapshot_info", std::make_shared<SnapshotInfoArgsProc>()},
   {"snapshot_add", std::make_shared<SnapshotAddArgsProc>()},
+  {"snapshot_append_storage", std::make_shared<SnapshotAppendStorageArgsProc>()},
   {"snapshot_create", std::make_shared<SnapshotCreateArgsProc>()},
   {"snapshot_destroy", std::make_shared<SnapshotDestroyArgsProc>()},
   {"snapshot_take", std::make_shared<SnapshotTakeArgsProc>()},
   {"snapshot_waitevent", std::make_shared<SnapshotWaitEventArgsProc>()},
   {"snapshot_collect", std::make_shared<SnapshotCollectArgsProc>()},
+  {"snapshot_stats", std::make_shared<SnapshotStatsArgsProc>()},
   {"snapshot_watcher", std::make_shared<SnapshotWatcherArgsProc>()},
+  {"export", std::make_shared<ExportArgsProc>()},
+  {"estimate", std::make_shared<EstimateArgsProc>()},
 };
 
 static void printUsage()